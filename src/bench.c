@@ -0,0 +1,176 @@
+/*
+ * bench.c
+ *
+ * The scheduler benchmark.  Each simulation of the matrix runs in a forked
+ * child, which generates its workload, runs it and prints its own line of
+ * results, so that nothing one run allocates shows up in the peak RSS of
+ * the next.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "generator.h"
+#include "scheduler.h"
+
+/* The seed of every benchmark workload */
+#define BENCH_SEED 1
+
+/* The RR time slice (also the top MLFQ quantum and the ARR base slice), PA
+ * age weight and CFS target latency */
+#define BENCH_TIME_SLICE_MS 200
+#define BENCH_AGE_WEIGHT 1
+#define BENCH_CFS_LATENCY_MS 2000
+
+static const sched_algorithm_t bench_algorithms[] = { FCFS, PA, RR, SRTF, MLFQ, CFS, ARR };
+static const unsigned int bench_sizes[] = { 8, 100, 1000, 10000, 100000 };
+static const unsigned int bench_cpus[] = { 1, 4, 16, 64, 256 };
+
+/* The largest size and CPU count of the quick matrix */
+#define BENCH_QUICK_MAX_SIZE 10000
+#define BENCH_QUICK_MAX_CPUS 64
+
+#define ARRAY_LENGTH(a) (sizeof(a) / sizeof((a)[0]))
+
+/**
+ * monotonic_ms() returns the wall-clock time, in milliseconds.
+ */
+static double monotonic_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e3 + (double)now.tv_nsec / 1e6;
+}
+
+/**
+ * run_simulation() runs one simulation of the benchmark and prints its
+ * line of results.  It is called in the child process.
+ */
+static void run_simulation(const bench_t *bench, sched_algorithm_t algorithm,
+                           unsigned int processes, unsigned int cpus)
+{
+    generator_config_t generator;
+    workload_t workload;
+    simulator_options_t options = {
+        .engine = ENGINE_INLINE,
+        .fast_forward = true,
+        .quiet = true,
+        .pacing = PACE_UNTHROTTLED
+    };
+    scheduler_config_t config = {
+        .algorithm = algorithm,
+        .age_weight = (algorithm == PA) ? BENCH_AGE_WEIGHT : 0,
+        .time_slice_ms = (algorithm == RR || algorithm == MLFQ || algorithm == ARR) ?
+                         BENCH_TIME_SLICE_MS :
+                         (algorithm == CFS) ? BENCH_CFS_LATENCY_MS : 0,
+        .per_cpu_queues = bench->per_cpu_queues,
+        .mlfq_levels = MLFQ_DEFAULT_LEVELS,
+        .mlfq_boost_ms = MLFQ_DEFAULT_BOOST_MS
+    };
+    simulator_stats_t stats;
+    scheduler_t *scheduler;
+    struct rusage usage;
+    unsigned long long schedule_ns = 0;
+    double start, wall_ms;
+
+    generator_defaults(&generator);
+    generator.count = processes;
+    generator.seed = BENCH_SEED;
+    generate_workload(&workload, &generator);
+    options.workload = &workload;
+
+    scheduler = scheduler_create(cpus, &config);
+    start = monotonic_ms();
+    start_simulator(cpus, &options, scheduler, &stats);
+    wall_ms = monotonic_ms() - start;
+    scheduler_destroy(scheduler);
+    workload_free(&workload);
+
+    for (unsigned int c = SIM_CALLBACK_IDLE; c <= SIM_CALLBACK_TERMINATE; c++) {
+        schedule_ns += stats.counters.callback_ns[c];
+    }
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%s,%u,%u,%u,%u,%.3f,%.0f,%.1f,%.1f,%ld\n",
+           scheduler_algorithm_name(algorithm), processes, cpus,
+           stats.execution_time, stats.context_switches, wall_ms,
+           wall_ms > 0.0 ? (double)stats.context_switches / (wall_ms / 1e3) : 0.0,
+           stats.context_switches ? (double)schedule_ns / (double)stats.context_switches : 0.0,
+           stats.counters.callback_calls[SIM_CALLBACK_WAKE_UP] ?
+               (double)stats.counters.callback_ns[SIM_CALLBACK_WAKE_UP] /
+               (double)stats.counters.callback_calls[SIM_CALLBACK_WAKE_UP] : 0.0,
+           usage.ru_maxrss);
+}
+
+/**
+ * fork_simulation() runs one simulation in a child process and waits for it.
+ *
+ * @return false if the child could not be started or did not exit cleanly
+ */
+static bool fork_simulation(const bench_t *bench, sched_algorithm_t algorithm,
+                            unsigned int processes, unsigned int cpus)
+{
+    pid_t pid;
+    int status;
+
+    /* Anything still buffered would be written by the child too */
+    fflush(stdout);
+
+    pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        run_simulation(bench, algorithm, processes, cpus);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        return false;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Benchmark of %s with %u processes on %u CPUs failed\n",
+                scheduler_algorithm_name(algorithm), processes, cpus);
+        return false;
+    }
+    return true;
+}
+
+extern int run_bench(const bench_t *bench)
+{
+    bool failed = false;
+
+    printf("algorithm,processes,cpus,ticks,decisions,wall_ms,decisions_per_sec,"
+           "ns_per_schedule,ns_per_wake_up,peak_rss_kb\n");
+
+    for (unsigned int a = 0; a < ARRAY_LENGTH(bench_algorithms); a++) {
+        /* MLFQ has no per-CPU queues, so its rows would repeat the shared ones */
+        if (bench->per_cpu_queues && bench_algorithms[a] == MLFQ) {
+            continue;
+        }
+        for (unsigned int s = 0; s < ARRAY_LENGTH(bench_sizes); s++) {
+            if (bench->quick && bench_sizes[s] > BENCH_QUICK_MAX_SIZE) {
+                continue;
+            }
+            for (unsigned int c = 0; c < ARRAY_LENGTH(bench_cpus); c++) {
+                if (bench->quick && bench_cpus[c] > BENCH_QUICK_MAX_CPUS) {
+                    continue;
+                }
+                if (!fork_simulation(bench, bench_algorithms[a], bench_sizes[s], bench_cpus[c])) {
+                    failed = true;
+                }
+            }
+        }
+    }
+
+    return failed ? -1 : 0;
+}
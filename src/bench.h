@@ -0,0 +1,54 @@
+/*
+ * bench.h
+ *
+ * The scheduler benchmark: every algorithm over a fixed matrix of generated
+ * workload sizes and CPU counts, reporting what the scheduler itself costs
+ * as CSV, so results can be kept and compared from run to run.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * A benchmark runs every algorithm for every workload size and CPU count
+ * of its matrix:
+ *
+ *   full  : 8, 100, 1000, 10000 and 100000 processes on 1, 4, 16, 64 and
+ *           256 CPUs
+ *   quick : the same up to 10000 processes and 64 CPUs, for a short check
+ *
+ * The workloads come from the generator with its defaults and a fixed seed,
+ * so every run of the benchmark simulates the same processes.  With
+ * per_cpu_queues MLFQ is left out, as it only has shared levels.
+ */
+typedef struct
+{
+    bool quick;
+    bool per_cpu_queues;
+} bench_t;
+
+/*
+ * run_bench() runs the benchmark and prints its results to stdout, a CSV
+ * header and then one line per simulation:
+ *
+ *          algorithm : FCFS, PA, RR, SRTF, MLFQ, CFS or ARR
+ *          processes : the number of processes
+ *               cpus : the number of CPUs
+ *              ticks : the simulated time, in ticks
+ *          decisions : scheduling decisions, i.e. context switches
+ *            wall_ms : wall-clock time of the simulation
+ *  decisions_per_sec : decisions per second of wall_ms
+ *    ns_per_schedule : time in the CPU callbacks (idle, preempt, yield and
+ *                      terminate, which all end in schedule()) per decision
+ *     ns_per_wake_up : time per wake_up(), including any preemption it
+ *                      forces
+ *        peak_rss_kb : the peak resident set size of the simulation
+ *
+ * Each simulation runs in a child process of its own, so that its peak RSS
+ * is its own, using the inline engine, which gives the same decisions every
+ * time, with fast-forward on and nothing printed.
+ *
+ * @return 0, or -1 if a simulation failed, to be used as the exit status
+ */
+extern int run_bench(const bench_t *bench);
@@ -0,0 +1,140 @@
+/*
+ * checkpoint.c
+ *
+ * Reading and writing the fields of a checkpoint file.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "checkpoint.h"
+
+extern bool checkpoint_create(checkpoint_t *checkpoint, const char *path)
+{
+    checkpoint->path = path;
+    checkpoint->failed = false;
+    checkpoint->error = NULL;
+    checkpoint->file = fopen(path, "wb");
+    if (checkpoint->file == NULL) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    checkpoint_write_u32(checkpoint, CHECKPOINT_MAGIC);
+    checkpoint_write_u32(checkpoint, CHECKPOINT_VERSION);
+    return true;
+}
+
+extern bool checkpoint_open(checkpoint_t *checkpoint, const char *path)
+{
+    checkpoint->path = path;
+    checkpoint->failed = false;
+    checkpoint->error = NULL;
+    checkpoint->file = fopen(path, "rb");
+    if (checkpoint->file == NULL) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    checkpoint_expect_u32(checkpoint, CHECKPOINT_MAGIC, "not a checkpoint file");
+    checkpoint_expect_u32(checkpoint, CHECKPOINT_VERSION, "unsupported checkpoint version");
+    if (checkpoint->failed) {
+        return checkpoint_close(checkpoint);
+    }
+    return true;
+}
+
+extern bool checkpoint_close(checkpoint_t *checkpoint)
+{
+    if (fclose(checkpoint->file) != 0) {
+        checkpoint_fail(checkpoint, strerror(errno));
+    }
+    checkpoint->file = NULL;
+    if (checkpoint->failed) {
+        fprintf(stderr, "Error: %s: %s.\n", checkpoint->path, checkpoint->error);
+    }
+    return !checkpoint->failed;
+}
+
+extern void checkpoint_fail(checkpoint_t *checkpoint, const char *error)
+{
+    if (!checkpoint->failed) {
+        checkpoint->failed = true;
+        checkpoint->error = error;
+    }
+}
+
+extern void checkpoint_write(checkpoint_t *checkpoint, const void *data, size_t size)
+{
+    if (checkpoint->failed || size == 0) {
+        return;
+    }
+    if (fwrite(data, size, 1, checkpoint->file) != 1) {
+        checkpoint_fail(checkpoint, "could not write checkpoint");
+    }
+}
+
+extern void checkpoint_read(checkpoint_t *checkpoint, void *data, size_t size)
+{
+    if (!checkpoint->failed && size > 0 && fread(data, size, 1, checkpoint->file) != 1) {
+        checkpoint_fail(checkpoint, "checkpoint is truncated");
+    }
+    if (checkpoint->failed) {
+        memset(data, 0, size);
+    }
+}
+
+extern void checkpoint_write_u32(checkpoint_t *checkpoint, unsigned int value)
+{
+    checkpoint_write(checkpoint, &value, sizeof(value));
+}
+
+extern unsigned int checkpoint_read_u32(checkpoint_t *checkpoint)
+{
+    unsigned int value;
+
+    checkpoint_read(checkpoint, &value, sizeof(value));
+    return value;
+}
+
+extern void checkpoint_write_u64(checkpoint_t *checkpoint, unsigned long long value)
+{
+    checkpoint_write(checkpoint, &value, sizeof(value));
+}
+
+extern unsigned long long checkpoint_read_u64(checkpoint_t *checkpoint)
+{
+    unsigned long long value;
+
+    checkpoint_read(checkpoint, &value, sizeof(value));
+    return value;
+}
+
+extern void checkpoint_expect_u32(checkpoint_t *checkpoint, unsigned int value,
+                                  const char *error)
+{
+    if (checkpoint_read_u32(checkpoint) != value) {
+        checkpoint_fail(checkpoint, error);
+    }
+}
+
+extern void checkpoint_write_pcb(checkpoint_t *checkpoint, const pcb_t *pcb)
+{
+    checkpoint_write_u32(checkpoint, pcb != NULL ? simulator_process_index(pcb) :
+                                                   CHECKPOINT_NO_PCB);
+}
+
+extern pcb_t *checkpoint_read_pcb(checkpoint_t *checkpoint)
+{
+    unsigned int index = checkpoint_read_u32(checkpoint);
+
+    if (checkpoint->failed || index == CHECKPOINT_NO_PCB) {
+        return NULL;
+    }
+    if (index >= simulator_process_count() ||
+        simulator_process(index)->state == PROCESS_TERMINATED) {
+        checkpoint_fail(checkpoint, "checkpoint names a process that is not live");
+        return NULL;
+    }
+    return simulator_process(index);
+}
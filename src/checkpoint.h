@@ -0,0 +1,100 @@
+/*
+ * checkpoint.h
+ *
+ * Checkpoints: the whole state of an inline simulation at the start of a
+ * tick, written to a file so that it can be resumed from there later.
+ *
+ * A checkpoint file is a sequence of fields in native byte order, written
+ * and read back in the same order by the simulator (os-sim.c) and then the
+ * scheduler (scheduler.c), each of which knows its own layout:
+ *
+ *   header    : magic ("OSCK"), version (3), then what the restoring
+ *               simulation must match: the CPUs and topology, and the I/O
+ *               devices and their channels
+ *   simulator : the clock, the counters and a fingerprint of every process
+ *               created so far, then each process slot: for a live process
+ *               its name, what is left of its ops, the fields of its PCB
+ *               and its accounting.  Then the histograms, each CPU's
+ *               process and preemption timer, and the waiting and
+ *               in-service requests of each I/O device
+ *   scheduler : current[], and every ready queue in the order it is
+ *               dequeued in
+ *
+ * The workload itself is not in the file: a checkpoint is restored with
+ * the same workload, whose processes created before the checkpoint are
+ * skipped and checked against the fingerprint, and the rest created as
+ * they arrive.  A PCB is written as the index of its process slot.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "os-sim.h"
+
+#define CHECKPOINT_MAGIC 0x4b43534fu   /* "OSCK" in little-endian byte order */
+#define CHECKPOINT_VERSION 3
+
+/* The index written for a NULL PCB */
+#define CHECKPOINT_NO_PCB 0xffffffffu
+
+/*
+ * An open checkpoint file.  failed is set by the first write or read that
+ * goes wrong, with error saying why; every later call then does nothing,
+ * and a read returns zeros, so a caller only checks once it is done.
+ */
+typedef struct
+{
+    FILE *file;
+    const char *path;
+    bool failed;
+    const char *error;
+} checkpoint_t;
+
+/*
+ * checkpoint_create() opens a checkpoint file for writing and writes its
+ * magic and version.  checkpoint_open() opens one for reading and checks
+ * them.
+ *
+ * @return false, after printing why, if the file cannot be used
+ */
+extern bool checkpoint_create(checkpoint_t *checkpoint, const char *path);
+extern bool checkpoint_open(checkpoint_t *checkpoint, const char *path);
+
+/*
+ * checkpoint_close() closes a checkpoint file.
+ *
+ * @return false, after printing why, if any write or read failed
+ */
+extern bool checkpoint_close(checkpoint_t *checkpoint);
+
+/*
+ * checkpoint_fail() marks a checkpoint as failed, if it has not already
+ * failed, for a reason found by the caller, e.g. a field that does not
+ * match the simulation restoring it.
+ */
+extern void checkpoint_fail(checkpoint_t *checkpoint, const char *error);
+
+/* Writing and reading raw bytes, and single fields */
+extern void checkpoint_write(checkpoint_t *checkpoint, const void *data, size_t size);
+extern void checkpoint_read(checkpoint_t *checkpoint, void *data, size_t size);
+extern void checkpoint_write_u32(checkpoint_t *checkpoint, unsigned int value);
+extern unsigned int checkpoint_read_u32(checkpoint_t *checkpoint);
+extern void checkpoint_write_u64(checkpoint_t *checkpoint, unsigned long long value);
+extern unsigned long long checkpoint_read_u64(checkpoint_t *checkpoint);
+
+/*
+ * checkpoint_expect_u32() reads a field and fails the checkpoint with
+ * error unless it holds value.
+ */
+extern void checkpoint_expect_u32(checkpoint_t *checkpoint, unsigned int value,
+                                  const char *error);
+
+/*
+ * checkpoint_write_pcb() writes a PCB of the running simulation as its
+ * slot index, or CHECKPOINT_NO_PCB for NULL.  checkpoint_read_pcb() reads
+ * one back, failing the checkpoint on an index that is not a live slot.
+ */
+extern void checkpoint_write_pcb(checkpoint_t *checkpoint, const pcb_t *pcb);
+extern pcb_t *checkpoint_read_pcb(checkpoint_t *checkpoint);
@@ -0,0 +1,153 @@
+/*
+ * cpumask.c
+ *
+ * A bitmap with one bit per CPU.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "cpumask.h"
+
+/**
+ * cpumask_init() allocates an empty mask for cpu_count CPUs.
+ */
+void cpumask_init(cpumask_t *mask, unsigned int cpu_count)
+{
+    mask->cpu_count = cpu_count;
+    mask->word_count = (unsigned int)((cpu_count + CPUMASK_WORD_BITS - 1) / CPUMASK_WORD_BITS);
+    mask->words = calloc(mask->word_count, sizeof(unsigned long));
+    assert(mask->words != NULL);
+}
+
+void cpumask_set(cpumask_t *mask, unsigned int cpu_id)
+{
+    assert(cpu_id < mask->cpu_count);
+    mask->words[cpu_id / CPUMASK_WORD_BITS] |= 1UL << (cpu_id % CPUMASK_WORD_BITS);
+}
+
+void cpumask_clear(cpumask_t *mask, unsigned int cpu_id)
+{
+    assert(cpu_id < mask->cpu_count);
+    mask->words[cpu_id / CPUMASK_WORD_BITS] &= ~(1UL << (cpu_id % CPUMASK_WORD_BITS));
+}
+
+bool cpumask_test(const cpumask_t *mask, unsigned int cpu_id)
+{
+    assert(cpu_id < mask->cpu_count);
+    return (mask->words[cpu_id / CPUMASK_WORD_BITS] >> (cpu_id % CPUMASK_WORD_BITS)) & 1UL;
+}
+
+/**
+ * cpumask_first() returns the lowest CPU in the mask, or -1 if it is empty.
+ * This costs one find-first-set per word of the mask.
+ */
+int cpumask_first(const cpumask_t *mask)
+{
+    for (unsigned int w = 0; w < mask->word_count; w++) {
+        if (mask->words[w] != 0)
+            return (int)(w * CPUMASK_WORD_BITS + (unsigned int)__builtin_ctzl(mask->words[w]));
+    }
+    return -1;
+}
+
+/**
+ * cpumask_next() returns the lowest CPU in the mask above cpu_id, or -1 if
+ * there is none.
+ */
+int cpumask_next(const cpumask_t *mask, unsigned int cpu_id)
+{
+    unsigned int next = cpu_id + 1;
+    unsigned int w = (unsigned int)(next / CPUMASK_WORD_BITS);
+    unsigned long word;
+
+    if (next >= mask->cpu_count)
+        return -1;
+
+    word = mask->words[w] & (~0UL << (next % CPUMASK_WORD_BITS));
+    while (1) {
+        if (word != 0)
+            return (int)(w * CPUMASK_WORD_BITS + (unsigned int)__builtin_ctzl(word));
+        if (++w >= mask->word_count)
+            return -1;
+        word = mask->words[w];
+    }
+}
+
+/**
+ * cpumask_weight() returns the number of CPUs in the mask.
+ */
+unsigned int cpumask_weight(const cpumask_t *mask)
+{
+    unsigned int weight = 0;
+
+    for (unsigned int w = 0; w < mask->word_count; w++)
+        weight += (unsigned int)__builtin_popcountl(mask->words[w]);
+    return weight;
+}
+
+void cpumask_set_atomic(cpumask_t *mask, unsigned int cpu_id)
+{
+    assert(cpu_id < mask->cpu_count);
+    __atomic_fetch_or(&mask->words[cpu_id / CPUMASK_WORD_BITS],
+                      1UL << (cpu_id % CPUMASK_WORD_BITS), __ATOMIC_SEQ_CST);
+}
+
+/**
+ * cpumask_test_and_clear_atomic() clears a CPU's bit and returns whether it
+ * was set, so exactly one caller wins when several race for the same bit.
+ */
+bool cpumask_test_and_clear_atomic(cpumask_t *mask, unsigned int cpu_id)
+{
+    unsigned long bit = 1UL << (cpu_id % CPUMASK_WORD_BITS);
+
+    assert(cpu_id < mask->cpu_count);
+    return (__atomic_fetch_and(&mask->words[cpu_id / CPUMASK_WORD_BITS], ~bit,
+                               __ATOMIC_SEQ_CST) & bit) != 0;
+}
+
+/**
+ * cpumask_claim_first_atomic() clears the lowest set bit and returns its
+ * CPU, or returns -1 if the mask is empty.
+ */
+int cpumask_claim_first_atomic(cpumask_t *mask)
+{
+    for (unsigned int w = 0; w < mask->word_count; w++) {
+        unsigned long word = __atomic_load_n(&mask->words[w], __ATOMIC_SEQ_CST);
+
+        while (word != 0) {
+            unsigned int cpu_id = (unsigned int)(w * CPUMASK_WORD_BITS +
+                                                 (unsigned int)__builtin_ctzl(word));
+            if (cpumask_test_and_clear_atomic(mask, cpu_id))
+                return (int)cpu_id;
+            word = __atomic_load_n(&mask->words[w], __ATOMIC_SEQ_CST);
+        }
+    }
+    return -1;
+}
+
+/**
+ * cpumask_claim_range_atomic() is cpumask_claim_first_atomic() for the CPUs
+ * from first up to, but not including, end.
+ */
+int cpumask_claim_range_atomic(cpumask_t *mask, unsigned int first, unsigned int end)
+{
+    unsigned int cpu_id = first;
+
+    while (cpu_id < end) {
+        unsigned int w = (unsigned int)(cpu_id / CPUMASK_WORD_BITS);
+        unsigned long word = __atomic_load_n(&mask->words[w], __ATOMIC_SEQ_CST) &
+                             (~0UL << (cpu_id % CPUMASK_WORD_BITS));
+
+        if (word == 0) {
+            cpu_id = (unsigned int)((w + 1) * CPUMASK_WORD_BITS);
+            continue;
+        }
+        cpu_id = (unsigned int)(w * CPUMASK_WORD_BITS + (unsigned int)__builtin_ctzl(word));
+        if (cpu_id >= end)
+            return -1;
+        if (cpumask_test_and_clear_atomic(mask, cpu_id))
+            return (int)cpu_id;
+    }
+    return -1;
+}
@@ -0,0 +1,37 @@
+/*
+ * cpumask.h
+ *
+ * A bitmap with one bit per CPU, sized at runtime so that the simulator is
+ * not limited to a fixed number of CPUs.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#define CPUMASK_WORD_BITS (8 * sizeof(unsigned long))
+
+typedef struct
+{
+    unsigned long *words;
+    unsigned int word_count;
+    unsigned int cpu_count;
+} cpumask_t;
+
+/* CPU mask function declarations */
+void cpumask_init(cpumask_t *mask, unsigned int cpu_count);
+void cpumask_set(cpumask_t *mask, unsigned int cpu_id);
+void cpumask_clear(cpumask_t *mask, unsigned int cpu_id);
+bool cpumask_test(const cpumask_t *mask, unsigned int cpu_id);
+int cpumask_first(const cpumask_t *mask);
+int cpumask_next(const cpumask_t *mask, unsigned int cpu_id);
+unsigned int cpumask_weight(const cpumask_t *mask);
+
+/*
+ * Atomic variants, for masks that are shared without a lock.  Each one is a
+ * sequentially consistent read-modify-write on a single word.
+ */
+void cpumask_set_atomic(cpumask_t *mask, unsigned int cpu_id);
+bool cpumask_test_and_clear_atomic(cpumask_t *mask, unsigned int cpu_id);
+int cpumask_claim_first_atomic(cpumask_t *mask);
+int cpumask_claim_range_atomic(cpumask_t *mask, unsigned int first, unsigned int end);
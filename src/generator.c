@@ -0,0 +1,325 @@
+/*
+ * generator.c
+ *
+ * The synthetic workload generator.
+ *
+ * generate_workload() first decides the class and the number of bursts of
+ * every process, which gives the exact size of the arena, then fills in
+ * the PCBs, ops and names in one pass.  It uses its own random number
+ * generator, so a seed gives the same workload on every platform and
+ * generating is safe on any thread.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "generator.h"
+
+/* Limits that keep a process's total time well inside 32 bits */
+#define MAX_BURSTS 1000
+#define MAX_BURST_LENGTH 100000
+
+typedef struct
+{
+    uint64_t state;
+} rng_t;
+
+/**
+ * rng_next() is splitmix64: small, fast and good enough for workloads.
+ */
+static uint64_t rng_next(rng_t *rng)
+{
+    uint64_t z = (rng->state += 0x9e3779b97f4a7c15ull);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * rng_uniform() returns a uniformly distributed double in [0, 1).
+ */
+static double rng_uniform(rng_t *rng)
+{
+    return (double)(rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * sample() draws one value from a distribution.
+ */
+static double sample(rng_t *rng, const distribution_t *dist)
+{
+    double u = rng_uniform(rng);
+
+    switch (dist->kind) {
+    case DIST_UNIFORM:
+        return floor(dist->a + u * (dist->b - dist->a + 1.0));
+    case DIST_EXPONENTIAL:
+        return -dist->a * log1p(-u);
+    case DIST_PARETO: {
+        /* The scale that gives mean a for shape b */
+        double scale = dist->a * (dist->b - 1.0) / dist->b;
+        return scale / pow(1.0 - u, 1.0 / dist->b);
+    }
+    default:
+        return dist->a;
+    }
+}
+
+/**
+ * sample_ticks() draws a whole number of ticks, from 1 to limit.
+ */
+static unsigned int sample_ticks(rng_t *rng, const distribution_t *dist,
+                                 unsigned int limit)
+{
+    double value = ceil(sample(rng, dist));
+
+    if (!(value >= 1.0)) {
+        return 1;
+    }
+    if (value > (double)limit) {
+        return limit;
+    }
+    return (unsigned int)value;
+}
+
+extern void generator_defaults(generator_config_t *config)
+{
+    config->count = 1000;
+    config->seed = 1;
+    config->cpu_bound_fraction = 0.5;
+    config->arrival_mean = 10.0;
+    config->priorities = 8;
+    config->io_devices = 1;
+    config->bursts = (distribution_t){ DIST_UNIFORM, 5.0, 25.0 };
+    config->io_cpu = (distribution_t){ DIST_EXPONENTIAL, 2.0, 0.0 };
+    config->io_io = (distribution_t){ DIST_PARETO, 4.0, 1.5 };
+    config->cpu_cpu = (distribution_t){ DIST_EXPONENTIAL, 8.0, 0.0 };
+    config->cpu_io = (distribution_t){ DIST_EXPONENTIAL, 3.0, 0.0 };
+}
+
+/**
+ * parse_distribution() parses fixed:a, uniform:a:b, exp:mean or
+ * pareto:mean:shape, up to the next comma.
+ *
+ * @return a pointer past the distribution, or NULL if it is not valid
+ */
+static const char *parse_distribution(const char *text, distribution_t *dist)
+{
+    static const struct {
+        const char *name;
+        distribution_kind_t kind;
+        unsigned int params;
+    } kinds[] = {
+        { "fixed", DIST_FIXED, 1 },
+        { "uniform", DIST_UNIFORM, 2 },
+        { "exp", DIST_EXPONENTIAL, 1 },
+        { "pareto", DIST_PARETO, 2 },
+    };
+    double params[2] = { 0.0, 0.0 };
+    unsigned int n, k;
+    char *end;
+
+    for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+        size_t length = strlen(kinds[k].name);
+        if (strncmp(text, kinds[k].name, length) == 0 && text[length] == ':') {
+            break;
+        }
+    }
+    if (k == sizeof(kinds) / sizeof(kinds[0])) {
+        return NULL;
+    }
+
+    text += strlen(kinds[k].name);
+    for (n = 0; n < kinds[k].params; n++) {
+        if (*text != ':') {
+            return NULL;
+        }
+        params[n] = strtod(text + 1, &end);
+        if (end == text + 1 || !(params[n] >= 0.0)) {
+            return NULL;
+        }
+        text = end;
+    }
+
+    if ((kinds[k].kind == DIST_UNIFORM && params[1] < params[0]) ||
+        (kinds[k].kind == DIST_PARETO && !(params[1] > 1.0))) {
+        return NULL;
+    }
+    dist->kind = kinds[k].kind;
+    dist->a = params[0];
+    dist->b = params[1];
+    return text;
+}
+
+extern bool generator_parse(generator_config_t *config, const char *spec)
+{
+    static const struct {
+        const char *key;
+        size_t offset;
+    } distributions[] = {
+        { "bursts", offsetof(generator_config_t, bursts) },
+        { "io-cpu", offsetof(generator_config_t, io_cpu) },
+        { "io-io", offsetof(generator_config_t, io_io) },
+        { "cpu-cpu", offsetof(generator_config_t, cpu_cpu) },
+        { "cpu-io", offsetof(generator_config_t, cpu_io) },
+    };
+    const char *text = spec;
+
+    while (*text != '\0') {
+        const char *value = strchr(text, '=');
+        const char *next = NULL;
+        size_t key_length;
+        char *end;
+
+        if (value == NULL) {
+            break;
+        }
+        key_length = (size_t)(value - text);
+        value++;
+
+#define KEY_IS(k) (key_length == strlen(k) && strncmp(text, k, key_length) == 0)
+        if (KEY_IS("count")) {
+            unsigned long count = strtoul(value, &end, 0);
+            if (end != value && count > 0 && count <= UINT32_MAX) {
+                config->count = (unsigned int)count;
+                next = end;
+            }
+        } else if (KEY_IS("seed")) {
+            config->seed = strtoull(value, &end, 0);
+            next = (end != value) ? end : NULL;
+        } else if (KEY_IS("cpu-bound")) {
+            config->cpu_bound_fraction = strtod(value, &end);
+            if (end != value && config->cpu_bound_fraction >= 0.0 &&
+                config->cpu_bound_fraction <= 1.0) {
+                next = end;
+            }
+        } else if (KEY_IS("arrival")) {
+            config->arrival_mean = strtod(value, &end);
+            if (end != value && config->arrival_mean >= 0.0) {
+                next = end;
+            }
+        } else if (KEY_IS("io-devices")) {
+            unsigned long io_devices = strtoul(value, &end, 0);
+            if (end != value && io_devices > 0 && io_devices <= UINT32_MAX) {
+                config->io_devices = (unsigned int)io_devices;
+                next = end;
+            }
+        } else if (KEY_IS("priorities")) {
+            unsigned long priorities = strtoul(value, &end, 0);
+            if (end != value && priorities > 0 && priorities <= UINT32_MAX) {
+                config->priorities = (unsigned int)priorities;
+                next = end;
+            }
+        } else {
+            for (unsigned int n = 0; n < sizeof(distributions) / sizeof(distributions[0]); n++) {
+                if (KEY_IS(distributions[n].key)) {
+                    next = parse_distribution(value, (distribution_t *)(void *)
+                                              ((char *)config + distributions[n].offset));
+                    break;
+                }
+            }
+        }
+#undef KEY_IS
+
+        if (next == NULL || (*next != ',' && *next != '\0')) {
+            break;
+        }
+        text = (*next == ',') ? next + 1 : next;
+    }
+
+    if (*text != '\0') {
+        fprintf(stderr, "Error: Invalid generator setting: %s\n", text);
+        return false;
+    }
+    return true;
+}
+
+extern void generate_workload(workload_t *workload, const generator_config_t *config)
+{
+    unsigned int count = config->count;
+    unsigned char *cpu_bound = malloc(count ? count : 1);
+    unsigned int *bursts = malloc(sizeof(unsigned int) * (count ? count : 1));
+    size_t op_total = 0, names_size = 0;
+    rng_t rng = { .state = config->seed };
+    double clock = 0.0;
+    op_t *ops;
+    char *names;
+
+    assert(cpu_bound != NULL && bursts != NULL);
+
+    /* Decide the shape of every process, to size the arena */
+    for (unsigned int n = 0; n < count; n++) {
+        cpu_bound[n] = rng_uniform(&rng) < config->cpu_bound_fraction;
+        bursts[n] = sample_ticks(&rng, &config->bursts, MAX_BURSTS);
+        op_total += 2 * (size_t)bursts[n];
+        names_size += (size_t)snprintf(NULL, 0, "%c%u", 'I', n) + 1;
+    }
+
+    workload->arena = malloc(sizeof(pcb_t) * count + sizeof(op_t) * op_total + names_size);
+    assert(workload->arena != NULL);
+    workload->count = count;
+    workload->processes = workload->arena;
+    workload->ops = (op_t *)(void *)(workload->processes + count);
+    workload->names = (char *)(workload->ops + op_total);
+    workload->mapping = NULL;
+    workload->mapping_size = 0;
+
+    ops = workload->ops;
+    names = workload->names;
+    for (unsigned int n = 0; n < count; n++) {
+        const distribution_t *cpu = cpu_bound[n] ? &config->cpu_cpu : &config->io_cpu;
+        const distribution_t *io = cpu_bound[n] ? &config->cpu_io : &config->io_io;
+        unsigned int total = 0;
+        op_t *pc = ops;
+        int name_length;
+
+        /* bursts[n] CPU bursts with an I/O burst between each pair */
+        for (unsigned int b = 0; b < bursts[n]; b++) {
+            if (b > 0) {
+                ops->type = OP_IO;
+                ops->time = sample_ticks(&rng, io, MAX_BURST_LENGTH);
+                ops->device = (config->io_devices > 1) ?
+                    (unsigned int)(rng_next(&rng) % config->io_devices) : 0;
+                total += ops->time;
+                ops++;
+            }
+            ops->type = OP_CPU;
+            ops->time = sample_ticks(&rng, cpu, MAX_BURST_LENGTH);
+            ops->device = 0;
+            total += ops->time;
+            ops++;
+        }
+        ops->type = OP_TERMINATE;
+        ops->time = 0;
+        ops->device = 0;
+        ops++;
+
+        name_length = sprintf(names, "%c%u", cpu_bound[n] ? 'C' : 'I', n);
+
+        /* pcb_t has a const pid, so each PCB is filled in with memcpy */
+        pcb_t pcb = {
+            .pid = n,
+            .name = names,
+            .time_in_CPU_burst = pc->time,
+            .priority = (unsigned int)(rng_next(&rng) % config->priorities),
+            .state = PROCESS_NEW,
+            .pc = pc,
+            .next = NULL,
+            .enqueue_time = 0,
+            .arrival_time = (clock < (double)UINT32_MAX) ? (unsigned int)clock : UINT32_MAX,
+            .total_time_remaining = total
+        };
+        memcpy(&workload->processes[n], &pcb, sizeof(pcb_t));
+
+        names += name_length + 1;
+        clock += sample(&rng, &(distribution_t){ DIST_EXPONENTIAL, config->arrival_mean, 0.0 });
+    }
+
+    free(cpu_bound);
+    free(bursts);
+}
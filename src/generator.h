@@ -0,0 +1,83 @@
+/*
+ * generator.h
+ *
+ * A synthetic workload generator.  It draws arrivals, burst counts and
+ * burst lengths from configurable distributions, for two classes of
+ * process in the spirit of the built-in table: I/O-bound ("I...") with
+ * short CPU bursts and long I/O, and CPU-bound ("C...") the other way
+ * round.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "workload.h"
+
+typedef enum
+{
+    DIST_FIXED = 0,     /* always a */
+    DIST_UNIFORM,       /* a to b, inclusive */
+    DIST_EXPONENTIAL,   /* mean a */
+    DIST_PARETO         /* mean a, shape b (> 1); heavy-tailed */
+} distribution_kind_t;
+
+typedef struct
+{
+    distribution_kind_t kind;
+    double a;
+    double b;
+} distribution_t;
+
+/*
+ * Generator configuration
+ *
+ *              count : the number of processes
+ *               seed : the seed of the generator; equal seeds give equal
+ *                      workloads
+ *  cpu_bound_fraction: the fraction of processes that are CPU-bound
+ *       arrival_mean : the mean gap between arrivals in ticks.  Gaps are
+ *                      exponential, so arrivals are a Poisson process.
+ *         priorities : priorities are drawn uniformly from 0 to this - 1
+ *         io_devices : each I/O burst goes to a device drawn uniformly from
+ *                      0 to this - 1
+ *             bursts : the number of CPU bursts of each process
+ *   io_cpu, io_io    : CPU and I/O burst lengths of I/O-bound processes
+ *   cpu_cpu, cpu_io  : CPU and I/O burst lengths of CPU-bound processes
+ *
+ * Burst lengths are in ticks, rounded up to at least one tick.
+ */
+typedef struct
+{
+    unsigned int count;
+    unsigned long long seed;
+    double cpu_bound_fraction;
+    double arrival_mean;
+    unsigned int priorities;
+    unsigned int io_devices;
+    distribution_t bursts;
+    distribution_t io_cpu;
+    distribution_t io_io;
+    distribution_t cpu_cpu;
+    distribution_t cpu_io;
+} generator_config_t;
+
+/* generator_defaults() fills in a configuration shaped like processes[] */
+extern void generator_defaults(generator_config_t *config);
+
+/*
+ * generator_parse() applies a comma-separated list of key=value settings to
+ * a configuration, e.g. "count=100000,seed=7,cpu-bound=0.3,io-io=pareto:8:1.5".
+ * The keys are count, seed, cpu-bound, arrival, priorities, io-devices, bursts,
+ * io-cpu, io-io, cpu-cpu and cpu-io.  Distributions are written
+ * fixed:a, uniform:a:b, exp:mean or pareto:mean:shape.
+ *
+ * @return false, after printing why, if spec is not valid
+ */
+extern bool generator_parse(generator_config_t *config, const char *spec);
+
+/*
+ * generate_workload() builds a workload from a configuration.  The PCBs,
+ * ops and names all live in one arena, freed by workload_free().
+ */
+extern void generate_workload(workload_t *workload, const generator_config_t *config);
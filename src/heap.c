@@ -0,0 +1,280 @@
+/*
+ * heap.c
+ *
+ * A binary min-heap of PCBs, ordered by the heap_key_t kept in each node,
+ * and an indexed max-heap of CPU ids.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "heap.h"
+
+#define HEAP_INITIAL_CAPACITY 16
+
+/**
+ * heap_key_before() returns whether key a comes before key b.
+ */
+bool heap_key_before(const heap_key_t *a, const heap_key_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key;
+    return a->tie < b->tie;
+}
+
+/**
+ * node_before() orders two heap nodes, falling back to push order when
+ * their keys are equal.
+ */
+static bool node_before(const heap_node_t *a, const heap_node_t *b)
+{
+    if (a->key.key != b->key.key || a->key.tie != b->key.tie)
+        return heap_key_before(&a->key, &b->key);
+    return a->seq < b->seq;
+}
+
+/**
+ * heap_init() prepares an empty heap.
+ *
+ * @param heap pointer to the heap
+ * @param key_of key function that decides the heap order
+ */
+void heap_init(pcb_heap_t *heap, pcb_key_t key_of)
+{
+    heap->nodes = NULL;
+    heap->size = 0;
+    heap->capacity = 0;
+    heap->seq = 0;
+    heap->key_of = key_of;
+}
+
+/**
+ * heap_destroy() frees the memory held by a heap.
+ */
+void heap_destroy(pcb_heap_t *heap)
+{
+    free(heap->nodes);
+    heap->nodes = NULL;
+    heap->size = 0;
+    heap->capacity = 0;
+}
+
+/**
+ * heap_push() inserts a process into the heap in O(log n).
+ *
+ * @param heap pointer to the heap
+ * @param process process to insert
+ */
+void heap_push(pcb_heap_t *heap, pcb_t *process)
+{
+    heap_node_t node;
+    unsigned int n;
+
+    if (heap->size == heap->capacity) {
+        heap->capacity = heap->capacity ? heap->capacity * 2 : HEAP_INITIAL_CAPACITY;
+        heap->nodes = realloc(heap->nodes, sizeof(heap_node_t) * heap->capacity);
+        assert(heap->nodes != NULL);
+    }
+
+    node.key = heap->key_of(process);
+    node.seq = heap->seq++;
+    node.pcb = process;
+
+    /* Sift the new node up, moving parents down into the hole */
+    n = heap->size++;
+    while (n > 0) {
+        unsigned int parent = (n - 1) / 2;
+        if (!node_before(&node, &heap->nodes[parent]))
+            break;
+        heap->nodes[n] = heap->nodes[parent];
+        n = parent;
+    }
+    heap->nodes[n] = node;
+}
+
+/**
+ * heap_pop() removes and returns the first process in heap order.
+ *
+ * @param heap pointer to the heap
+ *
+ * @return the removed process, or NULL when the heap is empty
+ */
+pcb_t *heap_pop(pcb_heap_t *heap)
+{
+    pcb_t *process;
+    heap_node_t last;
+    unsigned int n = 0;
+
+    if (heap->size == 0)
+        return NULL;
+
+    process = heap->nodes[0].pcb;
+    last = heap->nodes[--heap->size];
+
+    /* Sift the last node down from the root, moving children up into the hole */
+    while (1) {
+        unsigned int left = 2 * n + 1, right = left + 1, best = left;
+
+        if (left >= heap->size)
+            break;
+        if (right < heap->size && node_before(&heap->nodes[right], &heap->nodes[left]))
+            best = right;
+        if (!node_before(&heap->nodes[best], &last))
+            break;
+        heap->nodes[n] = heap->nodes[best];
+        n = best;
+    }
+    heap->nodes[n] = last;
+
+    return process;
+}
+
+/**
+ * heap_load() fills an empty heap with nodes that are already in heap
+ * order, such as the nodes[] of another heap, keeping their keys and push
+ * order as they are.
+ *
+ * @param heap pointer to the heap
+ * @param nodes the nodes, in heap order
+ * @param size the number of nodes
+ * @param seq the push order the next process pushed gets
+ */
+void heap_load(pcb_heap_t *heap, const heap_node_t *nodes, unsigned int size, unsigned long seq)
+{
+    assert(heap->size == 0);
+
+    if (size > heap->capacity) {
+        heap->capacity = size;
+        heap->nodes = realloc(heap->nodes, sizeof(heap_node_t) * heap->capacity);
+        assert(heap->nodes != NULL);
+    }
+    for (unsigned int n = 0; n < size; n++)
+        heap->nodes[n] = nodes[n];
+    heap->size = size;
+    heap->seq = seq;
+}
+
+/**
+ * heap_peek() returns the first process in heap order without removing it.
+ *
+ * @param heap pointer to the heap
+ *
+ * @return the first process, or NULL when the heap is empty
+ */
+pcb_t *heap_peek(const pcb_heap_t *heap)
+{
+    return heap->size ? heap->nodes[0].pcb : NULL;
+}
+
+static void cpu_heap_swap(cpu_heap_t *heap, unsigned int a, unsigned int b)
+{
+    unsigned int tmp = heap->cpus[a];
+    heap->cpus[a] = heap->cpus[b];
+    heap->cpus[b] = tmp;
+    heap->pos[heap->cpus[a]] = (int)a;
+    heap->pos[heap->cpus[b]] = (int)b;
+}
+
+static bool cpu_heap_above(const cpu_heap_t *heap, unsigned int a, unsigned int b)
+{
+    return heap->keys[heap->cpus[a]] > heap->keys[heap->cpus[b]];
+}
+
+static void cpu_heap_sift(cpu_heap_t *heap, unsigned int n)
+{
+    while (n > 0 && cpu_heap_above(heap, n, (n - 1) / 2)) {
+        cpu_heap_swap(heap, n, (n - 1) / 2);
+        n = (n - 1) / 2;
+    }
+
+    while (1) {
+        unsigned int left = 2 * n + 1, right = left + 1, best = n;
+
+        if (left < heap->size && cpu_heap_above(heap, left, best))
+            best = left;
+        if (right < heap->size && cpu_heap_above(heap, right, best))
+            best = right;
+        if (best == n)
+            break;
+        cpu_heap_swap(heap, n, best);
+        n = best;
+    }
+}
+
+/**
+ * cpu_heap_init() prepares an empty CPU heap for cpu_count CPUs.
+ */
+void cpu_heap_init(cpu_heap_t *heap, unsigned int cpu_count)
+{
+    heap->cpus = malloc(sizeof(unsigned int) * cpu_count);
+    heap->pos = malloc(sizeof(int) * cpu_count);
+    heap->keys = malloc(sizeof(unsigned long long) * cpu_count);
+    assert(heap->cpus != NULL && heap->pos != NULL && heap->keys != NULL);
+    heap->size = 0;
+    for (unsigned int n = 0; n < cpu_count; n++)
+        heap->pos[n] = -1;
+}
+
+/**
+ * cpu_heap_destroy() frees the memory held by a CPU heap.
+ */
+void cpu_heap_destroy(cpu_heap_t *heap)
+{
+    free(heap->cpus);
+    free(heap->pos);
+    free(heap->keys);
+    heap->size = 0;
+}
+
+/**
+ * cpu_heap_update() inserts a CPU, or changes its key if already present.
+ *
+ * @param heap pointer to the CPU heap
+ * @param cpu_id the cpu to insert or update
+ * @param key metric of the process now running on that cpu
+ */
+void cpu_heap_update(cpu_heap_t *heap, unsigned int cpu_id, unsigned long long key)
+{
+    if (heap->pos[cpu_id] == -1) {
+        heap->cpus[heap->size] = cpu_id;
+        heap->pos[cpu_id] = (int)heap->size++;
+    }
+    heap->keys[cpu_id] = key;
+    cpu_heap_sift(heap, (unsigned int)heap->pos[cpu_id]);
+}
+
+/**
+ * cpu_heap_remove() removes a CPU from the heap, if present.
+ */
+void cpu_heap_remove(cpu_heap_t *heap, unsigned int cpu_id)
+{
+    int n = heap->pos[cpu_id];
+
+    if (n == -1)
+        return;
+
+    heap->pos[cpu_id] = -1;
+    if ((unsigned int)n != --heap->size) {
+        heap->cpus[n] = heap->cpus[heap->size];
+        heap->pos[heap->cpus[n]] = n;
+        cpu_heap_sift(heap, (unsigned int)n);
+    }
+}
+
+/**
+ * cpu_heap_max() returns the CPU with the largest key, or -1 if the heap
+ * is empty.
+ */
+int cpu_heap_max(const cpu_heap_t *heap)
+{
+    return heap->size ? (int)heap->cpus[0] : -1;
+}
+
+/**
+ * cpu_heap_key() returns the key of a CPU that is in the heap.
+ */
+unsigned long long cpu_heap_key(const cpu_heap_t *heap, unsigned int cpu_id)
+{
+    assert(heap->pos[cpu_id] != -1);
+    return heap->keys[cpu_id];
+}
@@ -0,0 +1,80 @@
+/*
+ * heap.h
+ *
+ * A binary min-heap of PCBs.  This is used as an ordered backend for the
+ * ready queue, so that picking the next process costs O(log n) instead of a
+ * scan over every queued PCB.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "os-sim.h"
+
+/*
+ * A heap_key_t is where a process goes in the heap: processes are ordered
+ * on key, then on tie, and those that compare equal on both are returned
+ * in the order they were pushed.
+ */
+typedef struct
+{
+    unsigned long long key;
+    unsigned long long tie;
+} heap_key_t;
+
+/*
+ * A pcb_key_t returns the heap key of a process.  It is called once, when
+ * the process is pushed, and the key is kept in its node, so sifting
+ * compares keys that sit next to each other in nodes[] rather than calling
+ * out and reading a PCB for every comparison; the key must therefore not
+ * change while the process is in the heap.
+ */
+typedef heap_key_t (*pcb_key_t)(const pcb_t *process);
+
+typedef struct
+{
+    heap_key_t key;
+    unsigned long seq;
+    pcb_t *pcb;
+} heap_node_t;
+
+typedef struct
+{
+    heap_node_t *nodes;
+    unsigned int size;
+    unsigned int capacity;
+    unsigned long seq;
+    pcb_key_t key_of;
+} pcb_heap_t;
+
+/* Heap function declarations */
+bool heap_key_before(const heap_key_t *a, const heap_key_t *b);
+void heap_init(pcb_heap_t *heap, pcb_key_t key_of);
+void heap_destroy(pcb_heap_t *heap);
+void heap_push(pcb_heap_t *heap, pcb_t *process);
+pcb_t *heap_pop(pcb_heap_t *heap);
+pcb_t *heap_peek(const pcb_heap_t *heap);
+void heap_load(pcb_heap_t *heap, const heap_node_t *nodes, unsigned int size, unsigned long seq);
+
+/*
+ * A cpu_heap_t is an indexed binary max-heap of CPU ids, keyed by a metric
+ * of the process running on each CPU.  pos[] maps a CPU to its slot in
+ * cpus[] (or -1 if the CPU is not in the heap), so a CPU's key can be
+ * changed or removed in O(log n).
+ */
+typedef struct
+{
+    unsigned int *cpus;
+    int *pos;
+    unsigned long long *keys;
+    unsigned int size;
+} cpu_heap_t;
+
+/* CPU heap function declarations */
+void cpu_heap_init(cpu_heap_t *heap, unsigned int cpu_count);
+void cpu_heap_destroy(cpu_heap_t *heap);
+void cpu_heap_update(cpu_heap_t *heap, unsigned int cpu_id, unsigned long long key);
+void cpu_heap_remove(cpu_heap_t *heap, unsigned int cpu_id);
+int cpu_heap_max(const cpu_heap_t *heap);
+unsigned long long cpu_heap_key(const cpu_heap_t *heap, unsigned int cpu_id);
@@ -0,0 +1,115 @@
+/*
+ * histogram.c
+ *
+ * Log-linear histograms and percentiles.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "histogram.h"
+
+/**
+ * bucket_of() returns the bucket a value is counted in.
+ */
+static unsigned int bucket_of(unsigned int value)
+{
+    unsigned int msb, shift;
+
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    /* [2^msb, 2^(msb+1)) is split into HISTOGRAM_SUB_BUCKETS buckets */
+    msb = 31 - (unsigned int)__builtin_clz(value);
+    shift = msb - HISTOGRAM_SUB_BITS;
+    return HISTOGRAM_SUB_BUCKETS * (shift + 1) + ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+}
+
+/**
+ * bucket_upper() returns the largest value counted in a bucket.
+ */
+static unsigned long long bucket_upper(unsigned int bucket)
+{
+    unsigned int shift, sub;
+
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+
+    shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    sub = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return (((unsigned long long)sub + 1) << shift) - 1;
+}
+
+void histogram_init(histogram_t *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+/*
+ * There is only ever one writer, so each field is read plainly and stored
+ * atomically, for histogram_snapshot() to read while it is being added to.
+ */
+void histogram_add(histogram_t *histogram, unsigned int value)
+{
+    unsigned int bucket = bucket_of(value);
+
+    __atomic_store_n(&histogram->counts[bucket], histogram->counts[bucket] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->count, histogram->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&histogram->sum, histogram->sum + value, __ATOMIC_RELAXED);
+    if (value > histogram->max)
+        __atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+}
+
+void histogram_snapshot(const histogram_t *histogram, histogram_t *snapshot)
+{
+    for (unsigned int b = 0; b < HISTOGRAM_BUCKETS; b++)
+        snapshot->counts[b] = __atomic_load_n(&histogram->counts[b], __ATOMIC_RELAXED);
+    snapshot->count = __atomic_load_n(&histogram->count, __ATOMIC_RELAXED);
+    snapshot->sum = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+    snapshot->max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+}
+
+unsigned long long histogram_count_at_most(const histogram_t *histogram, unsigned long long bound)
+{
+    unsigned long long count = 0;
+
+    for (unsigned int b = 0; b < HISTOGRAM_BUCKETS && bucket_upper(b) <= bound; b++)
+        count += histogram->counts[b];
+    return count;
+}
+
+/**
+ * histogram_percentile() returns the smallest bucket bound that at least
+ * percentile (0 to 100) of the values are at or below, or 0 if the
+ * histogram is empty.
+ */
+unsigned int histogram_percentile(const histogram_t *histogram, double percentile)
+{
+    unsigned long long rank, seen = 0;
+
+    if (histogram->count == 0)
+        return 0;
+
+    /* The rank of the value, counting from 1 */
+    rank = (unsigned long long)ceil(percentile / 100.0 * (double)histogram->count);
+    if (rank < 1)
+        rank = 1;
+
+    for (unsigned int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += histogram->counts[b];
+        if (seen >= rank) {
+            unsigned long long upper = bucket_upper(b);
+            return (upper < histogram->max) ? (unsigned int)upper : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+void histogram_summarize(const histogram_t *histogram, histogram_summary_t *summary)
+{
+    summary->mean = histogram->count ? (double)histogram->sum / (double)histogram->count : 0.0;
+    summary->p50 = histogram_percentile(histogram, 50.0);
+    summary->p95 = histogram_percentile(histogram, 95.0);
+    summary->p99 = histogram_percentile(histogram, 99.0);
+    summary->max = histogram->max;
+}
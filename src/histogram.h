@@ -0,0 +1,52 @@
+/*
+ * histogram.h
+ *
+ * A histogram of unsigned values with fixed, log-linear buckets: values
+ * below 32 have a bucket each, and every power of two above that is split
+ * into 32 buckets.  A percentile is read from the bucket counts, to within
+ * about 3% of the exact value, without keeping or sorting the values.
+ */
+
+#pragma once
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1u << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS * (33 - HISTOGRAM_SUB_BITS))
+
+typedef struct
+{
+    unsigned long long counts[HISTOGRAM_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned int max;
+} histogram_t;
+
+/*
+ * A summary of a histogram.  The percentiles are the upper bound of the
+ * bucket they fall in, but never more than max.
+ */
+typedef struct
+{
+    double mean;
+    unsigned int p50, p95, p99, max;
+} histogram_summary_t;
+
+/* Histogram function declarations */
+void histogram_init(histogram_t *histogram);
+void histogram_add(histogram_t *histogram, unsigned int value);
+unsigned int histogram_percentile(const histogram_t *histogram, double percentile);
+void histogram_summarize(const histogram_t *histogram, histogram_summary_t *summary);
+
+/*
+ * histogram_snapshot() copies a histogram that another thread may be adding
+ * to.  Each field is read atomically, but not all at the same instant, so
+ * the copy may be a value or two out of step with itself.
+ */
+void histogram_snapshot(const histogram_t *histogram, histogram_t *snapshot);
+
+/*
+ * histogram_count_at_most() counts the values of the buckets that lie wholly
+ * at or below bound; a bucket that straddles it is left out, so the count
+ * is exact below HISTOGRAM_SUB_BUCKETS and within a bucket's width above.
+ */
+unsigned long long histogram_count_at_most(const histogram_t *histogram, unsigned long long bound);
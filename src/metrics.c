@@ -0,0 +1,251 @@
+/*
+ * metrics.c
+ *
+ * The live metrics exporter: the snapshot file and the loop that writes it.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+/* How often the exporter checks whether it has been stopped */
+#define METRICS_POLL_NS 10000000L
+
+/* Ticks are 100ms of simulated time */
+#define TICKS_PER_SECOND 10.0
+
+/**
+ * monotonic_ms() returns the wall-clock time, in milliseconds.
+ */
+static double monotonic_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1e3 + (double)now.tv_nsec / 1e6;
+}
+
+/**
+ * print_header() prints the help and type lines of a metric.
+ */
+static void print_header(FILE *file, const char *name, const char *type, const char *help)
+{
+    fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * print_histogram() prints a histogram as a Prometheus histogram, with a
+ * bucket for each le of 1, 2 and 5 times a power of ten up to the largest
+ * value.  scale is the number of units of the histogram's values per unit
+ * of the metric's: TICKS_PER_SECOND for times, and 1 for counts.
+ */
+static void print_histogram(FILE *file, const char *name, const char *help,
+                            const histogram_t *histogram, double scale)
+{
+    static const unsigned int steps[] = { 1, 2, 5 };
+    unsigned long long power = 1;
+
+    print_header(file, name, "histogram", help);
+    if (scale == 1.0) {
+        fprintf(file, "%s_bucket{le=\"0\"} %llu\n", name,
+                histogram_count_at_most(histogram, 0));
+    }
+    for (;;) {
+        for (unsigned int s = 0; s < 3; s++) {
+            unsigned long long bound = steps[s] * power;
+
+            fprintf(file, "%s_bucket{le=\"%g\"} %llu\n", name, (double)bound / scale,
+                    histogram_count_at_most(histogram, bound));
+        }
+        if (steps[2] * power >= histogram->max || power >= 1000000000ull)
+            break;
+        power *= 10;
+    }
+    fprintf(file, "%s_bucket{le=\"+Inf\"} %llu\n", name, histogram->count);
+    fprintf(file, "%s_sum %g\n", name, (double)histogram->sum / scale);
+    fprintf(file, "%s_count %llu\n", name, histogram->count);
+}
+
+/**
+ * print_snapshot() prints every metric of a snapshot.  elapsed is the
+ * ticks since the last snapshot, for the rates.
+ */
+static void print_snapshot(FILE *file, const metrics_t *metrics,
+                           const simulator_metrics_t *state, unsigned int elapsed)
+{
+    unsigned long long switches = 0, last_switches = 0;
+    unsigned long long timer = 0, forced = 0;
+    unsigned int cpu_count = metrics->counter_count - 1;
+
+    print_header(file, "os_sim_running", "gauge", "Whether the simulation is still running.");
+    fprintf(file, "os_sim_running %d\n", state->finished ? 0 : 1);
+    print_header(file, "os_sim_time_seconds", "gauge", "Simulated time.");
+    fprintf(file, "os_sim_time_seconds %.1f\n", (double)state->time / TICKS_PER_SECOND);
+
+    print_header(file, "os_sim_processes", "gauge", "Processes in each state.");
+    fprintf(file, "os_sim_processes{state=\"ready\"} %u\n", state->ready);
+    fprintf(file, "os_sim_processes{state=\"running\"} %u\n", state->running);
+    fprintf(file, "os_sim_processes{state=\"waiting\"} %u\n", state->waiting);
+    print_header(file, "os_sim_processes_created_total", "counter", "Processes created.");
+    fprintf(file, "os_sim_processes_created_total %u\n", state->created);
+    print_header(file, "os_sim_processes_terminated_total", "counter", "Processes terminated.");
+    fprintf(file, "os_sim_processes_terminated_total %u\n", state->terminated);
+    print_header(file, "os_sim_throughput", "gauge",
+                 "Processes terminated per simulated second since the last snapshot.");
+    fprintf(file, "os_sim_throughput %g\n", elapsed ?
+            (double)(state->terminated - metrics->last_terminated) * TICKS_PER_SECOND /
+            (double)elapsed : 0.0);
+
+    print_header(file, "os_sim_io_requests", "gauge", "I/O requests queued and in service.");
+    fprintf(file, "os_sim_io_requests{state=\"queued\"} %u\n", state->io_queued);
+    fprintf(file, "os_sim_io_requests{state=\"in_service\"} %u\n", state->io_in_service);
+
+    print_header(file, "os_sim_cpu_busy_seconds_total", "counter",
+                 "Simulated time each CPU had a process.");
+    for (unsigned int n = 0; n < cpu_count; n++) {
+        fprintf(file, "os_sim_cpu_busy_seconds_total{cpu=\"%u\"} %.1f\n", n,
+                (double)metrics->counters[n].busy_ticks / TICKS_PER_SECOND);
+    }
+    print_header(file, "os_sim_cpu_utilization", "gauge",
+                 "Share of the simulated time since the last snapshot each CPU had a process.");
+    for (unsigned int n = 0; n < cpu_count; n++) {
+        unsigned long long busy = metrics->counters[n].busy_ticks;
+        double share;
+
+        /* With no ticks since the last snapshot, the whole run so far */
+        if (elapsed > 0) {
+            share = (double)(busy - metrics->last[n].busy_ticks) / (double)elapsed;
+        } else {
+            share = state->time ? (double)busy / (double)state->time : 0.0;
+        }
+        fprintf(file, "os_sim_cpu_utilization{cpu=\"%u\"} %.3f\n", n, share > 1.0 ? 1.0 : share);
+    }
+
+    for (unsigned int n = 0; n < metrics->counter_count; n++) {
+        switches += metrics->counters[n].context_switches;
+        last_switches += metrics->last[n].context_switches;
+        timer += metrics->counters[n].timer_preemptions;
+        forced += metrics->counters[n].forced_preemptions;
+    }
+    print_header(file, "os_sim_context_switches_total", "counter", "Context switches.");
+    fprintf(file, "os_sim_context_switches_total %llu\n", switches);
+    print_header(file, "os_sim_context_switches_per_second", "gauge",
+                 "Context switches per simulated second since the last snapshot.");
+    fprintf(file, "os_sim_context_switches_per_second %g\n", elapsed ?
+            (double)(switches - last_switches) * TICKS_PER_SECOND / (double)elapsed : 0.0);
+    print_header(file, "os_sim_preemptions_total", "counter",
+                 "Processes preempted by their time slice running out or by force_preempt().");
+    fprintf(file, "os_sim_preemptions_total{kind=\"timer\"} %llu\n", timer);
+    fprintf(file, "os_sim_preemptions_total{kind=\"forced\"} %llu\n", forced);
+
+    print_histogram(file, "os_sim_response_time_seconds",
+                    "Time from arrival to first running, of the processes terminated.",
+                    &state->response, TICKS_PER_SECOND);
+    print_histogram(file, "os_sim_ready_wait_seconds",
+                    "Time spent ready, of the processes terminated.",
+                    &state->ready_wait, TICKS_PER_SECOND);
+    print_histogram(file, "os_sim_turnaround_seconds",
+                    "Time from arrival to termination, of the processes terminated.",
+                    &state->turnaround, TICKS_PER_SECOND);
+    print_histogram(file, "os_sim_process_preemptions",
+                    "Times each process terminated was preempted.",
+                    &state->preemptions, 1.0);
+}
+
+/**
+ * write_snapshot() takes a snapshot of the simulation and writes it out.
+ *
+ * @return false, after printing why the first time, if it cannot be written
+ */
+static bool write_snapshot(metrics_t *metrics)
+{
+    simulator_metrics_t state;
+    simulator_cpu_counters_t *swap;
+    unsigned int elapsed;
+    FILE *file;
+    bool written;
+
+    simulator_metrics(&state);
+    simulator_counters(metrics->counters, metrics->counter_count);
+    elapsed = state.time - metrics->last_time;
+
+    file = fopen(metrics->temp_path, "w");
+    written = (file != NULL);
+    if (written) {
+        print_snapshot(file, metrics, &state, elapsed);
+        written = !ferror(file);
+        written = (fclose(file) == 0) && written;
+    }
+    written = written && rename(metrics->temp_path, metrics->path) == 0;
+    if (!written && !metrics->failed) {
+        fprintf(stderr, "Error: %s: %s\n", metrics->path, strerror(errno));
+        metrics->failed = true;
+    }
+
+    /* The rates of the next snapshot are taken from this one */
+    swap = metrics->last;
+    metrics->last = metrics->counters;
+    metrics->counters = swap;
+    metrics->last_time = state.time;
+    metrics->last_terminated = state.terminated;
+    return written;
+}
+
+extern bool metrics_open(metrics_t *metrics, const char *path, unsigned int interval_ms)
+{
+    size_t length = strlen(path);
+
+    memset(metrics, 0, sizeof(metrics_t));
+    metrics->path = path;
+    metrics->interval_ms = interval_ms ? interval_ms : METRICS_DEFAULT_INTERVAL_MS;
+    metrics->temp_path = malloc(length + sizeof(".tmp"));
+    assert(metrics->temp_path != NULL);
+    memcpy(metrics->temp_path, path, length);
+    memcpy(metrics->temp_path + length, ".tmp", sizeof(".tmp"));
+
+    metrics->counter_count = simulator_counters(NULL, 0);
+    metrics->counters = calloc(metrics->counter_count, sizeof(simulator_cpu_counters_t));
+    metrics->last = calloc(metrics->counter_count, sizeof(simulator_cpu_counters_t));
+    assert(metrics->counters != NULL && metrics->last != NULL);
+
+    if (!write_snapshot(metrics)) {
+        metrics_close(metrics);
+        return false;
+    }
+    return true;
+}
+
+extern void metrics_run(metrics_t *metrics)
+{
+    struct timespec poll = { 0, METRICS_POLL_NS };
+    double next = monotonic_ms() + metrics->interval_ms;
+
+    while (!__atomic_load_n(&metrics->stopping, __ATOMIC_ACQUIRE)) {
+        if (monotonic_ms() >= next) {
+            write_snapshot(metrics);
+            next += metrics->interval_ms;
+        }
+        nanosleep(&poll, NULL);
+    }
+    write_snapshot(metrics);
+}
+
+extern void metrics_stop(metrics_t *metrics)
+{
+    __atomic_store_n(&metrics->stopping, true, __ATOMIC_RELEASE);
+}
+
+extern void metrics_close(metrics_t *metrics)
+{
+    free(metrics->temp_path);
+    free(metrics->counters);
+    free(metrics->last);
+    metrics->temp_path = NULL;
+    metrics->counters = NULL;
+    metrics->last = NULL;
+}
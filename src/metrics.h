@@ -0,0 +1,79 @@
+/*
+ * metrics.h
+ *
+ * Live metrics: a snapshot of a running simulation, written to a file in
+ * the Prometheus text exposition format every interval of wall-clock time,
+ * for a textfile collector or anything else that scrapes it to put on a
+ * dashboard.
+ *
+ * The exporter runs on a thread of its own and never takes simulator_mutex
+ * or a scheduler lock: it reads the simulation through simulator_metrics()
+ * and simulator_counters(), which are lock-free.  Each snapshot is written
+ * to path.tmp and renamed over path, so a reader never sees half of one.
+ *
+ * Times are in simulated seconds.  The snapshot holds:
+ *
+ *   os_sim_running                     1 while the simulation runs, then 0
+ *   os_sim_time_seconds                the simulated time
+ *   os_sim_processes{state}            the ready, running and waiting processes
+ *   os_sim_processes_created_total     the processes created and terminated
+ *   os_sim_processes_terminated_total
+ *   os_sim_throughput                  terminations per second, since the last snapshot
+ *   os_sim_io_requests{state}          I/O requests queued and in service
+ *   os_sim_cpu_busy_seconds_total{cpu} the time each CPU had a process
+ *   os_sim_cpu_utilization{cpu}        the share of the time since the last
+ *                                      snapshot each CPU had a process
+ *   os_sim_context_switches_total      context switches, and per second since
+ *   os_sim_context_switches_per_second the last snapshot
+ *   os_sim_preemptions_total{kind}     timer and forced preemptions
+ *   os_sim_response_time_seconds       the latency histograms of the processes
+ *   os_sim_ready_wait_seconds          terminated so far, and of the number of
+ *   os_sim_turnaround_seconds          times each was preempted
+ *   os_sim_process_preemptions
+ *
+ * The histograms' buckets are the simulator's own log-linear ones, summed
+ * up to each le bound, so a count can be a bucket's width short of exact.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "os-sim.h"
+
+/* The default time between snapshots, in milliseconds */
+#define METRICS_DEFAULT_INTERVAL_MS 1000
+
+typedef struct
+{
+    const char *path;
+    char *temp_path;
+    unsigned int interval_ms;
+    bool stopping;
+    bool failed;                        /* a write failed and was reported */
+    unsigned int counter_count;
+    simulator_cpu_counters_t *counters; /* this snapshot's, then the last one's */
+    simulator_cpu_counters_t *last;
+    unsigned int last_time;
+    unsigned int last_terminated;
+} metrics_t;
+
+/*
+ * metrics_open() sets up an exporter and writes its first snapshot.  It is
+ * called on a thread of the simulation, once it is set up.
+ *
+ * @return false, after printing why, if the snapshot cannot be written
+ */
+extern bool metrics_open(metrics_t *metrics, const char *path, unsigned int interval_ms);
+
+/*
+ * metrics_run() writes a snapshot every interval until metrics_stop() is
+ * called, then writes one last one.  It runs on the exporter's own thread,
+ * which must belong to the simulation.  A write that fails is reported
+ * once, and the next one is tried all the same.
+ */
+extern void metrics_run(metrics_t *metrics);
+extern void metrics_stop(metrics_t *metrics);
+
+/* metrics_close() releases an exporter whose thread has returned */
+extern void metrics_close(metrics_t *metrics);
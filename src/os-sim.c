@@ -7,15 +7,25 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdint.h>
+#include <string.h>
 #include <time.h>
 
+#include "checkpoint.h"
+#include "cpumask.h"
+#include "metrics.h"
 #include "os-sim.h"
+#include "outbuf.h"
 #include "process.h"
 #include "scheduler.h"
+#include "trace.h"
+#include "workload.h"
 
 
 typedef enum {
@@ -31,163 +41,601 @@ typedef struct {
     simulator_cpu_state_t state;
     pthread_cond_t wakeup;
     int preemption_timer;
+    simulator_t *sim;
+    unsigned int cpu_id;
+    bool batched; /* handling an event of the current batch */
 } simulator_cpu_data_t;
 
-/* The I/O queue is a simple, FIFO queue using a linked list */
+/*
+ * The accounting of one process, kept by the simulator rather than in the
+ * PCB, which belongs to the scheduler.  Each field is updated by the event
+ * that changes it, with simulator_mutex held.
+ *
+ * ready_time counts the ticks the process was sampled as ready, the same
+ * ticks that make up ready_counter, rather than clock time: with CPU
+ * threads a dispatch can land after publish_clock() but before the next
+ * tick is sampled, and the process has then lost no tick at all.
+ */
+typedef struct {
+    unsigned int ready_since;  /* ticks_sampled when it last became READY */
+    unsigned int first_run;    /* UINT_MAX until it is first dispatched */
+    unsigned int ready_time;   /* ticks spent READY so far */
+    unsigned int preemptions;
+} process_stats_t;
+
+/*
+ * The counters of one CPU, or of the supervisor, padded out to cache lines
+ * of their own so that threads counting for different CPUs never share a
+ * line.  The counters are only changed with relaxed atomic adds, so
+ * simulator_counters() can read them at any time.  idle_ticks is not kept;
+ * it is worked out from busy_ticks when a snapshot is taken.
+ */
+#define CACHE_LINE_SIZE 64
+
+typedef struct {
+    simulator_cpu_counters_t counters;
+    unsigned int busy_since;   /* when the CPU got its process; UINT_MAX while idle */
+} __attribute__((aligned(CACHE_LINE_SIZE))) simulator_cpu_slot_t;
+
+/*
+ * Each I/O device has a queue of waiting requests, a simple FIFO linked
+ * list, and up to channels requests in service at once.  A process has at
+ * most one I/O request outstanding, so each request lives in the slot of
+ * the process it is for, and no request is ever allocated.
+ * remote_ticks is the extra time a request from another node takes, spent
+ * before its burst goes on.
+ */
 typedef struct _io_request {
     pcb_t *pcb;
     unsigned int execution_time;
+    unsigned int remote_ticks;
     struct _io_request *next;
 } io_request;
 
+typedef struct {
+    io_device_config_t config;
+    io_request *head, *tail;   /* waiting requests, in submission order */
+    io_request **in_service;   /* config.channels slots, NULL when free */
+} io_device_t;
+
+/*
+ * Each process created gets a slot of its own, holding its PCB, its own
+ * copy of its ops and name, which simulating it consumes, its accounting
+ * and its I/O request.  Slots are allocated SLOT_CHUNK_SIZE at a time in
+ * chunks that never move, so the scheduler can hold on to PCBs, and the
+ * slot of a process that has terminated goes on a free list for the next
+ * one created, so an open-ended stream of processes only takes as many
+ * slots as are ever live at once.  admitted numbers the processes in the
+ * order they were created.
+ */
+#define SLOT_CHUNK_SIZE 256
+
+typedef struct _process_slot {
+    pcb_t pcb;                 /* first, so a PCB is at its slot's address */
+    process_stats_t stats;
+    io_request io;
+    op_t *ops;
+    unsigned int op_capacity;
+    char *name;
+    size_t name_capacity;
+    unsigned int index;        /* see simulator_process() */
+    unsigned int admitted;
+    bool live;
+    struct _process_slot *next_free;
+} process_slot_t;
+
+/*
+ * The counts the supervisor publishes once a tick for simulator_metrics(),
+ * which reads them from another thread.  They are only accessed with
+ * atomic builtins.
+ */
+typedef enum {
+    GAUGE_READY,
+    GAUGE_RUNNING,
+    GAUGE_WAITING,
+    GAUGE_IO_IN_SERVICE,
+    GAUGE_CREATED,
+    GAUGE_TERMINATED,
+    GAUGE_COUNT
+} simulator_gauge_t;
 
-static io_request *io_queue_head = NULL, *io_queue_tail = NULL;
-static simulator_cpu_data_t *simulator_cpu_data;
-static pthread_t *cpu_thread;
-static pthread_mutex_t simulator_mutex;
-static unsigned int simulator_time = 0;
-static unsigned int processes_terminated = 0;
-static unsigned int cpu_count;
-static unsigned int ready_counter = 0, running_counter = 0, waiting_counter = 0;
-static unsigned int context_switches = 0;
+
+/*
+ * All the state of one simulation.  Several simulations can run in the same
+ * process (see sweep.c); sim points at the one the calling thread belongs
+ * to, and is set by start_simulator() and at the top of each CPU thread.
+ *
+ * stream hands out the processes to create, and each one created is
+ * copied into a slot of its own.  fingerprint is a hash of every process
+ * created so far, as it was before any of it was simulated, for
+ * checkpoints.  scheduler_data is the scheduler's own state for this
+ * simulation, see simulator_scheduler_data().
+ */
+struct simulator {
+    io_device_t *io_devices;
+    unsigned int io_device_count;
+    process_slot_t **slot_chunks;
+    unsigned int slot_count;     /* slots allocated, live or free */
+    process_slot_t *free_slots;
+    histogram_t response_histogram, ready_wait_histogram;
+    histogram_t turnaround_histogram, preemption_histogram;
+    simulator_cpu_data_t *simulator_cpu_data;
+    simulator_cpu_slot_t *cpu_slots; /* cpu_count + 1; the last is the supervisor's */
+    cpumask_t busy_cpus; /* CPUs with a process, protected by simulator_mutex */
+    pthread_t *cpu_thread;
+    pthread_mutex_t simulator_mutex;
+    unsigned int *batch;         /* CPUs with an event this tick (ENGINE_BATCHED) */
+    simulator_cpu_state_t *batch_event;
+    unsigned int batch_size;
+    unsigned int batch_pending;  /* batched events not yet handled */
+    pthread_cond_t batch_done;
+    unsigned int io_requests; /* submitted and not yet completed */
+    trace_t trace;               /* the binary trace, if trace_path is set */
+    bool tracing;
+    bool exporting;
+    metrics_t metrics;           /* the live metrics, if metrics_path is set */
+    pthread_t metrics_thread;
+    unsigned int gauges[GAUGE_COUNT]; /* published once a tick, see publish_gauges() */
+    bool finished;
+    outbuf_t gantt_buffer;       /* GANTT_BUFFERED output */
+    unsigned int *gantt_last;    /* admitted of each CPU's process last printed,
+                                    or UINT_MAX for idle, GANTT_CHANGES */
+    bool gantt_printed;
+    struct timespec pace_start;  /* wall-clock start, for PACE_REALTIME/SCALED */
+    unsigned int pace_origin;    /* simulator_time at pace_start */
+    bool checkpoint_due;         /* checkpoint_path is still to be written */
+    unsigned int simulator_time; /* the supervisor's own copy of the clock */
+    unsigned int clock_epoch;
+    unsigned long long clock;    /* time | epoch << 32, see publish_clock() */
+    unsigned int processes_terminated;
+    unsigned int processes_created;
+    simulator_options_t simulator_options;
+    unsigned int cpu_count;
+    cpu_topology_t topology;
+    unsigned int ready_counter, running_counter, waiting_counter;
+    unsigned int ticks_sampled;  /* ticks whose process counts are in those */
+    unsigned int context_switches;
+    workload_stream_t *stream;
+    workload_stream_t own_stream; /* over workload, unless workload_stream is set */
+    unsigned long long fingerprint;
+    void *scheduler_data;
+};
+
+static __thread simulator_t *sim;
+static __thread trace_ring_t *trace_ring; /* this thread's ring, while tracing */
+static __thread simulator_cpu_slot_t *thread_slot; /* where this thread's lock waits go */
+
+/* Each of the two GANTT_BUFFERED buffers holds this many bytes */
+#define GANTT_BUFFER_SIZE (1u << 20)
 
 static void simulator_supervisor_thread(void);
+static void publish_clock(void);
+static void trace_event(trace_event_t type, unsigned int cpu_id, const pcb_t *pcb,
+                        unsigned int arg);
+static void trace_state(unsigned int cpu_id, const pcb_t *pcb,
+                        process_state_t from, process_state_t to);
+static void trace_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event);
+static void account_ready(const pcb_t *pcb);
+static void account_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event);
+static void pace_supervisor(void);
+static unsigned long long monotonic_ns(void);
+static void count_add(unsigned long long *counter, unsigned long long value);
+static void account_busy(unsigned int cpu_id, bool busy);
+static void snapshot_slot(unsigned int slot, simulator_cpu_counters_t *counters);
+static void run_callback(unsigned int cpu_id, simulator_cpu_state_t event);
+static void run_wake_up(pcb_t *pcb);
 static void simulator_cpu_thread(unsigned int cpu_id);
 
 int nanosleep(const struct timespec *rqtp, struct timespec *rmtp);
 
+static void count_process_states(unsigned int *ready, unsigned int *running,
+                                 unsigned int *waiting);
+static void gantt_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static bool gantt_assignment_changed(void);
 static void print_gantt_header(void);
-static void print_gantt_line(void);static void print_final_stats(void);
-
+static void print_gantt_line(void);
+static void publish_gauges(unsigned int ready, unsigned int running, unsigned int waiting);
+static void print_cpu_counters(void);
+static void print_node_counters(void);
+static void print_final_stats(void);
+
+static void dispatch_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event);
+static void queue_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event);
+static void dispatch_cpu_batch(void);
+static void run_inline_event(unsigned int cpu_id, simulator_cpu_state_t event);
+static void run_inline_idle(void);
 static void simulate_cpus(void);
 static void simulate_process(unsigned int cpu_id, pcb_t *pcb);
-static void submit_io_request(pcb_t *pcb, unsigned int execution_time);
+static void estimate_burst(pcb_t *pcb);
+static unsigned long long vruntime_delta(const pcb_t *pcb);
+static void submit_io_request(unsigned int cpu_id, pcb_t *pcb, unsigned int execution_time);
+static io_request *take_io_request(io_device_t *device);
 static void simulate_io(void);
 static void simulate_creat(void);
+static unsigned int quiet_ticks(void);
+static void skip_quiet_ticks(unsigned int ticks);
+static void append_io_request(io_device_t *device, io_request *r);
+static process_slot_t *slot_of(const pcb_t *pcb);
+static process_slot_t *take_slot(void);
+static pcb_t *admit_process(const pcb_t *process);
+static void release_process(pcb_t *pcb);
+static const pcb_t *next_arrival(void);
+
+static void write_checkpoint(void);
+static void restore_checkpoint(void);
 
 static void* simulator_cpu_thread_func(void *data);
+static void* simulator_metrics_thread_func(void *data);
 
 
-/*
- * IRWL - An "Inverted" Readers-Writers Lock
- *
- * Unlike a traditional readers-writers lock, this lock allows infinitely
- * many writers or one reader.
- *
- * Its purpose is to protect the state variable of the PCB structures.
- *
- * For the simulation_lock, the IRWL_WRITER should always be locked while
- * code is executing on a CPU thread.  The IRWL_READER should always be
- * locked whenever non-constant data in a PCB is used by the library.
- */
-typedef struct {
-    pthread_mutex_t mutex;
-    pthread_cond_t no_writers;
-    int writers;
-} irwl;
-
-#define IRWL_INIT(i) \
-    pthread_mutex_init(&(i).mutex, NULL); \
-    pthread_cond_init(&(i).no_writers, NULL); \
-    (i).writers = 0;
-
-#define IRWL_READER_LOCK(i) \
-    pthread_mutex_lock(&(i).mutex); \
-    while ((i).writers > 0) \
-    { pthread_cond_wait(&(i).no_writers, &(i).mutex); }
-
-#define IRWL_READER_UNLOCK(i) \
-    pthread_mutex_unlock(&(i).mutex);
-
-#define IRWL_WRITER_LOCK(i) \
-    pthread_mutex_lock(&(i).mutex); \
-    (i).writers++; \
-    pthread_mutex_unlock(&(i).mutex);
-
-#define IRWL_WRITER_UNLOCK(i) \
-    pthread_mutex_lock(&(i).mutex); \
-    (i).writers--; \
-    if ((i).writers == 0) \
-    { pthread_cond_signal(&(i).no_writers); } \
-    pthread_mutex_unlock(&(i).mutex);
-
-static irwl simulation_lock;
 
 
 /* The big initialization function */
-extern void start_simulator(unsigned int new_cpu_count)
+extern void start_simulator(unsigned int new_cpu_count,
+                            const simulator_options_t *options,
+                            void *scheduler_data, simulator_stats_t *stats)
 {
+    simulator_t *outer = sim;
+    trace_ring_t *outer_ring = trace_ring;
+    simulator_cpu_slot_t *outer_slot = thread_slot;
     unsigned int n;
 
+    sim = calloc(1, sizeof(simulator_t));
+    assert(sim != NULL);
+    if (options != NULL)
+        sim->simulator_options = *options;
+    sim->scheduler_data = scheduler_data;
+
     /* Make sure the # of CPUs is reasonable */
-    cpu_count = new_cpu_count;
-    if (cpu_count < 1 || cpu_count > 16)
+    sim->cpu_count = new_cpu_count;
+    if (sim->cpu_count < 1)
     {
-        fprintf(stderr, "CPU Count must be an integer from 1 to 16!\n\n");
+        fprintf(stderr, "CPU Count must be a positive integer!\n\n");
         exit(-1);
     }
+    sim->topology = sim->simulator_options.topology;
+    if (sim->topology.sockets == 0)
+        topology_flat(&sim->topology, sim->cpu_count);
+    if (topology_cpu_count(&sim->topology) != sim->cpu_count)
+    {
+        fprintf(stderr, "The topology must have one CPU per simulated CPU!\n\n");
+        exit(-1);
+    }
+
+    /* Processes are copied into slots of their own as they are created */
+    if (sim->simulator_options.workload_stream != NULL)
+        sim->stream = sim->simulator_options.workload_stream;
+    else
+    {
+        if (sim->simulator_options.workload != NULL)
+            workload_stream_init(&sim->own_stream, sim->simulator_options.workload->processes,
+                sim->simulator_options.workload->count);
+        else
+            workload_stream_init(&sim->own_stream, processes, PROCESS_COUNT);
+        sim->stream = &sim->own_stream;
+    }
+    sim->fingerprint = WORKLOAD_FINGERPRINT_BASIS;
+    histogram_init(&sim->response_histogram);
+    histogram_init(&sim->ready_wait_histogram);
+    histogram_init(&sim->turnaround_histogram);
+    histogram_init(&sim->preemption_histogram);
+
+    /* Set up the I/O devices; by default one FIFO device with one channel */
+    sim->io_device_count = sim->simulator_options.io_device_count;
+    if (sim->io_device_count == 0)
+        sim->io_device_count = 1;
+    sim->io_devices = calloc(sim->io_device_count, sizeof(io_device_t));
+    assert(sim->io_devices != NULL);
+    for (n=0; n<sim->io_device_count; n++)
+    {
+        io_device_t *device = &sim->io_devices[n];
 
+        if (sim->simulator_options.io_device_count > 0)
+            device->config = sim->simulator_options.io_devices[n];
+        else
+            device->config = (io_device_config_t){ IO_FIFO, 1, 0 };
+        if (device->config.channels < 1)
+        {
+            fprintf(stderr, "I/O devices need at least one channel!\n\n");
+            exit(-1);
+        }
+        if (device->config.node >= topology_node_count(&sim->topology))
+        {
+            fprintf(stderr, "I/O devices must be attached to a node of the topology!\n\n");
+            exit(-1);
+        }
+        device->in_service = calloc(device->config.channels, sizeof(io_request *));
+        assert(device->in_service != NULL);
+    }
 
     /* Allocate arrays */
-    cpu_thread = malloc(sizeof(pthread_t) * cpu_count);
-    assert(cpu_thread != NULL);
-    simulator_cpu_data = malloc(sizeof(simulator_cpu_data_t) * cpu_count);
-    assert(simulator_cpu_data != NULL);
+    sim->cpu_thread = malloc(sizeof(pthread_t) * sim->cpu_count);
+    assert(sim->cpu_thread != NULL);
+    sim->simulator_cpu_data = malloc(sizeof(simulator_cpu_data_t) * sim->cpu_count);
+    assert(sim->simulator_cpu_data != NULL);
+    sim->batch = malloc(sizeof(unsigned int) * sim->cpu_count);
+    sim->batch_event = malloc(sizeof(simulator_cpu_state_t) * sim->cpu_count);
+    assert(sim->batch != NULL && sim->batch_event != NULL);
+    sim->gantt_last = malloc(sizeof(unsigned int) * sim->cpu_count);
+    assert(sim->gantt_last != NULL);
+    for (n=0; n<sim->cpu_count; n++)
+        sim->gantt_last[n] = UINT_MAX;
+    if (posix_memalign((void **)&sim->cpu_slots, CACHE_LINE_SIZE,
+        sizeof(simulator_cpu_slot_t) * (sim->cpu_count + 1)) != 0)
+        assert(!"out of memory");
+    memset(sim->cpu_slots, 0, sizeof(simulator_cpu_slot_t) * (sim->cpu_count + 1));
+    for (n=0; n<=sim->cpu_count; n++)
+        sim->cpu_slots[n].busy_since = UINT_MAX;
+    thread_slot = &sim->cpu_slots[sim->cpu_count];
+    cpumask_init(&sim->busy_cpus, sim->cpu_count);
 
     /* Initialize mutexes and condition variables */
-    pthread_mutex_init(&simulator_mutex, NULL);
-    simulator_time = 0;
-    for (n=0; n<cpu_count; n++)
+    pthread_mutex_init(&sim->simulator_mutex, NULL);
+    pthread_cond_init(&sim->batch_done, NULL);
+    sim->simulator_time = 0;
+    sim->ticks_sampled = 0;
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        sim->simulator_cpu_data[n].current = NULL;
+        sim->simulator_cpu_data[n].state = CPU_IDLE;
+        sim->simulator_cpu_data[n].preemption_timer = -1;
+        sim->simulator_cpu_data[n].sim = sim;
+        sim->simulator_cpu_data[n].cpu_id = n;
+        sim->simulator_cpu_data[n].batched = false;
+        pthread_cond_init(&sim->simulator_cpu_data[n].wakeup, NULL);
+    }
+
+    /* Ring 0 is the supervisor's, and ring n + 1 that of CPU n's thread */
+    trace_ring = NULL;
+    if (sim->simulator_options.trace_path != NULL)
+    {
+        if (sim->cpu_count >= TRACE_NONE_CPU)
+        {
+            fprintf(stderr, "Tracing supports at most %u CPUs!\n\n", TRACE_NONE_CPU - 1);
+            exit(-1);
+        }
+        if (!trace_open(&sim->trace, sim->simulator_options.trace_path,
+            sim->cpu_count + 1, sim->cpu_count))
+            exit(-1);
+        sim->tracing = true;
+        trace_ring = &sim->trace.rings[0];
+    }
+
+    /* Checkpoints are taken between ticks, when no callback is running */
+    if ((sim->simulator_options.checkpoint_path != NULL ||
+        sim->simulator_options.restore_path != NULL) &&
+        sim->simulator_options.engine != ENGINE_INLINE)
     {
-        simulator_cpu_data[n].current = NULL;
-        simulator_cpu_data[n].state = CPU_IDLE;
-        simulator_cpu_data[n].preemption_timer = -1;
-        pthread_cond_init(&simulator_cpu_data[n].wakeup, NULL);
+        fprintf(stderr, "Checkpoints need the inline engine!\n\n");
+        exit(-1);
     }
+    if (sim->simulator_options.restore_path != NULL)
+        restore_checkpoint();
+    sim->checkpoint_due = (sim->simulator_options.checkpoint_path != NULL);
 
-    IRWL_INIT(simulation_lock)
+    /* The live metrics are written by a thread of their own */
+    if (sim->simulator_options.metrics_path != NULL)
+    {
+        unsigned int ready, running, waiting;
+
+        count_process_states(&ready, &running, &waiting);
+        publish_gauges(ready, running, waiting);
+        if (!metrics_open(&sim->metrics, sim->simulator_options.metrics_path,
+            sim->simulator_options.metrics_interval_ms))
+            exit(-1);
+        sim->exporting = true;
+        pthread_create(&sim->metrics_thread, NULL, simulator_metrics_thread_func, sim);
+    }
 
-    /* Start CPU threads */
-    for (n=0; n<cpu_count; n++)
-        pthread_create(&cpu_thread[n], NULL, simulator_cpu_thread_func,
-        (void*)(uintptr_t)n);
+    /* Start CPU threads; the inline engine runs every CPU on this thread */
+    if (sim->simulator_options.engine != ENGINE_INLINE)
+    {
+        for (n=0; n<sim->cpu_count; n++)
+            pthread_create(&sim->cpu_thread[n], NULL, simulator_cpu_thread_func,
+            &sim->simulator_cpu_data[n]);
+    }
 
     /* Start supervisor thread */
     simulator_supervisor_thread();
+
+    if (sim->exporting)
+    {
+        metrics_stop(&sim->metrics);
+        pthread_join(sim->metrics_thread, NULL);
+        metrics_close(&sim->metrics);
+    }
+
+    if (stats != NULL)
+    {
+        stats->context_switches = sim->context_switches;
+        stats->execution_time = sim->simulator_time;
+        stats->ready_time = sim->ready_counter;
+        stats->running_time = sim->running_counter;
+        stats->waiting_time = sim->waiting_counter;
+        histogram_summarize(&sim->response_histogram, &stats->response);
+        histogram_summarize(&sim->ready_wait_histogram, &stats->ready_wait);
+        histogram_summarize(&sim->turnaround_histogram, &stats->turnaround);
+        histogram_summarize(&sim->preemption_histogram, &stats->preemptions);
+
+        memset(&stats->counters, 0, sizeof(stats->counters));
+        for (n=0; n<=sim->cpu_count; n++)
+        {
+            simulator_cpu_counters_t counters;
+            unsigned int c;
+
+            snapshot_slot(n, &counters);
+            stats->counters.busy_ticks += counters.busy_ticks;
+            stats->counters.idle_ticks += counters.idle_ticks;
+            stats->counters.context_switches += counters.context_switches;
+            stats->counters.forced_preemptions += counters.forced_preemptions;
+            stats->counters.timer_preemptions += counters.timer_preemptions;
+            stats->counters.migrations += counters.migrations;
+            stats->counters.remote_migrations += counters.remote_migrations;
+            stats->counters.remote_io += counters.remote_io;
+            for (c=0; c<SIM_CALLBACK_COUNT; c++)
+            {
+                stats->counters.callback_calls[c] += counters.callback_calls[c];
+                stats->counters.callback_ns[c] += counters.callback_ns[c];
+            }
+            stats->counters.parked_ns += counters.parked_ns;
+            for (c=0; c<SIM_LOCK_COUNT; c++)
+            {
+                stats->counters.lock_waits[c] += counters.lock_waits[c];
+                stats->counters.lock_wait_ns[c] += counters.lock_wait_ns[c];
+            }
+        }
+    }
+
+    /*
+     * With the inline engine nothing else refers to this simulation, so it
+     * can be freed.  CPU threads never return from idle(), so a threaded
+     * simulation is left in place until the process exits.
+     */
+    if (sim->simulator_options.engine == ENGINE_INLINE)
+    {
+        for (n=0; n<sim->cpu_count; n++)
+            pthread_cond_destroy(&sim->simulator_cpu_data[n].wakeup);
+        pthread_mutex_destroy(&sim->simulator_mutex);
+        pthread_cond_destroy(&sim->batch_done);
+        free(sim->batch);
+        free(sim->batch_event);
+        free(sim->gantt_last);
+        free(sim->cpu_slots);
+        free(sim->busy_cpus.words);
+        free(sim->simulator_cpu_data);
+        free(sim->cpu_thread);
+        for (n=0; n<sim->slot_count; n++)
+        {
+            process_slot_t *slot = &sim->slot_chunks[n / SLOT_CHUNK_SIZE][n % SLOT_CHUNK_SIZE];
+
+            free(slot->ops);
+            free(slot->name);
+        }
+        for (n=0; n<(sim->slot_count + SLOT_CHUNK_SIZE - 1) / SLOT_CHUNK_SIZE; n++)
+            free(sim->slot_chunks[n]);
+        free(sim->slot_chunks);
+        for (n=0; n<sim->io_device_count; n++)
+            free(sim->io_devices[n].in_service);
+        free(sim->io_devices);
+        free(sim);
+    }
+    sim = outer;
+    trace_ring = outer_ring;
+    thread_slot = outer_slot;
 }
 
 
 
 /*
- * This is the loop for the supervisor thread.  It waits for 100ms, then
- * simulates one interval of time.
+ * This is the loop for the supervisor thread.  It simulates one interval of
+ * time, then waits as long as the pacing mode asks for.
  */
 static void simulator_supervisor_thread(void)
 {
-    print_gantt_header();
+    bool buffered = !sim->simulator_options.quiet &&
+                    sim->simulator_options.gantt == GANTT_BUFFERED;
+
+    if (buffered)
+        outbuf_init(&sim->gantt_buffer, stdout, GANTT_BUFFER_SIZE);
+    if (!sim->simulator_options.quiet && sim->simulator_options.gantt != GANTT_OFF)
+        print_gantt_header();
+    clock_gettime(CLOCK_MONOTONIC, &sim->pace_start);
+    sim->pace_origin = sim->simulator_time;
 
     /* Loop, performing execution every 100ms.  At each execution, we will
        display a line in the Gantt chart and check for pending I/O requests */
     while (1)
     {
-        pthread_mutex_lock(&simulator_mutex);
+        pthread_mutex_lock(&sim->simulator_mutex);
+
+        /* Stop when no more processes are coming and all of them terminated */
+        if (sim->processes_terminated >= sim->processes_created && next_arrival() == NULL)
+        {
+            if (sim->checkpoint_due)
+                fprintf(stderr, "Warning: the simulation ended before tick %u; "
+                    "no checkpoint was written.\n", sim->simulator_options.checkpoint_at);
+            if (sim->tracing)
+                trace_close(&sim->trace);
+            if (sim->exporting)
+            {
+                publish_gauges(0, 0, 0);
+                __atomic_store_n(&sim->finished, true, __ATOMIC_RELEASE);
+            }
+            if (buffered)
+                outbuf_close(&sim->gantt_buffer);
+            if (!sim->simulator_options.quiet)
+                print_final_stats();
+            pthread_mutex_unlock(&sim->simulator_mutex);
+            return;
+        }
 
-        /* Exit when all processes terminate */
-        if (processes_terminated >= PROCESS_COUNT)
+        if (sim->checkpoint_due && sim->simulator_time == sim->simulator_options.checkpoint_at)
         {
-            print_final_stats();
-            exit(0);
+            write_checkpoint();
+            sim->checkpoint_due = false;
         }
 
         print_gantt_line();
+
+        /* In fast-forward mode, jump over ticks in which nothing happens */
+        if (sim->simulator_options.fast_forward)
+        {
+            unsigned int ticks = quiet_ticks();
+            if (ticks > 0)
+            {
+                skip_quiet_ticks(ticks);
+                pthread_mutex_unlock(&sim->simulator_mutex);
+                pace_supervisor();
+                continue;
+            }
+        }
+
         simulate_cpus();
         simulate_io();
         simulate_creat();
-        simulator_time++;
-        pthread_mutex_unlock(&simulator_mutex);
+        sim->simulator_time++;
+        publish_clock();
+        pthread_mutex_unlock(&sim->simulator_mutex);
+        pace_supervisor();
+    }
+}
+
+/*
+ * pace_supervisor() waits, with simulator_mutex not held, until it is time
+ * for the supervisor to simulate the next tick.
+ */
+static void pace_supervisor(void)
+{
+    double tick_ns;
+    struct timespec deadline;
+    unsigned long long ns;
+
+    switch (sim->simulator_options.pacing)
+    {
+    case PACE_UNTHROTTLED:
+        return;
+
+    case PACE_REALTIME:
+        tick_ns = 100e6;
+        break;
+
+    case PACE_SCALED:
+        tick_ns = 100e6 / sim->simulator_options.pace_scale;
+        break;
 
-        mt_safe_usleep(1);
+    default:
+        /* Give the CPU threads a chance to run; the inline engine has none */
+        if (sim->simulator_options.engine != ENGINE_INLINE)
+            mt_safe_usleep(1);
+        return;
     }
+
+    /* Sleep until the wall-clock time of the current tick */
+    ns = (unsigned long long)sim->pace_start.tv_nsec +
+         (unsigned long long)((double)(sim->simulator_time - sim->pace_origin) * tick_ns);
+    deadline.tv_sec = sim->pace_start.tv_sec + (time_t)(ns / 1000000000ull);
+    deadline.tv_nsec = (long)(ns % 1000000000ull);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
 }
 
 
@@ -221,67 +669,202 @@ static void simulator_cpu_thread(unsigned int cpu_id)
 
     while (1)
     {
-        pthread_mutex_lock(&simulator_mutex);
+        pthread_mutex_lock(&sim->simulator_mutex);
 
         /* Let the simulator know the scheduler has been run */
-        pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
+        pthread_cond_signal(&sim->simulator_cpu_data[cpu_id].wakeup);
+        if (sim->simulator_cpu_data[cpu_id].batched)
+        {
+            sim->simulator_cpu_data[cpu_id].batched = false;
+            if (--sim->batch_pending == 0)
+                pthread_cond_signal(&sim->batch_done);
+        }
 
-        if (simulator_cpu_data[cpu_id].current == NULL)
+        if (sim->simulator_cpu_data[cpu_id].current == NULL)
         {
             /* the idle process was selected */
-            simulator_cpu_data[cpu_id].state = CPU_IDLE;
+            sim->simulator_cpu_data[cpu_id].state = CPU_IDLE;
         }
         else
         {
             /* a process was scheduled */
-            simulator_cpu_data[cpu_id].state = CPU_RUNNING;
+            sim->simulator_cpu_data[cpu_id].state = CPU_RUNNING;
 
-            while (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+            while (sim->simulator_cpu_data[cpu_id].state == CPU_RUNNING)
+                pthread_cond_wait(&sim->simulator_cpu_data[cpu_id].wakeup,
+                    &sim->simulator_mutex);
         }
-        state = simulator_cpu_data[cpu_id].state;
-        pthread_mutex_unlock(&simulator_mutex);
+        state = sim->simulator_cpu_data[cpu_id].state;
+        pthread_mutex_unlock(&sim->simulator_mutex);
 
-        switch (state)
+        if (state == CPU_TERMINATE)
         {
-        case CPU_IDLE:
-            /*
-             * We can't lock the simulation_lock for idle(); otherwise we can't
-             * print statistics while any CPU is idling.
-             */
-            idle(cpu_id);
-            break;
+            pcb_t *pcb;
+
+            pthread_mutex_lock(&sim->simulator_mutex);
+            sim->processes_terminated++;
+            pcb = sim->simulator_cpu_data[cpu_id].current;
+            pthread_mutex_unlock(&sim->simulator_mutex);
+
+            /* The process's slot is free once terminate() is done with it */
+            run_callback(cpu_id, state);
+            pthread_mutex_lock(&sim->simulator_mutex);
+            release_process(pcb);
+            pthread_mutex_unlock(&sim->simulator_mutex);
+        }
+        else
+            run_callback(cpu_id, state);
+    }
+}
 
-        case CPU_PREEMPT:
-            IRWL_WRITER_LOCK(simulation_lock)
-            preempt(cpu_id);
-            IRWL_WRITER_UNLOCK(simulation_lock)
-            break;
+/*
+ * run_callback() calls the scheduler callback for a CPU event, idle() for
+ * CPU_IDLE, and adds the wall-clock time it took to the CPU's counters.
+ * Any time idle() reports having spent parked is left out: it is waiting
+ * for work, not the cost of the callback.
+ */
+static void run_callback(unsigned int cpu_id, simulator_cpu_state_t event)
+{
+    simulator_cpu_counters_t *counters = &sim->cpu_slots[cpu_id].counters;
+    unsigned long long parked = __atomic_load_n(&thread_slot->counters.parked_ns, __ATOMIC_RELAXED);
+    unsigned long long start = monotonic_ns();
+    simulator_callback_t callback;
 
-        case CPU_YIELD:
-            IRWL_WRITER_LOCK(simulation_lock)
-            yield(cpu_id);
-            IRWL_WRITER_UNLOCK(simulation_lock)
-            break;
+    switch (event)
+    {
+    case CPU_IDLE:
+        idle(cpu_id);
+        callback = SIM_CALLBACK_IDLE;
+        break;
 
-        case CPU_TERMINATE:
-            pthread_mutex_lock(&simulator_mutex);
-            processes_terminated++;
-            pthread_mutex_unlock(&simulator_mutex);
-            IRWL_WRITER_LOCK(simulation_lock)
-            terminate(cpu_id);
-            IRWL_WRITER_UNLOCK(simulation_lock)
-            break;
+    case CPU_PREEMPT:
+        preempt(cpu_id);
+        callback = SIM_CALLBACK_PREEMPT;
+        break;
 
-        case CPU_RUNNING:
-            /* This should never happen!!! */
-            break;
-        }
+    case CPU_YIELD:
+        yield(cpu_id);
+        callback = SIM_CALLBACK_YIELD;
+        break;
+
+    case CPU_TERMINATE:
+        terminate(cpu_id);
+        callback = SIM_CALLBACK_TERMINATE;
+        break;
+
+    default:
+        /* CPU_RUNNING: this should never happen!!! */
+        return;
     }
+
+    parked = __atomic_load_n(&thread_slot->counters.parked_ns, __ATOMIC_RELAXED) - parked;
+    count_add(&counters->callback_calls[callback], 1);
+    count_add(&counters->callback_ns[callback], monotonic_ns() - start - parked);
+}
+
+/*
+ * run_wake_up() calls the scheduler's wake_up() for a process, and adds the
+ * time it took to the supervisor's counters.  It is called without
+ * simulator_mutex held.
+ */
+static void run_wake_up(pcb_t *pcb)
+{
+    simulator_cpu_counters_t *counters = &sim->cpu_slots[sim->cpu_count].counters;
+    unsigned long long start = monotonic_ns();
+
+    wake_up(pcb);
+    count_add(&counters->callback_calls[SIM_CALLBACK_WAKE_UP], 1);
+    count_add(&counters->callback_ns[SIM_CALLBACK_WAKE_UP], monotonic_ns() - start);
+}
+
+
+
+/*
+ * count_process_states() returns how many processes are ready, running and
+ * waiting.  These are worked out from state the simulator owns rather than
+ * read from the PCBs, which the scheduler writes from the CPU threads: a
+ * process is running while it is some CPU's current process, waiting while
+ * it has an I/O request, and otherwise ready from its creation until it
+ * terminates.  So the counts need no lock beyond simulator_mutex, and never
+ * wait for a scheduler callback to finish.  It is called with
+ * simulator_mutex held.
+ */
+static void count_process_states(unsigned int *ready, unsigned int *running,
+                                 unsigned int *waiting)
+{
+    unsigned int live = sim->processes_created - sim->processes_terminated;
+
+    *running = cpumask_weight(&sim->busy_cpus);
+    *waiting = sim->io_requests;
+
+    /* A process part way through terminating is counted as running */
+    *ready = (live > *running + *waiting) ? live - *running - *waiting : 0;
+}
+
+/*
+ * publish_gauges() publishes the process counts of this tick, and how many
+ * I/O requests are in service, for simulator_metrics().  It is called with
+ * simulator_mutex held.
+ */
+static void publish_gauges(unsigned int ready, unsigned int running, unsigned int waiting)
+{
+    unsigned int in_service = 0;
+    unsigned int n, c;
+
+    for (n=0; n<sim->io_device_count; n++)
+        for (c=0; c<sim->io_devices[n].config.channels; c++)
+            if (sim->io_devices[n].in_service[c] != NULL)
+                in_service++;
+
+    __atomic_store_n(&sim->gauges[GAUGE_READY], ready, __ATOMIC_RELAXED);
+    __atomic_store_n(&sim->gauges[GAUGE_RUNNING], running, __ATOMIC_RELAXED);
+    __atomic_store_n(&sim->gauges[GAUGE_WAITING], waiting, __ATOMIC_RELAXED);
+    __atomic_store_n(&sim->gauges[GAUGE_IO_IN_SERVICE], in_service, __ATOMIC_RELAXED);
+    __atomic_store_n(&sim->gauges[GAUGE_CREATED], sim->processes_created, __ATOMIC_RELAXED);
+    __atomic_store_n(&sim->gauges[GAUGE_TERMINATED], sim->processes_terminated,
+        __ATOMIC_RELAXED);
+}
+
+/*
+ * gantt_printf() prints part of the Gantt chart: to stdout, or with
+ * GANTT_BUFFERED into gantt_buffer, whose own thread writes it out.
+ */
+static void gantt_printf(const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    if (sim->simulator_options.gantt == GANTT_BUFFERED)
+        outbuf_vprintf(&sim->gantt_buffer, format, args);
+    else
+        vprintf(format, args);
+    va_end(args);
 }
 
+/*
+ * gantt_assignment_changed() returns true if some CPU runs a different
+ * process than on the last line printed, or no line has been printed yet,
+ * and remembers the current assignment.
+ */
+static bool gantt_assignment_changed(void)
+{
+    bool changed = !sim->gantt_printed;
+    unsigned int n;
 
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        pcb_t *pcb = sim->simulator_cpu_data[n].current;
+        unsigned int admitted = (pcb != NULL) ? slot_of(pcb)->admitted : UINT_MAX;
+
+        if (sim->gantt_last[n] != admitted)
+        {
+            sim->gantt_last[n] = admitted;
+            changed = true;
+        }
+    }
+    sim->gantt_printed = true;
+    return changed;
+}
 
 /*
  * print_gantt_header() and print_gantt_line() are helper functions to display
@@ -291,14 +874,14 @@ static void print_gantt_header(void)
 {
     unsigned int n;
 
-    printf("Time  Ru Re Wa     ");
-    for (n=0; n<cpu_count; n++)
-        printf(" CPU %d   ", n);
-    printf("     < I/O Queue <\n"
+    gantt_printf("Time  Ru Re Wa     ");
+    for (n=0; n<sim->cpu_count; n++)
+        gantt_printf(" CPU %d   ", n);
+    gantt_printf("     < I/O Queue <\n"
            "===== == == ==     ");
-    for (n=0; n<cpu_count; n++)
-        printf(" ========");
-    printf("     =============\n");
+    for (n=0; n<sim->cpu_count; n++)
+        gantt_printf(" ========");
+    gantt_printf("     =============\n");
 }
 
 static void print_gantt_line(void)
@@ -307,68 +890,179 @@ static void print_gantt_line(void)
     unsigned int current_ready = 0, current_running = 0, current_waiting = 0;
     unsigned int n;
 
+    /* Update number of processes in each state */
+    count_process_states(&current_ready, &current_running, &current_waiting);
+    sim->ready_counter += current_ready;
+    sim->running_counter += current_running;
+    sim->waiting_counter += current_waiting;
+    sim->ticks_sampled = sim->simulator_time + 1;
+    if (sim->exporting)
+        publish_gauges(current_ready, current_running, current_waiting);
 
-    /*
-     * Update number of processes in each state.
-     */
-    IRWL_READER_LOCK(simulation_lock)
-    for (n=0; n<PROCESS_COUNT; n++)
-    {
-        switch(processes[n].state)
-        {
-        case PROCESS_READY:
-            current_ready++;
-            ready_counter++;
-            break;
+    if (sim->simulator_options.quiet || sim->simulator_options.gantt == GANTT_OFF)
+        return;
+    if (sim->simulator_options.gantt == GANTT_CHANGES && !gantt_assignment_changed())
+        return;
+
+    /* Print time */
+    gantt_printf("%-5.1f %-2d %-2d %-2d     ", (float)sim->simulator_time / 10.0,
+        current_running, current_ready, current_waiting);
 
-        case PROCESS_RUNNING:
-            current_running++;
-            running_counter++;
-            break;
+    /* Print running processes */
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        if (sim->simulator_cpu_data[n].current != NULL)
+            gantt_printf(" %-8s", sim->simulator_cpu_data[n].current->name);
+        else
+            gantt_printf(" (IDLE)  ");
+    }
 
-        case PROCESS_WAITING:
-            current_waiting++;
-            waiting_counter++;
-            break;
+    /* Print I/O requests, in service and then waiting, for each device */
+    gantt_printf("     <");
+    for (n=0; n<sim->io_device_count; n++)
+    {
+        io_device_t *device = &sim->io_devices[n];
+        unsigned int c;
 
-        default:
-            break;
+        if (n > 0)
+            gantt_printf(" |");
+        for (c=0; c<device->config.channels; c++)
+        {
+            if (device->in_service[c] != NULL)
+                gantt_printf(" %s", device->in_service[c]->pcb->name);
         }
+        for (r = device->head; r != NULL; r = r->next)
+            gantt_printf(" %s", r->pcb->name);
     }
+    gantt_printf(" <\n");
+}
 
+/*
+ * print_cpu_counters() prints the counters of each CPU and the supervisor,
+ * then the scheduler callbacks and lock waits summed over all of them.
+ * Times are wall-clock milliseconds.
+ */
+static void print_cpu_counters(void)
+{
+    static const char *callback_names[SIM_CALLBACK_COUNT] = {
+        "idle()", "preempt()", "yield()", "terminate()", "wake_up()"
+    };
+    static const char *lock_names[SIM_LOCK_COUNT] = { "queue_mutex", "current_mutex" };
+    simulator_cpu_counters_t counters, total;
+    unsigned int n, c;
+
+    memset(&total, 0, sizeof(total));
+    printf("\nPer-CPU counters  Busy %%  Switches  Timer  Forced  Migrated  Callback ms  Lock wait ms  Parked ms\n");
+    for (n=0; n<=sim->cpu_count; n++)
+    {
+        unsigned long long callback_ns = 0, lock_wait_ns = 0;
 
-    /* Print time */
-    printf("%-5.1f %-2d %-2d %-2d     ", (float)simulator_time / 10.0,
-        current_running, current_ready, current_waiting);
+        snapshot_slot(n, &counters);
+        for (c=0; c<SIM_CALLBACK_COUNT; c++)
+        {
+            callback_ns += counters.callback_ns[c];
+            total.callback_calls[c] += counters.callback_calls[c];
+            total.callback_ns[c] += counters.callback_ns[c];
+        }
+        for (c=0; c<SIM_LOCK_COUNT; c++)
+        {
+            lock_wait_ns += counters.lock_wait_ns[c];
+            total.lock_waits[c] += counters.lock_waits[c];
+            total.lock_wait_ns[c] += counters.lock_wait_ns[c];
+        }
 
-    /* Print running processes */
-    for (n=0; n<cpu_count; n++)
-    {
-        if (simulator_cpu_data[n].current != NULL)
-            printf(" %-8s", simulator_cpu_data[n].current->name);
+        if (n < sim->cpu_count)
+            printf("  CPU %-10u %8.1f %9llu %6llu %7llu %9llu", n,
+                sim->simulator_time ? 100.0 * (double)counters.busy_ticks /
+                (double)sim->simulator_time : 0.0, counters.context_switches,
+                counters.timer_preemptions, counters.forced_preemptions,
+                counters.migrations);
         else
-            printf(" (IDLE)  ");
+            printf("  %-14s %8s %9s %6s %7s %9s", "Supervisor", "-", "-", "-", "-", "-");
+        printf(" %12.3f %13.3f", (double)callback_ns / 1e6, (double)lock_wait_ns / 1e6);
+        if (n < sim->cpu_count)
+            printf(" %10.3f\n", (double)counters.parked_ns / 1e6);
+        else
+            printf(" %10s\n", "-");
     }
 
-    /* Print I/O requests */
-    printf("     <");
-    r = io_queue_head;
-    while (r != NULL)
+    print_node_counters();
+
+    printf("\nScheduler callbacks      Calls     Total ms    ns/call\n");
+    for (c=0; c<SIM_CALLBACK_COUNT; c++)
+        printf("  %-16s %11llu %12.3f %10.0f\n", callback_names[c], total.callback_calls[c],
+            (double)total.callback_ns[c] / 1e6, total.callback_calls[c] ?
+            (double)total.callback_ns[c] / (double)total.callback_calls[c] : 0.0);
+
+    printf("\nScheduler lock waits     Waits     Total ms\n");
+    for (c=0; c<SIM_LOCK_COUNT; c++)
+        printf("  %-16s %11llu %12.3f\n", lock_names[c], total.lock_waits[c],
+            (double)total.lock_wait_ns[c] / 1e6);
+}
+
+/*
+ * print_node_counters() prints the CPU counters summed over each NUMA node,
+ * with the migrations and I/O bursts that crossed nodes.  A flat machine
+ * has a single node, and nothing is printed for it.
+ */
+static void print_node_counters(void)
+{
+    unsigned int node_count = topology_node_count(&sim->topology);
+    unsigned int node_cpus = sim->cpu_count / node_count;
+    simulator_cpu_counters_t counters;
+    unsigned int node, n;
+
+    if (node_count < 2)
+        return;
+
+    printf("\nPer-node counters  CPUs  Busy %%  Migrated  Remote  Remote I/O\n");
+    for (node=0; node<node_count; node++)
     {
-        printf(" %s", r->pcb->name);
-        r = r->next;
+        unsigned long long busy = 0, migrations = 0, remote = 0, remote_io = 0;
+
+        for (n=node*node_cpus; n<(node+1)*node_cpus; n++)
+        {
+            snapshot_slot(n, &counters);
+            busy += counters.busy_ticks;
+            migrations += counters.migrations;
+            remote += counters.remote_migrations;
+            remote_io += counters.remote_io;
+        }
+        printf("  Node %-11u %5u %7.1f %9llu %7llu %11llu\n", node, node_cpus,
+            sim->simulator_time ? 100.0 * (double)busy /
+            ((double)sim->simulator_time * node_cpus) : 0.0, migrations, remote, remote_io);
     }
-    printf(" <\n");
+}
+
+/* print_latency() prints one line of the per-process summary, in seconds */
+static void print_latency(const char *name, const histogram_t *histogram)
+{
+    histogram_summary_t summary;
 
-    IRWL_READER_UNLOCK(simulation_lock)
+    histogram_summarize(histogram, &summary);
+    printf("  %-20s %8.1f %8.1f %8.1f %8.1f %8.1f\n", name, summary.mean / 10.0,
+        (float)summary.p50 / 10.0, (float)summary.p95 / 10.0,
+        (float)summary.p99 / 10.0, (float)summary.max / 10.0);
 }
 
 static void print_final_stats(void)
 {
+    histogram_summary_t preemptions;
+
     printf("\n\n");
-    printf("Total Context Switches: %u\n", context_switches);
-    printf("Total execution time: %.1f s\n", (float)simulator_time / 10.0);
-    printf("Total time spent in READY state: %.1f s\n", (float)ready_counter / 10.0);
+    printf("Total Context Switches: %u\n", sim->context_switches);
+    printf("Total execution time: %.1f s\n", (float)sim->simulator_time / 10.0);
+    printf("Total time spent in READY state: %.1f s\n", (float)sim->ready_counter / 10.0);
+
+    histogram_summarize(&sim->preemption_histogram, &preemptions);
+    printf("\nPer-process latency (s)     mean      p50      p95      p99      max\n");
+    print_latency("Response time", &sim->response_histogram);
+    print_latency("Ready queue wait", &sim->ready_wait_histogram);
+    print_latency("Turnaround time", &sim->turnaround_histogram);
+    printf("  %-20s %8.1f %8u %8u %8u %8u\n", "Preemptions", preemptions.mean,
+        preemptions.p50, preemptions.p95, preemptions.p99, preemptions.max);
+
+    print_cpu_counters();
 }
 
 
@@ -380,84 +1074,271 @@ static void print_final_stats(void)
 extern void context_switch(unsigned int cpu_id, pcb_t *pcb,
                            int preemption_time)
 {
-    assert(cpu_id < cpu_count);
-    assert(pcb == NULL || (pcb >= processes && pcb <= processes +
-        PROCESS_COUNT - 1));
+    assert(cpu_id < sim->cpu_count);
+    assert(pcb == NULL || slot_of(pcb)->live);
+
+    pthread_mutex_lock(&sim->simulator_mutex);
+    sim->context_switches++;
+    count_add(&sim->cpu_slots[cpu_id].counters.context_switches, 1);
+    account_busy(cpu_id, pcb != NULL);
+    if (pcb != NULL)
+    {
+        process_stats_t *ps = &slot_of(pcb)->stats;
+        unsigned int now = get_current_time();
 
-    IRWL_WRITER_UNLOCK(simulation_lock);
+        if (ps->first_run == UINT_MAX)
+            ps->first_run = now;
+        ps->ready_time += sim->ticks_sampled - ps->ready_since;
+
+        /*
+         * A process that moves core starts with cold caches, and one that
+         * moves node with its memory on the old node
+         */
+        pcb->migration_ticks = 0;
+        if (pcb->last_cpu != -1 && pcb->last_cpu != (int)cpu_id)
+        {
+            unsigned int last_cpu = (unsigned int)pcb->last_cpu;
 
-    pthread_mutex_lock(&simulator_mutex);
-    context_switches++;
-    simulator_cpu_data[cpu_id].current = pcb;
-    simulator_cpu_data[cpu_id].preemption_timer = preemption_time;
-    pthread_mutex_unlock(&simulator_mutex);
+            count_add(&sim->cpu_slots[cpu_id].counters.migrations, 1);
+            if (topology_core_of(&sim->topology, last_cpu) != topology_core_of(&sim->topology, cpu_id))
+                pcb->migration_ticks = sim->simulator_options.migration_cost;
+            if (topology_node_of(&sim->topology, last_cpu) != topology_node_of(&sim->topology, cpu_id))
+            {
+                count_add(&sim->cpu_slots[cpu_id].counters.remote_migrations, 1);
+                pcb->migration_ticks += sim->simulator_options.remote_cost;
+            }
+        }
+        pcb->last_cpu = (int)cpu_id;
+    }
+    sim->simulator_cpu_data[cpu_id].current = pcb;
+    if (pcb != NULL)
+        cpumask_set(&sim->busy_cpus, cpu_id);
+    else
+        cpumask_clear(&sim->busy_cpus, cpu_id);
+    sim->simulator_cpu_data[cpu_id].preemption_timer = preemption_time;
+    pthread_mutex_unlock(&sim->simulator_mutex);
 
-    IRWL_WRITER_LOCK(simulation_lock);
+    trace_event(TRACE_CONTEXT_SWITCH, cpu_id, pcb, (unsigned int)preemption_time);
+    if (pcb != NULL)
+        trace_state(cpu_id, pcb, PROCESS_READY, PROCESS_RUNNING);
 }
 
 extern void force_preempt(unsigned int cpu_id)
 {
-    assert(cpu_id < cpu_count);
+    assert(cpu_id < sim->cpu_count);
 
-    IRWL_WRITER_UNLOCK(simulation_lock);
-    pthread_mutex_lock(&simulator_mutex);
+    pthread_mutex_lock(&sim->simulator_mutex);
 
     /*
      * It is possible that the scheduler code calls force_preempt() at the
      * same time the process was already going to yield or terminate.  We
      * check for that case by only preempting if the CPU is set to CPU_RUNNING.
      */
-    if (simulator_cpu_data[cpu_id].state == CPU_RUNNING)
+    if (sim->simulator_cpu_data[cpu_id].state == CPU_RUNNING)
     {
-        simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
-        pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-        /* Ensure the scheduler gets run before the simulator */
-        pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-            &simulator_mutex);
+        trace_event(TRACE_FORCE_PREEMPT, cpu_id, sim->simulator_cpu_data[cpu_id].current, 1);
+        count_add(&sim->cpu_slots[cpu_id].counters.forced_preemptions, 1);
+        trace_cpu_event(cpu_id, CPU_PREEMPT);
+        account_cpu_event(cpu_id, CPU_PREEMPT);
+        dispatch_cpu_event(cpu_id, CPU_PREEMPT);
     }
+    else
+        trace_event(TRACE_FORCE_PREEMPT, cpu_id, sim->simulator_cpu_data[cpu_id].current, 0);
 
-    pthread_mutex_unlock(&simulator_mutex);
-    IRWL_WRITER_LOCK(simulation_lock);
+    pthread_mutex_unlock(&sim->simulator_mutex);
 }
 
 
 
 /*
- * The functions below are used by the supervisor thread to simulate the OS.
- *
- * simulate_cpus() / simulate_process() simulate the processes on each CPU
- *   and signal the appropriate CPU thread if an event occurs.
- *
- * submit_io_request() inserts a PCB into tail of the I/O queue.
+ * dispatch_cpu_event() delivers a preempt, yield or terminate event to a CPU
+ * and returns once the scheduler has handled it.  It is called with
+ * simulator_mutex held.
  *
- * simulate_io() simulates the I/O request at the head of the I/O queue and
- *   calls wake_up() upon completion.
- *
- * simulate_creat() simulates initial process creation by calling the
- *   scheduler's wake_up().
+ * With the threaded engine this wakes the CPU thread and waits for it.  With
+ * the inline engine (ENGINE_INLINE) the scheduler callback is called right
+ * here instead, followed by idle() for any CPU left without a process, so a
+ * run is single-threaded and gives the same result every time.
  */
-
-static void simulate_cpus(void)
+static void dispatch_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event)
 {
-    unsigned int n;
-
-    for (n=0; n<cpu_count; n++)
+    if (sim->simulator_options.engine == ENGINE_INLINE)
     {
-        if (simulator_cpu_data[n].current != NULL)
-            simulate_process(n, simulator_cpu_data[n].current);
+        run_inline_event(cpu_id, event);
+        return;
     }
+
+    sim->simulator_cpu_data[cpu_id].state = event;
+    pthread_cond_signal(&sim->simulator_cpu_data[cpu_id].wakeup);
+
+    /* Ensure the scheduler gets run before the simulator */
+    pthread_cond_wait(&sim->simulator_cpu_data[cpu_id].wakeup,
+        &sim->simulator_mutex);
 }
 
-static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
+/*
+ * queue_cpu_event() is how simulate_process() raises an event.  With
+ * ENGINE_BATCHED the event is added to the tick's batch, for
+ * dispatch_cpu_batch() to deliver once every CPU has been simulated;
+ * otherwise it is dispatched right away.  It is called with simulator_mutex
+ * held.
+ */
+static void queue_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event)
 {
+    trace_cpu_event(cpu_id, event);
+    account_cpu_event(cpu_id, event);
+    if (sim->simulator_options.engine != ENGINE_BATCHED)
+    {
+        dispatch_cpu_event(cpu_id, event);
+        return;
+    }
+
     /*
-     * The "program counter" is really just a pointer to the current position
-     * in the operations array
+     * simulate_cpus() only simulates CPUs whose thread has settled in
+     * CPU_RUNNING, so every CPU in the batch is parked waiting for its
+     * event.  It stays CPU_RUNNING, so nothing else preempts it, until then.
      */
-    op_t *pc = (op_t*)pcb->pc;
+    sim->simulator_cpu_data[cpu_id].batched = true;
+    sim->batch[sim->batch_size] = cpu_id;
+    sim->batch_event[sim->batch_size++] = event;
+}
 
-    switch (pc->type)
+/*
+ * dispatch_cpu_batch() delivers every event in the batch: it wakes all of
+ * the CPUs first and then waits once, until the last of them has been
+ * handled, instead of a round trip per CPU.  It is called with
+ * simulator_mutex held; the CPU threads take it in turn while the
+ * supervisor waits, and otherwise run their callbacks in parallel.
+ */
+static void dispatch_cpu_batch(void)
+{
+    unsigned int n;
+
+    if (sim->batch_size == 0)
+        return;
+
+    sim->batch_pending = sim->batch_size;
+    for (n=0; n<sim->batch_size; n++)
+    {
+        sim->simulator_cpu_data[sim->batch[n]].state = sim->batch_event[n];
+        pthread_cond_signal(&sim->simulator_cpu_data[sim->batch[n]].wakeup);
+    }
+
+    while (sim->batch_pending > 0)
+        pthread_cond_wait(&sim->batch_done, &sim->simulator_mutex);
+    sim->batch_size = 0;
+}
+
+/*
+ * run_inline_event() is the inline engine's version of one pass of
+ * simulator_cpu_thread(): it runs the scheduler callback for an event, then
+ * sets the CPU state the way the CPU thread would.  It is called with
+ * simulator_mutex held, and drops it around the callback.
+ */
+static void run_inline_event(unsigned int cpu_id, simulator_cpu_state_t event)
+{
+    pcb_t *pcb = sim->simulator_cpu_data[cpu_id].current;
+
+    sim->simulator_cpu_data[cpu_id].state = event;
+    if (event == CPU_TERMINATE)
+        sim->processes_terminated++;
+    pthread_mutex_unlock(&sim->simulator_mutex);
+
+    run_callback(cpu_id, event);
+
+    pthread_mutex_lock(&sim->simulator_mutex);
+    if (event == CPU_TERMINATE)
+        release_process(pcb);
+    sim->simulator_cpu_data[cpu_id].state =
+        sim->simulator_cpu_data[cpu_id].current == NULL ? CPU_IDLE : CPU_RUNNING;
+    pthread_mutex_unlock(&sim->simulator_mutex);
+
+    run_inline_idle();
+    pthread_mutex_lock(&sim->simulator_mutex);
+}
+
+/*
+ * run_inline_idle() calls idle() for every CPU without a process, in CPU
+ * order.  In inline mode idle() returns instead of blocking when there is
+ * nothing to run.  It is called without simulator_mutex held, and does
+ * nothing with the threaded engine.
+ */
+static void run_inline_idle(void)
+{
+    unsigned int n;
+
+    if (sim->simulator_options.engine != ENGINE_INLINE)
+        return;
+
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        pthread_mutex_lock(&sim->simulator_mutex);
+        bool cpu_idle = (sim->simulator_cpu_data[n].current == NULL);
+        pthread_mutex_unlock(&sim->simulator_mutex);
+
+        if (cpu_idle)
+        {
+            run_callback(n, CPU_IDLE);
+
+            pthread_mutex_lock(&sim->simulator_mutex);
+            sim->simulator_cpu_data[n].state =
+                sim->simulator_cpu_data[n].current == NULL ? CPU_IDLE : CPU_RUNNING;
+            pthread_mutex_unlock(&sim->simulator_mutex);
+        }
+    }
+}
+
+
+
+/*
+ * The functions below are used by the supervisor thread to simulate the OS.
+ *
+ * simulate_cpus() / simulate_process() simulate the processes on each CPU
+ *   and signal the appropriate CPU thread if an event occurs.
+ *
+ * submit_io_request() inserts a PCB into the tail of the queue of the I/O
+ *   device its op names, using the request in the process's slot.
+ *
+ * simulate_io() starts waiting requests on any free channel of each I/O
+ *   device, simulates every request in service and calls wake_up() upon
+ *   completion.
+ *
+ * simulate_creat() simulates initial process creation by calling the
+ *   scheduler's wake_up().
+ *
+ * admit_process() and release_process() give a process its slot when it
+ *   is created and free it once it has terminated.
+ */
+
+static void simulate_cpus(void)
+{
+    int n;
+
+    /*
+     * Only visit CPUs that have a process; idle CPUs have nothing to do.  A
+     * CPU whose thread has not settled into CPU_RUNNING yet, e.g. one that
+     * idle() has just given a process, is left for the next tick: the
+     * thread would overwrite any event raised for it now.
+     */
+    sim->batch_size = 0;
+    for (n=cpumask_first(&sim->busy_cpus); n!=-1; n=cpumask_next(&sim->busy_cpus, (unsigned int)n))
+    {
+        if (sim->simulator_cpu_data[n].current != NULL &&
+            sim->simulator_cpu_data[n].state == CPU_RUNNING)
+            simulate_process((unsigned int)n, sim->simulator_cpu_data[n].current);
+    }
+    dispatch_cpu_batch();
+}
+
+static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
+{
+    /*
+     * The "program counter" is really just a pointer to the current position
+     * in the operations array
+     */
+    op_t *pc = (op_t*)pcb->pc;
+
+    switch (pc->type)
     {
     case OP_CPU:
         /* Scheduling a running process ... good ... */
@@ -465,53 +1346,50 @@ static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
         /* Check to see if the CPU burst has completed */
         if (pc->time > 0)
         {
-            /* Simulate running the process */
-            pcb->time_in_CPU_burst = pc->time--; // Set remaining time then decrement time
-            pcb->total_time_remaining--;
+            /* Simulate running the process, once it has warmed the caches */
+            if (pcb->migration_ticks > 0)
+                pcb->migration_ticks--;
+            else
+            {
+                pcb->time_in_CPU_burst = pc->time--; // Set remaining time then decrement time
+                pcb->total_time_remaining--;
+                pcb->burst_ticks++;
+            }
+            if (pcb->weight != 0)
+                pcb->vruntime += vruntime_delta(pcb);
 
             /* Simulate the preemption timer */
-            simulator_cpu_data[cpu_id].preemption_timer--;
+            sim->simulator_cpu_data[cpu_id].preemption_timer--;
 
-            if (simulator_cpu_data[cpu_id].preemption_timer == 0)
+            if (sim->simulator_cpu_data[cpu_id].preemption_timer == 0)
             {
                 /* The timer has expired; preempt the running process */
-                simulator_cpu_data[cpu_id].state = CPU_PREEMPT;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+                count_add(&sim->cpu_slots[cpu_id].counters.timer_preemptions, 1);
+                queue_cpu_event(cpu_id, CPU_PREEMPT);
             }
         }
         else
         {
+            /* The burst is over; fold its length into the estimate */
+            estimate_burst(pcb);
+
             /* Move to the next operation */
             pcb->pc=((op_t*)(pcb->pc))+1;
             pc++;
             switch (pc->type)
             {
             case OP_IO:
-                /* Put a request in the I/O FIFO queue */
-                submit_io_request(pcb, pc->time);
+                /* Put a request in the queue of the op's I/O device */
+                submit_io_request(cpu_id, pcb, pc->time);
 
                 /* Generate a yield() call on the appropriate CPU */
-                simulator_cpu_data[cpu_id].state = CPU_YIELD;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+                queue_cpu_event(cpu_id, CPU_YIELD);
 
                 break;
 
             case OP_TERMINATE:
                 /* Generate a terminate() call on the appropriate CPU */
-                simulator_cpu_data[cpu_id].state = CPU_TERMINATE;
-                pthread_cond_signal(&simulator_cpu_data[cpu_id].wakeup);
-
-                /* Ensure the scheduler gets run before the simulator */
-                pthread_cond_wait(&simulator_cpu_data[cpu_id].wakeup,
-                    &simulator_mutex);
+                queue_cpu_event(cpu_id, CPU_TERMINATE);
 
                 break;
 
@@ -533,89 +1411,808 @@ static void simulate_process(unsigned int cpu_id, pcb_t *pcb)
     }
 }
 
-static void submit_io_request(pcb_t *pcb, unsigned int execution_time)
+/*
+ * estimate_burst() folds the length of the CPU burst a process has just
+ * completed into its burst_estimate, the way SJF approximations predict
+ * the next burst: halfway between the last estimate and the last burst.
+ */
+static void estimate_burst(pcb_t *pcb)
+{
+    unsigned long long burst = (unsigned long long)pcb->burst_ticks * PCB_BURST_SCALE;
+
+    if (pcb->burst_estimate != 0)
+        burst = (burst + pcb->burst_estimate + 1) / 2;
+    pcb->burst_estimate = (burst < UINT_MAX) ? (unsigned int)burst : UINT_MAX;
+    pcb->burst_ticks = 0;
+}
+
+/* The vruntime a process gains for each tick it runs */
+static unsigned long long vruntime_delta(const pcb_t *pcb)
+{
+    return PCB_VRUNTIME_TICK * PCB_NICE_0_WEIGHT / pcb->weight;
+}
+
+static void submit_io_request(unsigned int cpu_id, pcb_t *pcb, unsigned int execution_time)
 {
+    unsigned int device_id = pcb->pc->device % sim->io_device_count;
+    io_device_t *device = &sim->io_devices[device_id];
     io_request *r;
 
+    trace_event(TRACE_IO_SUBMIT, cpu_id, pcb, device_id);
+
     /* Build I/O Request */
-    r = malloc(sizeof(io_request));
-    assert(r != NULL);
+    r = &slot_of(pcb)->io;
     r->pcb = pcb;
     r->execution_time = execution_time;
-    r->next = NULL;
+    r->remote_ticks = 0;
 
-    /* Add request to head of queue */
-    if (io_queue_tail != NULL)
+    /* I/O to a device on another node takes longer */
+    if (device->config.node != topology_node_of(&sim->topology, cpu_id))
     {
-        io_queue_tail->next = r;
-        io_queue_tail = r;
+        count_add(&sim->cpu_slots[cpu_id].counters.remote_io, 1);
+        r->remote_ticks = sim->simulator_options.remote_cost;
+    }
+    sim->io_requests++;
+    append_io_request(device, r);
+}
+
+/* append_io_request() adds a request to the tail of a device's queue */
+static void append_io_request(io_device_t *device, io_request *r)
+{
+    r->next = NULL;
+    if (device->tail != NULL)
+    {
+        device->tail->next = r;
+        device->tail = r;
     }
     else
     {
-        io_queue_head = r;
-        io_queue_tail = r;
+        device->head = r;
+        device->tail = r;
     }
 }
 
+/*
+ * take_io_request() removes the request a device services next from its
+ * queue: the oldest for IO_FIFO, or for IO_SHORTEST_FIRST the shortest,
+ * oldest first among equals.
+ */
+static io_request *take_io_request(io_device_t *device)
+{
+    io_request *r = device->head, *prev = NULL, *best_prev = NULL;
+
+    if (device->config.discipline == IO_SHORTEST_FIRST)
+    {
+        for (prev = r; prev->next != NULL; prev = prev->next)
+        {
+            if (prev->next->execution_time < r->execution_time)
+            {
+                best_prev = prev;
+                r = prev->next;
+            }
+        }
+    }
+
+    if (best_prev != NULL)
+        best_prev->next = r->next;
+    else
+        device->head = r->next;
+    if (device->tail == r)
+        device->tail = best_prev;
+    r->next = NULL;
+    return r;
+}
+
 static void simulate_io(void)
 {
-    if (io_queue_head == NULL)
-        return; /* There are no I/O requests */
+    unsigned int n, c;
 
-    if (io_queue_head->execution_time-- <= 0)
+    for (n=0; n<sim->io_device_count; n++)
     {
-        io_request *completed = io_queue_head;
-        pcb_t *pcb;
+        io_device_t *device = &sim->io_devices[n];
 
-        /* Move the programs "PC" to the next "instruction" */
-        completed->pcb->pc = ((op_t*)completed->pcb->pc) + 1;
+        /* Start waiting requests on free channels */
+        for (c=0; c<device->config.channels && device->head != NULL; c++)
+        {
+            if (device->in_service[c] == NULL)
+                device->in_service[c] = take_io_request(device);
+        }
 
-        /*
-         * Remove the I/O request from the queue before calling the scheduler
-         * code.  We must do this, because once we release the simulator_mutex,
-         * the I/O queue may have changed.
-         */
-        pcb = completed->pcb;
-        io_queue_head = completed->next;
-        if (io_queue_head == NULL)
-            io_queue_tail = NULL;
-        free(completed);
+        for (c=0; c<device->config.channels; c++)
+        {
+            io_request *r = device->in_service[c];
+            pcb_t *pcb;
 
-        /* Call the scheduler's wake_up() handler */
-        pthread_mutex_unlock(&simulator_mutex);
-        IRWL_WRITER_LOCK(simulation_lock);
-        wake_up(pcb);
-        IRWL_WRITER_UNLOCK(simulation_lock);
-        pthread_mutex_lock(&simulator_mutex);
-    }
-    else {
-        io_queue_head->pcb->total_time_remaining--;
+            if (r == NULL)
+                continue;
+
+            if (r->remote_ticks > 0)
+            {
+                r->remote_ticks--;
+                continue;
+            }
+            if (r->execution_time-- > 0)
+            {
+                r->pcb->total_time_remaining--;
+                continue;
+            }
+
+            /* Move the programs "PC" to the next "instruction" */
+            pcb = r->pcb;
+            pcb->pc = ((op_t*)pcb->pc) + 1;
+
+            /*
+             * Free the channel before calling the scheduler code.  Only
+             * the supervisor touches the I/O devices, so they are as we
+             * left them when simulator_mutex is taken back.
+             */
+            device->in_service[c] = NULL;
+            sim->io_requests--;
+            trace_event(TRACE_IO_COMPLETE, TRACE_NONE_CPU, pcb, n);
+            trace_state(TRACE_NONE_CPU, pcb, PROCESS_WAITING, PROCESS_READY);
+            account_ready(pcb);
+
+            /* Call the scheduler's wake_up() handler */
+            pthread_mutex_unlock(&sim->simulator_mutex);
+            run_wake_up(pcb);
+            run_inline_idle();
+            pthread_mutex_lock(&sim->simulator_mutex);
+        }
     }
 }
 
+/*
+ * simulate_creat() admits every process whose arrival time has come.  The
+ * stream is in arrival order, so this only looks at the next one.
+ */
 static void simulate_creat(void)
 {
-    static int processes_created = 0;
+    const pcb_t *next;
 
-    if ((simulator_time % 10) == 0 && processes_created < PROCESS_COUNT)
+    while ((next = next_arrival()) != NULL && next->arrival_time <= sim->simulator_time)
     {
+        pcb_t *pcb = admit_process(next);
+
+        workload_stream_next(sim->stream);
+        trace_state(TRACE_NONE_CPU, pcb, PROCESS_NEW, PROCESS_READY);
+        account_ready(pcb);
+
         /* Call scheduler's wake_up() handler */
-        pthread_mutex_unlock(&simulator_mutex);
-        IRWL_WRITER_LOCK(simulation_lock);
-        wake_up(&processes[processes_created]);
-        IRWL_WRITER_UNLOCK(simulation_lock);
-        pthread_mutex_lock(&simulator_mutex);
+        pthread_mutex_unlock(&sim->simulator_mutex);
+        run_wake_up(pcb);
+        run_inline_idle();
+        pthread_mutex_lock(&sim->simulator_mutex);
+
+        sim->processes_created++;
+    }
+}
+
+/*
+ * next_arrival() returns the next process the stream has to create, or
+ * NULL once it has run out.  A stream whose file turns out not to be valid
+ * has already said why, and ends the program.
+ */
+static const pcb_t *next_arrival(void)
+{
+    const pcb_t *next = workload_stream_peek(sim->stream);
+
+    if (next == NULL && sim->stream->failed)
+        exit(-1);
+    return next;
+}
+
+/* slot_of() returns the slot a PCB is in */
+static process_slot_t *slot_of(const pcb_t *pcb)
+{
+    return (process_slot_t *)(uintptr_t)pcb;
+}
+
+/*
+ * take_slot() returns a free slot, adding a chunk of new ones once there
+ * are none left.  It is called with simulator_mutex held.
+ */
+static process_slot_t *take_slot(void)
+{
+    process_slot_t *slot = sim->free_slots;
+
+    if (slot != NULL)
+    {
+        sim->free_slots = slot->next_free;
+        return slot;
+    }
+
+    if (sim->slot_count % SLOT_CHUNK_SIZE == 0)
+    {
+        unsigned int chunks = sim->slot_count / SLOT_CHUNK_SIZE;
+
+        sim->slot_chunks = realloc(sim->slot_chunks, sizeof(process_slot_t *) * (chunks + 1));
+        assert(sim->slot_chunks != NULL);
+        sim->slot_chunks[chunks] = calloc(SLOT_CHUNK_SIZE, sizeof(process_slot_t));
+        assert(sim->slot_chunks[chunks] != NULL);
+    }
+    slot = &sim->slot_chunks[sim->slot_count / SLOT_CHUNK_SIZE][sim->slot_count % SLOT_CHUNK_SIZE];
+    slot->index = sim->slot_count++;
+    return slot;
+}
+
+/*
+ * admit_process() copies a process from the stream into a slot, with its
+ * ops and name, and adds it to the fingerprint.  It is called with
+ * simulator_mutex held.
+ */
+static pcb_t *admit_process(const pcb_t *process)
+{
+    process_slot_t *slot = take_slot();
+    unsigned int length = 1;
+    size_t name_length = strlen(process->name);
+
+    while (process->pc[length - 1].type != OP_TERMINATE)
+        length++;
+    if (slot->op_capacity < length)
+    {
+        slot->op_capacity = length;
+        slot->ops = realloc(slot->ops, sizeof(op_t) * length);
+        assert(slot->ops != NULL);
+    }
+    memcpy(slot->ops, process->pc, sizeof(op_t) * length);
+    if (slot->name_capacity < name_length + 1)
+    {
+        slot->name_capacity = name_length + 1;
+        slot->name = realloc(slot->name, slot->name_capacity);
+        assert(slot->name != NULL);
+    }
+    memcpy(slot->name, process->name, name_length + 1);
+
+    /* pcb_t has a const pid, so the PCB is copied with memcpy */
+    memcpy(&slot->pcb, process, sizeof(pcb_t));
+    slot->pcb.name = slot->name;
+    slot->pcb.pc = slot->ops;
+    slot->pcb.next = NULL;
+    slot->pcb.last_cpu = -1;
+    slot->pcb.migration_ticks = 0;
+    slot->pcb.burst_estimate = 0;
+    slot->pcb.burst_ticks = 0;
+    slot->stats = (process_stats_t){ 0, UINT_MAX, 0, 0 };
+    slot->admitted = sim->processes_created;
+    slot->live = true;
+    sim->fingerprint = workload_fingerprint(sim->fingerprint, process);
+    return &slot->pcb;
+}
+
+/*
+ * release_process() puts the slot of a process that has terminated on the
+ * free list.  It is called with simulator_mutex held, once terminate() has
+ * returned, so nothing refers to the PCB any more.
+ */
+static void release_process(pcb_t *pcb)
+{
+    process_slot_t *slot = slot_of(pcb);
+
+    pcb->state = PROCESS_TERMINATED;
+    slot->live = false;
+    slot->next_free = sim->free_slots;
+    sim->free_slots = slot;
+}
+
+
+
+/*
+ * quiet_ticks() and skip_quiet_ticks() implement fast-forward mode.
+ *
+ * quiet_ticks() returns how many ticks, starting with the current one, will
+ * pass without an event: no CPU burst completes, no preemption timer
+ * expires, no I/O request in service finishes or starts, and no process is
+ * created.  It returns 0 if the current tick has an event, or
+ * if a CPU thread is still part way through a scheduling decision (a READY
+ * process while a CPU is idle, or a CPU that has not settled into running
+ * its process yet), since the simulation state is not settled yet.
+ *
+ * skip_quiet_ticks() then applies those ticks in one step, printing the
+ * same Gantt lines the tick-by-tick loop would have printed.
+ *
+ * Both are called with simulator_mutex held.
+ */
+static unsigned int quiet_ticks(void)
+{
+    unsigned int ticks = UINT_MAX;
+    unsigned int ready, running, waiting;
+    const pcb_t *next;
+    unsigned int n;
+
+    count_process_states(&ready, &running, &waiting);
+
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        pcb_t *pcb = sim->simulator_cpu_data[n].current;
+        int timer = sim->simulator_cpu_data[n].preemption_timer;
+        unsigned int burst;
+
+        if (pcb == NULL)
+            continue;
+
+        /* The CPU thread has not settled into running this process yet */
+        if (sim->simulator_cpu_data[n].state != CPU_RUNNING || pcb->pc->type != OP_CPU)
+            return 0;
+
+        /* A burst that is used up moves to the next op this tick */
+        burst = (pcb->pc->time > 0) ? pcb->pc->time + pcb->migration_ticks : 0;
+        if (burst < ticks)
+            ticks = burst;
 
-        processes_created++;
+        /* The timer expires on the tick that decrements it to zero */
+        if (timer > 0 && (unsigned int)(timer - 1) < ticks)
+            ticks = (unsigned int)(timer - 1);
     }
+
+    if (ready > 0 && running < sim->cpu_count)
+        return 0;
+
+    for (n=0; n<sim->io_device_count; n++)
+    {
+        io_device_t *device = &sim->io_devices[n];
+        unsigned int c;
+
+        for (c=0; c<device->config.channels; c++)
+        {
+            io_request *r = device->in_service[c];
+
+            /* A free channel with a request waiting starts it this tick */
+            if (r == NULL && device->head != NULL)
+                return 0;
+            if (r != NULL && r->execution_time + r->remote_ticks < ticks)
+                ticks = r->execution_time + r->remote_ticks;
+        }
+    }
+
+    next = next_arrival();
+    if (next != NULL)
+    {
+        unsigned int arrival = next->arrival_time;
+
+        if (arrival <= sim->simulator_time)
+            return 0;
+        if (arrival - sim->simulator_time < ticks)
+            ticks = arrival - sim->simulator_time;
+    }
+
+    /* Nothing at all is pending; step normally rather than jump forever */
+    if (ticks == UINT_MAX)
+        return 0;
+
+    /* Land on the checkpoint's tick rather than jump over it */
+    if (sim->checkpoint_due && sim->simulator_options.checkpoint_at > sim->simulator_time &&
+        sim->simulator_options.checkpoint_at - sim->simulator_time < ticks)
+        ticks = sim->simulator_options.checkpoint_at - sim->simulator_time;
+
+    return ticks;
 }
 
+static void skip_quiet_ticks(unsigned int ticks)
+{
+    unsigned int n;
+
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        pcb_t *pcb = sim->simulator_cpu_data[n].current;
+        unsigned int warm_up, run;
+
+        if (pcb == NULL)
+            continue;
+
+        /* The caches warm up first, then the burst goes on */
+        warm_up = (pcb->migration_ticks < ticks) ? pcb->migration_ticks : ticks;
+        run = ticks - warm_up;
+        pcb->migration_ticks -= warm_up;
+        if (run > 0)
+        {
+            pcb->pc->time -= run;
+            pcb->time_in_CPU_burst = pcb->pc->time + 1;
+            pcb->total_time_remaining -= run;
+            pcb->burst_ticks += run;
+        }
+        if (pcb->weight != 0)
+            pcb->vruntime += vruntime_delta(pcb) * ticks;
+        sim->simulator_cpu_data[n].preemption_timer -= (int)ticks;
+    }
 
+    for (n=0; n<sim->io_device_count; n++)
+    {
+        io_device_t *device = &sim->io_devices[n];
+        unsigned int c;
 
-/* Cheap hack -- passing an int through a void pointer */
+        for (c=0; c<device->config.channels; c++)
+        {
+            io_request *r = device->in_service[c];
+            unsigned int remote, service;
+
+            if (r == NULL)
+                continue;
+            remote = (r->remote_ticks < ticks) ? r->remote_ticks : ticks;
+            service = ticks - remote;
+            r->remote_ticks -= remote;
+            r->execution_time -= service;
+            r->pcb->total_time_remaining -= service;
+        }
+    }
+
+    /* The current tick's line is already printed */
+    for (n=1; n<ticks; n++)
+    {
+        sim->simulator_time++;
+        print_gantt_line();
+    }
+    sim->simulator_time++;
+    publish_clock();
+}
+
+
+
+/*
+ * write_checkpoint() and restore_checkpoint() implement checkpoints, see
+ * checkpoint.h.
+ *
+ * write_checkpoint() writes the state of the simulation at the start of
+ * the current tick, before its Gantt line, and then the scheduler's.  It
+ * is called by the supervisor with simulator_mutex held.
+ *
+ * restore_checkpoint() reads it all back into a simulation that has been
+ * set up but not started, and moves the stream past the processes created
+ * before the checkpoint, so the supervisor loop carries on from that tick
+ * as if it had got there itself.
+ *
+ * Both exit if the checkpoint cannot be written or read.  The header and
+ * each process slot are written by a pair of helpers, one for each
+ * direction.
+ */
+static void write_checkpoint_header(checkpoint_t *checkpoint)
+{
+    unsigned int n;
+
+    checkpoint_write_u32(checkpoint, sim->cpu_count);
+    checkpoint_write_u32(checkpoint, sim->topology.sockets);
+    checkpoint_write_u32(checkpoint, sim->topology.cores);
+    checkpoint_write_u32(checkpoint, sim->topology.threads);
+    checkpoint_write_u32(checkpoint, sim->io_device_count);
+    for (n=0; n<sim->io_device_count; n++)
+        checkpoint_write_u32(checkpoint, sim->io_devices[n].config.channels);
+}
+
+static void check_checkpoint_header(checkpoint_t *checkpoint)
+{
+    unsigned int n;
+
+    checkpoint_expect_u32(checkpoint, sim->cpu_count, "checkpoint has another number of CPUs");
+    checkpoint_expect_u32(checkpoint, sim->topology.sockets, "checkpoint has another topology");
+    checkpoint_expect_u32(checkpoint, sim->topology.cores, "checkpoint has another topology");
+    checkpoint_expect_u32(checkpoint, sim->topology.threads, "checkpoint has another topology");
+    checkpoint_expect_u32(checkpoint, sim->io_device_count,
+        "checkpoint has another number of I/O devices");
+    for (n=0; n<sim->io_device_count; n++)
+        checkpoint_expect_u32(checkpoint, sim->io_devices[n].config.channels,
+            "checkpoint has I/O devices with other channels");
+}
+
+/*
+ * A live slot holds a process with its name, what is left of its ops, the
+ * fields of its PCB and its accounting; a free one only says so.
+ */
+static void write_slot(checkpoint_t *checkpoint, const process_slot_t *slot)
+{
+    const pcb_t *pcb = &slot->pcb;
+    unsigned int length = 1, name_length;
+
+    checkpoint_write_u32(checkpoint, slot->live);
+    if (!slot->live)
+        return;
+
+    while (slot->ops[length - 1].type != OP_TERMINATE)
+        length++;
+    name_length = (unsigned int)strlen(pcb->name);
+    checkpoint_write_u32(checkpoint, slot->admitted);
+    checkpoint_write_u32(checkpoint, pcb->pid);
+    checkpoint_write_u32(checkpoint, name_length);
+    checkpoint_write(checkpoint, pcb->name, name_length);
+    checkpoint_write_u32(checkpoint, length);
+    checkpoint_write(checkpoint, slot->ops, sizeof(op_t) * length);
+
+    checkpoint_write_u32(checkpoint, pcb->time_in_CPU_burst);
+    checkpoint_write_u32(checkpoint, pcb->priority);
+    checkpoint_write_u32(checkpoint, (unsigned int)pcb->state);
+    checkpoint_write_u32(checkpoint, (unsigned int)(pcb->pc - slot->ops));
+    checkpoint_write_u32(checkpoint, pcb->enqueue_time);
+    checkpoint_write_u32(checkpoint, pcb->arrival_time);
+    checkpoint_write_u32(checkpoint, pcb->total_time_remaining);
+    checkpoint_write_u32(checkpoint, pcb->level);
+    checkpoint_write_u32(checkpoint, pcb->level_period);
+    checkpoint_write_u64(checkpoint, pcb->vruntime);
+    checkpoint_write_u32(checkpoint, pcb->weight);
+    checkpoint_write_u32(checkpoint, (unsigned int)pcb->last_cpu);
+    checkpoint_write_u32(checkpoint, pcb->migration_ticks);
+    checkpoint_write_u32(checkpoint, pcb->burst_estimate);
+    checkpoint_write_u32(checkpoint, pcb->burst_ticks);
+    checkpoint_write(checkpoint, &slot->stats, sizeof(process_stats_t));
+}
+
+static void read_slot(checkpoint_t *checkpoint, process_slot_t *slot)
+{
+    unsigned int length, name_length, pid, pc;
+
+    slot->live = (checkpoint_read_u32(checkpoint) != 0);
+    if (!slot->live || checkpoint->failed)
+    {
+        slot->live = false;
+        slot->pcb.state = PROCESS_TERMINATED;
+        return;
+    }
+
+    slot->admitted = checkpoint_read_u32(checkpoint);
+    if (slot->admitted >= sim->processes_created)
+        checkpoint_fail(checkpoint, "checkpoint has a process that was never created");
+    pid = checkpoint_read_u32(checkpoint);
+    name_length = checkpoint_read_u32(checkpoint);
+    slot->name_capacity = (size_t)name_length + 1;
+    slot->name = malloc(slot->name_capacity);
+    assert(slot->name != NULL);
+    checkpoint_read(checkpoint, slot->name, name_length);
+    slot->name[name_length] = '\0';
+    length = checkpoint_read_u32(checkpoint);
+    if (length == 0)
+        checkpoint_fail(checkpoint, "checkpoint has a process without ops");
+    if (checkpoint->failed)
+        length = 1;
+    slot->op_capacity = length;
+    slot->ops = malloc(sizeof(op_t) * length);
+    assert(slot->ops != NULL);
+    checkpoint_read(checkpoint, slot->ops, sizeof(op_t) * length);
+    slot->ops[length - 1].type = OP_TERMINATE;
+
+    /* pcb_t has a const pid, so the PCB is filled in with memcpy */
+    pcb_t pcb = {
+        .pid = pid,
+        .name = slot->name,
+        .pc = slot->ops,
+        .next = NULL
+    };
+    pcb.time_in_CPU_burst = checkpoint_read_u32(checkpoint);
+    pcb.priority = checkpoint_read_u32(checkpoint);
+    pcb.state = (process_state_t)checkpoint_read_u32(checkpoint);
+    pc = checkpoint_read_u32(checkpoint);
+    if (pc >= length)
+        checkpoint_fail(checkpoint, "checkpoint has a pc past the end of the ops");
+    else
+        pcb.pc = &slot->ops[pc];
+    pcb.enqueue_time = checkpoint_read_u32(checkpoint);
+    pcb.arrival_time = checkpoint_read_u32(checkpoint);
+    pcb.total_time_remaining = checkpoint_read_u32(checkpoint);
+    pcb.level = checkpoint_read_u32(checkpoint);
+    pcb.level_period = checkpoint_read_u32(checkpoint);
+    pcb.vruntime = checkpoint_read_u64(checkpoint);
+    pcb.weight = checkpoint_read_u32(checkpoint);
+    pcb.last_cpu = (int)checkpoint_read_u32(checkpoint);
+    pcb.migration_ticks = checkpoint_read_u32(checkpoint);
+    pcb.burst_estimate = checkpoint_read_u32(checkpoint);
+    pcb.burst_ticks = checkpoint_read_u32(checkpoint);
+    memcpy(&slot->pcb, &pcb, sizeof(pcb_t));
+    checkpoint_read(checkpoint, &slot->stats, sizeof(process_stats_t));
+}
+
+static void write_checkpoint(void)
+{
+    checkpoint_t checkpoint;
+    io_request *r;
+    unsigned int n, c;
+
+    if (!checkpoint_create(&checkpoint, sim->simulator_options.checkpoint_path))
+        exit(-1);
+    write_checkpoint_header(&checkpoint);
+
+    checkpoint_write_u32(&checkpoint, sim->simulator_time);
+    checkpoint_write_u32(&checkpoint, sim->clock_epoch);
+    checkpoint_write_u32(&checkpoint, sim->processes_created);
+    checkpoint_write_u32(&checkpoint, sim->processes_terminated);
+    checkpoint_write_u64(&checkpoint, sim->fingerprint);
+    checkpoint_write_u32(&checkpoint, sim->ready_counter);
+    checkpoint_write_u32(&checkpoint, sim->running_counter);
+    checkpoint_write_u32(&checkpoint, sim->waiting_counter);
+    checkpoint_write_u32(&checkpoint, sim->context_switches);
+
+    /* The process slots, and the histograms of the processes gone */
+    checkpoint_write_u32(&checkpoint, sim->slot_count);
+    for (n=0; n<sim->slot_count; n++)
+        write_slot(&checkpoint, slot_of(simulator_process(n)));
+    checkpoint_write(&checkpoint, &sim->response_histogram, sizeof(histogram_t));
+    checkpoint_write(&checkpoint, &sim->ready_wait_histogram, sizeof(histogram_t));
+    checkpoint_write(&checkpoint, &sim->turnaround_histogram, sizeof(histogram_t));
+    checkpoint_write(&checkpoint, &sim->preemption_histogram, sizeof(histogram_t));
+
+    /* The CPUs, and the counters of every CPU and the supervisor */
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        checkpoint_write_pcb(&checkpoint, sim->simulator_cpu_data[n].current);
+        checkpoint_write_u32(&checkpoint, (unsigned int)sim->simulator_cpu_data[n].state);
+        checkpoint_write_u32(&checkpoint, (unsigned int)sim->simulator_cpu_data[n].preemption_timer);
+    }
+    for (n=0; n<=sim->cpu_count; n++)
+    {
+        checkpoint_write(&checkpoint, &sim->cpu_slots[n].counters, sizeof(simulator_cpu_counters_t));
+        checkpoint_write_u32(&checkpoint, sim->cpu_slots[n].busy_since);
+    }
+
+    /* The I/O devices: the waiting requests in order, then each channel */
+    for (n=0; n<sim->io_device_count; n++)
+    {
+        io_device_t *device = &sim->io_devices[n];
+        unsigned int waiting = 0;
+
+        for (r = device->head; r != NULL; r = r->next)
+            waiting++;
+        checkpoint_write_u32(&checkpoint, waiting);
+        for (r = device->head; r != NULL; r = r->next)
+        {
+            checkpoint_write_pcb(&checkpoint, r->pcb);
+            checkpoint_write_u32(&checkpoint, r->execution_time);
+            checkpoint_write_u32(&checkpoint, r->remote_ticks);
+        }
+        for (c=0; c<device->config.channels; c++)
+        {
+            r = device->in_service[c];
+            checkpoint_write_pcb(&checkpoint, r != NULL ? r->pcb : NULL);
+            checkpoint_write_u32(&checkpoint, r != NULL ? r->execution_time : 0);
+            checkpoint_write_u32(&checkpoint, r != NULL ? r->remote_ticks : 0);
+        }
+    }
+
+    scheduler_checkpoint(&checkpoint);
+    if (!checkpoint_close(&checkpoint))
+        exit(-1);
+}
+
+/* read_io_request() reads a request into the slot of the process it is for */
+static io_request *read_io_request(checkpoint_t *checkpoint)
+{
+    pcb_t *pcb = checkpoint_read_pcb(checkpoint);
+    unsigned int execution_time = checkpoint_read_u32(checkpoint);
+    unsigned int remote_ticks = checkpoint_read_u32(checkpoint);
+    io_request *r;
+
+    if (pcb == NULL)
+        return NULL;
+    r = &slot_of(pcb)->io;
+    r->pcb = pcb;
+    r->execution_time = execution_time;
+    r->remote_ticks = remote_ticks;
+    r->next = NULL;
+    sim->io_requests++;
+    return r;
+}
+
+/*
+ * skip_created() moves the stream past the processes created before a
+ * checkpoint, and checks that they are the ones it was made with.
+ */
+static void skip_created(checkpoint_t *checkpoint, unsigned long long fingerprint)
+{
+    unsigned int n;
+
+    for (n=0; n<sim->processes_created && !checkpoint->failed; n++)
+    {
+        const pcb_t *next = next_arrival();
+
+        if (next == NULL)
+        {
+            checkpoint_fail(checkpoint, "checkpoint has more processes than the workload");
+            return;
+        }
+        sim->fingerprint = workload_fingerprint(sim->fingerprint, next);
+        workload_stream_next(sim->stream);
+    }
+    if (sim->fingerprint != fingerprint)
+        checkpoint_fail(checkpoint, "checkpoint has another workload");
+}
+
+static void restore_checkpoint(void)
+{
+    checkpoint_t checkpoint;
+    unsigned long long fingerprint;
+    unsigned int n, c, slots;
+
+    if (!checkpoint_open(&checkpoint, sim->simulator_options.restore_path))
+        exit(-1);
+    check_checkpoint_header(&checkpoint);
+
+    sim->simulator_time = checkpoint_read_u32(&checkpoint);
+    sim->ticks_sampled = sim->simulator_time;
+    sim->clock_epoch = checkpoint_read_u32(&checkpoint);
+    sim->processes_created = checkpoint_read_u32(&checkpoint);
+    sim->processes_terminated = checkpoint_read_u32(&checkpoint);
+    fingerprint = checkpoint_read_u64(&checkpoint);
+    sim->ready_counter = checkpoint_read_u32(&checkpoint);
+    sim->running_counter = checkpoint_read_u32(&checkpoint);
+    sim->waiting_counter = checkpoint_read_u32(&checkpoint);
+    sim->context_switches = checkpoint_read_u32(&checkpoint);
+    if (sim->processes_terminated > sim->processes_created)
+        checkpoint_fail(&checkpoint, "checkpoint has more processes terminated than created");
+    skip_created(&checkpoint, fingerprint);
+    __atomic_store_n(&sim->clock,
+        (unsigned long long)sim->clock_epoch << 32 | sim->simulator_time, __ATOMIC_RELEASE);
+
+    /* Free slots only go on the free list once they all exist */
+    slots = checkpoint_read_u32(&checkpoint);
+    if (slots > sim->processes_created)
+        checkpoint_fail(&checkpoint, "checkpoint has more process slots than processes");
+    for (n=0; n<slots && !checkpoint.failed; n++)
+        read_slot(&checkpoint, take_slot());
+    for (n=sim->slot_count; n>0; n--)
+    {
+        process_slot_t *slot = slot_of(simulator_process(n - 1));
+
+        if (!slot->live)
+        {
+            slot->next_free = sim->free_slots;
+            sim->free_slots = slot;
+        }
+    }
+    checkpoint_read(&checkpoint, &sim->response_histogram, sizeof(histogram_t));
+    checkpoint_read(&checkpoint, &sim->ready_wait_histogram, sizeof(histogram_t));
+    checkpoint_read(&checkpoint, &sim->turnaround_histogram, sizeof(histogram_t));
+    checkpoint_read(&checkpoint, &sim->preemption_histogram, sizeof(histogram_t));
+
+    for (n=0; n<sim->cpu_count; n++)
+    {
+        sim->simulator_cpu_data[n].current = checkpoint_read_pcb(&checkpoint);
+        sim->simulator_cpu_data[n].state = (simulator_cpu_state_t)checkpoint_read_u32(&checkpoint);
+        sim->simulator_cpu_data[n].preemption_timer = (int)checkpoint_read_u32(&checkpoint);
+        if (sim->simulator_cpu_data[n].current != NULL)
+            cpumask_set(&sim->busy_cpus, n);
+    }
+    for (n=0; n<=sim->cpu_count; n++)
+    {
+        checkpoint_read(&checkpoint, &sim->cpu_slots[n].counters, sizeof(simulator_cpu_counters_t));
+        sim->cpu_slots[n].busy_since = checkpoint_read_u32(&checkpoint);
+    }
+
+    for (n=0; n<sim->io_device_count; n++)
+    {
+        io_device_t *device = &sim->io_devices[n];
+        unsigned int waiting = checkpoint_read_u32(&checkpoint);
+
+        if (waiting > sim->slot_count)
+            checkpoint_fail(&checkpoint, "checkpoint has more I/O requests than processes");
+        for (c=0; c<waiting && !checkpoint.failed; c++)
+        {
+            io_request *r = read_io_request(&checkpoint);
+
+            if (r != NULL)
+                append_io_request(device, r);
+        }
+        for (c=0; c<device->config.channels; c++)
+            device->in_service[c] = read_io_request(&checkpoint);
+    }
+
+    scheduler_restore(&checkpoint);
+    if (!checkpoint_close(&checkpoint))
+        exit(-1);
+}
+
+/* Each CPU thread is passed its simulator_cpu_data_t */
 static void *simulator_cpu_thread_func(void *data)
 {
-    simulator_cpu_thread((unsigned int)(uintptr_t)data);
+    simulator_cpu_data_t *cpu = data;
+
+    sim = cpu->sim;
+    trace_ring = sim->tracing ? &sim->trace.rings[cpu->cpu_id + 1] : NULL;
+    thread_slot = &sim->cpu_slots[cpu->cpu_id];
+    simulator_cpu_thread(cpu->cpu_id);
+    return NULL;
+}
+
+/* simulator_metrics_thread_func() is the live metrics exporter's thread */
+static void *simulator_metrics_thread_func(void *data)
+{
+    sim = data;
+    trace_ring = NULL;
+    thread_slot = NULL;
+    metrics_run(&sim->metrics);
     return NULL;
 }
 
@@ -630,11 +2227,262 @@ extern void mt_safe_usleep(long usec)
     while (nanosleep(&ts, &ts) != 0);
 }
 
-/* get_current_time() returns the current simulation time and is thread-safe */
+/* simulator_is_inline() reports whether the inline engine is running */
+extern bool simulator_is_inline(void)
+{
+    return sim->simulator_options.engine == ENGINE_INLINE;
+}
+
+/* simulator_scheduler_data() returns the scheduler state of this simulation */
+extern void *simulator_scheduler_data(void)
+{
+    return sim->scheduler_data;
+}
+
+/* The processes of this simulation by index; see os-sim.h */
+extern unsigned int simulator_process_count(void)
+{
+    return sim->slot_count;
+}
+
+extern pcb_t *simulator_process(unsigned int index)
+{
+    assert(index < sim->slot_count);
+    return &sim->slot_chunks[index / SLOT_CHUNK_SIZE][index % SLOT_CHUNK_SIZE].pcb;
+}
+
+extern unsigned int simulator_process_index(const pcb_t *pcb)
+{
+    return slot_of(pcb)->index;
+}
+
+/*
+ * trace_event() records an event in this thread's trace ring, if the
+ * simulation is being traced.  The time is the tick being simulated.
+ */
+static void trace_event(trace_event_t type, unsigned int cpu_id, const pcb_t *pcb,
+                        unsigned int arg)
+{
+    trace_record_t record;
+
+    if (trace_ring == NULL)
+        return;
+
+    record.time = get_current_time();
+    record.type = (uint16_t)type;
+    record.cpu = (uint16_t)cpu_id;
+    record.pid = (pcb != NULL) ? pcb->pid : TRACE_NONE_PID;
+    record.arg = arg;
+    trace_emit(trace_ring, &record);
+}
+
+/*
+ * trace_state() records a process moving from one state to another.  The
+ * states are the ones each event moves a process between (wake_up() makes
+ * a process READY, a preemption makes it READY again, and so on), which the
+ * simulator knows without reading the PCB while its scheduler may be
+ * writing it.
+ */
+static void trace_state(unsigned int cpu_id, const pcb_t *pcb,
+                        process_state_t from, process_state_t to)
+{
+    trace_event(TRACE_STATE, cpu_id, pcb, (unsigned int)from << 16 | (unsigned int)to);
+}
+
+/* trace_cpu_event() records the state change of a preempt, yield or terminate */
+static void trace_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event)
+{
+    process_state_t to = (event == CPU_YIELD) ? PROCESS_WAITING :
+                         (event == CPU_TERMINATE) ? PROCESS_TERMINATED : PROCESS_READY;
+
+    trace_state(cpu_id, sim->simulator_cpu_data[cpu_id].current, PROCESS_RUNNING, to);
+}
+
+/*
+ * account_ready() notes the time a process becomes READY, and
+ * account_cpu_event() updates the accounting of a CPU's process for a
+ * preempt, yield or terminate.  On terminate the process's figures go into
+ * the histograms.  A process that leaves the CPU drops any migration
+ * warm-up it has left, so that it is only ever set while the process runs
+ * and the scheduler can count on it being 0 until context_switch().  Both
+ * are called with simulator_mutex held.
+ */
+static void account_ready(const pcb_t *pcb)
+{
+    slot_of(pcb)->stats.ready_since = sim->ticks_sampled;
+}
+
+static void account_cpu_event(unsigned int cpu_id, simulator_cpu_state_t event)
+{
+    pcb_t *pcb = sim->simulator_cpu_data[cpu_id].current;
+    process_stats_t *ps = &slot_of(pcb)->stats;
+    unsigned int now = get_current_time();
+
+    switch (event)
+    {
+    case CPU_PREEMPT:
+        ps->preemptions++;
+        ps->ready_since = sim->ticks_sampled;
+        break;
+
+    case CPU_TERMINATE:
+        histogram_add(&sim->response_histogram, ps->first_run - pcb->arrival_time);
+        histogram_add(&sim->ready_wait_histogram, ps->ready_time);
+        histogram_add(&sim->turnaround_histogram, now - pcb->arrival_time);
+        histogram_add(&sim->preemption_histogram, ps->preemptions);
+        break;
+
+    default:
+        break;
+    }
+    pcb->migration_ticks = 0;
+}
+
+/* monotonic_ns() returns the wall-clock time, in nanoseconds */
+static unsigned long long monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + (unsigned long long)now.tv_nsec;
+}
+
+/* count_add() adds to a counter in a cpu_slots[] entry */
+static void count_add(unsigned long long *counter, unsigned long long value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+/*
+ * account_busy() adds the ticks a CPU has been busy to its counters, when it
+ * is given a process or goes idle.  It is called with simulator_mutex held,
+ * so busy_since has no other writer.
+ */
+static void account_busy(unsigned int cpu_id, bool busy)
+{
+    simulator_cpu_slot_t *slot = &sim->cpu_slots[cpu_id];
+    unsigned int now = get_current_time();
+
+    if (slot->busy_since != UINT_MAX)
+        count_add(&slot->counters.busy_ticks, now - slot->busy_since);
+    __atomic_store_n(&slot->busy_since, busy ? now : UINT_MAX, __ATOMIC_RELAXED);
+}
+
+/*
+ * snapshot_slot() reads the counters of cpu_slots[slot], with the ticks of
+ * a CPU that is busy right now counted up to the current time.
+ */
+static void snapshot_slot(unsigned int slot, simulator_cpu_counters_t *counters)
+{
+    const simulator_cpu_slot_t *from = &sim->cpu_slots[slot];
+    unsigned int now = get_current_time();
+    unsigned int since = __atomic_load_n(&from->busy_since, __ATOMIC_RELAXED);
+    unsigned int c;
+
+    counters->busy_ticks = __atomic_load_n(&from->counters.busy_ticks, __ATOMIC_RELAXED);
+    if (since != UINT_MAX && now > since)
+        counters->busy_ticks += now - since;
+    counters->idle_ticks = 0;
+    if (slot < sim->cpu_count && now > counters->busy_ticks)
+        counters->idle_ticks = now - counters->busy_ticks;
+
+    counters->context_switches =
+        __atomic_load_n(&from->counters.context_switches, __ATOMIC_RELAXED);
+    counters->forced_preemptions =
+        __atomic_load_n(&from->counters.forced_preemptions, __ATOMIC_RELAXED);
+    counters->timer_preemptions =
+        __atomic_load_n(&from->counters.timer_preemptions, __ATOMIC_RELAXED);
+    counters->migrations = __atomic_load_n(&from->counters.migrations, __ATOMIC_RELAXED);
+    counters->remote_migrations =
+        __atomic_load_n(&from->counters.remote_migrations, __ATOMIC_RELAXED);
+    counters->remote_io = __atomic_load_n(&from->counters.remote_io, __ATOMIC_RELAXED);
+    for (c=0; c<SIM_CALLBACK_COUNT; c++)
+    {
+        counters->callback_calls[c] =
+            __atomic_load_n(&from->counters.callback_calls[c], __ATOMIC_RELAXED);
+        counters->callback_ns[c] =
+            __atomic_load_n(&from->counters.callback_ns[c], __ATOMIC_RELAXED);
+    }
+    counters->parked_ns = __atomic_load_n(&from->counters.parked_ns, __ATOMIC_RELAXED);
+    for (c=0; c<SIM_LOCK_COUNT; c++)
+    {
+        counters->lock_waits[c] =
+            __atomic_load_n(&from->counters.lock_waits[c], __ATOMIC_RELAXED);
+        counters->lock_wait_ns[c] =
+            __atomic_load_n(&from->counters.lock_wait_ns[c], __ATOMIC_RELAXED);
+    }
+}
+
+/* simulator_counters() takes a snapshot of every CPU's counters; see os-sim.h */
+extern unsigned int simulator_counters(simulator_cpu_counters_t *counters,
+                                       unsigned int max)
+{
+    unsigned int n;
+
+    for (n=0; n<=sim->cpu_count && n<max; n++)
+        snapshot_slot(n, &counters[n]);
+    return sim->cpu_count + 1;
+}
+
+/* simulator_metrics() takes a snapshot of the simulation; see os-sim.h */
+extern void simulator_metrics(simulator_metrics_t *metrics)
+{
+    unsigned int in_service;
+
+    metrics->finished = __atomic_load_n(&sim->finished, __ATOMIC_ACQUIRE);
+    metrics->time = get_current_time();
+    metrics->ready = __atomic_load_n(&sim->gauges[GAUGE_READY], __ATOMIC_RELAXED);
+    metrics->running = __atomic_load_n(&sim->gauges[GAUGE_RUNNING], __ATOMIC_RELAXED);
+    metrics->waiting = __atomic_load_n(&sim->gauges[GAUGE_WAITING], __ATOMIC_RELAXED);
+    in_service = __atomic_load_n(&sim->gauges[GAUGE_IO_IN_SERVICE], __ATOMIC_RELAXED);
+    metrics->io_in_service = in_service;
+    metrics->io_queued = metrics->waiting > in_service ? metrics->waiting - in_service : 0;
+    metrics->created = __atomic_load_n(&sim->gauges[GAUGE_CREATED], __ATOMIC_RELAXED);
+    metrics->terminated = __atomic_load_n(&sim->gauges[GAUGE_TERMINATED], __ATOMIC_RELAXED);
+    histogram_snapshot(&sim->response_histogram, &metrics->response);
+    histogram_snapshot(&sim->ready_wait_histogram, &metrics->ready_wait);
+    histogram_snapshot(&sim->turnaround_histogram, &metrics->turnaround);
+    histogram_snapshot(&sim->preemption_histogram, &metrics->preemptions);
+}
+
+/* simulator_lock_wait() charges a scheduler lock wait to the calling thread */
+extern void simulator_lock_wait(simulator_lock_t lock, unsigned long long ns)
+{
+    count_add(&thread_slot->counters.lock_waits[lock], 1);
+    count_add(&thread_slot->counters.lock_wait_ns[lock], ns);
+}
+
+/* simulator_idle_parked() charges time parked in idle() to the calling thread */
+extern void simulator_idle_parked(unsigned long long ns)
+{
+    count_add(&thread_slot->counters.parked_ns, ns);
+}
+
+/*
+ * publish_clock() makes the supervisor's simulator_time visible to the
+ * scheduler, as one step of the clock.  The time and the epoch share one
+ * 64-bit word, so a reader always sees a matching pair.  Only the supervisor
+ * writes the clock.
+ */
+static void publish_clock(void)
+{
+    sim->clock_epoch++;
+    __atomic_store_n(&sim->clock,
+        (unsigned long long)sim->clock_epoch << 32 | sim->simulator_time,
+        __ATOMIC_RELEASE);
+}
+
+/* get_current_time() returns the current simulation time and is lock-free */
 extern unsigned int get_current_time(void)
 {
-    pthread_mutex_lock(&simulator_mutex);
-    unsigned int time = simulator_time;
-    pthread_mutex_unlock(&simulator_mutex);
-    return time;
+    return (unsigned int)__atomic_load_n(&sim->clock, __ATOMIC_ACQUIRE);
+}
+
+/* get_tick_epoch() returns the current time and clock epoch together */
+extern simulator_tick_t get_tick_epoch(void)
+{
+    unsigned long long clock = __atomic_load_n(&sim->clock, __ATOMIC_ACQUIRE);
+    simulator_tick_t tick = { (unsigned int)clock, (unsigned int)(clock >> 32) };
+
+    return tick;
 }
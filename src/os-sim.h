@@ -8,6 +8,13 @@
 
 #pragma once
 
+#include <stdbool.h>
+
+#include "cpumask.h"
+#include "histogram.h"
+#include "rbtree.h"
+#include "topology.h"
+
 /*
  * The process_state_t enum contains the possible states for a process.
  *
@@ -28,10 +35,16 @@ typedef enum
     OP_TERMINATE
 } op_type;
 
+/*
+ * An op of a process: a CPU or I/O burst of time ticks, or the end of the
+ * process.  device picks the I/O device an OP_IO burst goes to, modulo the
+ * number of devices; it is unused for other ops.
+ */
 typedef struct
 {
     op_type type;
     unsigned int time;
+    unsigned int device;
 } op_t;
 
 /*
@@ -55,6 +68,40 @@ typedef struct
  *        is used by the priority aging algorithm.
  * 
  *   total_time_remaining: The total amount of CPU and IO time left for this process
+ *
+ *   level, level_period : The MLFQ level of the process, and the boost
+ *        period it was set in.  Used by the MLFQ scheduler.
+ *
+ *   run_node : The node of the process in a CFS ready queue.
+ *
+ *   vruntime : The virtual runtime of the process.  The simulator adds
+ *        PCB_VRUNTIME_TICK * PCB_NICE_0_WEIGHT / weight for every tick the
+ *        process runs, so a heavier process gains vruntime more slowly.
+ *
+ *   weight : The CFS weight of the process, set by the scheduler.  A
+ *        process with weight 0 gains no vruntime.
+ *
+ *   last_cpu : The CPU the process last ran on, or -1 if it has not run
+ *        yet.  Set by the simulator in context_switch().
+ *
+ *   migration_ticks : Ticks the process still has to spend warming up the
+ *        caches of the CPU it has moved to, before its burst goes on.
+ *        Set by the simulator in context_switch() when a process starts
+ *        running on a CPU other than last_cpu, and 0 while it is not
+ *        running.
+ *
+ *   affinity : The CPUs the process may run on, or NULL for any CPU.  Set
+ *        by the scheduler.
+ *
+ *   burst_estimate : An exponential average of the lengths of the CPU
+ *        bursts the process has completed, in 1/PCB_BURST_SCALE ticks, or 0
+ *        before it has completed one.  Each burst moves it halfway from its
+ *        old value to the burst's length.  Set by the simulator, and used
+ *        by the adaptive RR scheduler.
+ *
+ *   burst_ticks : The ticks the process has run of its current CPU burst,
+ *        across preemptions (cache warm-up ticks are not counted).  Set by
+ *        the simulator.
  */
 typedef struct _pcb_t
 {
@@ -68,13 +115,338 @@ typedef struct _pcb_t
     unsigned int enqueue_time;
     unsigned int arrival_time; // The time at which an applicaiton is launched (Also when the process first enters the ready queue)
     unsigned int total_time_remaining;
+    unsigned int level;
+    unsigned int level_period;
+    rb_node_t run_node;
+    unsigned long long vruntime;
+    unsigned int weight;
+    int last_cpu;
+    unsigned int migration_ticks;
+    const cpumask_t *affinity;
+    unsigned int burst_estimate;
+    unsigned int burst_ticks;
 } pcb_t;
 
+/* The vruntime of one tick at the weight of a nice 0 process */
+#define PCB_VRUNTIME_TICK 1024ull
+#define PCB_NICE_0_WEIGHT 1024u
+
+/* The fraction of a tick burst_estimate counts in */
+#define PCB_BURST_SCALE 16u
+
+/*
+ * The simulation engine.
+ *
+ *   ENGINE_THREADS : one pthread per CPU, woken by the supervisor thread for
+ *                    each scheduler event.
+ *   ENGINE_INLINE  : every scheduler callback is called directly on the
+ *                    supervisor thread, in a fixed order, so runs are
+ *                    deterministic and there is no thread handoff per event.
+ *   ENGINE_BATCHED : CPU threads as with ENGINE_THREADS, but the supervisor
+ *                    first collects the preempt, yield and terminate events
+ *                    of every CPU in a tick, then wakes all of those CPUs at
+ *                    once and waits for the whole batch, so the callbacks
+ *                    for different CPUs run in parallel.
+ */
+typedef enum
+{
+    ENGINE_THREADS = 0,
+    ENGINE_INLINE,
+    ENGINE_BATCHED
+} simulator_engine_t;
+
+/*
+ * How the supervisor paces ticks against the wall clock.
+ *
+ *   PACE_DEFAULT     : no pacing, but with CPU threads the supervisor naps
+ *                      for a moment after each tick to let them run.
+ *   PACE_REALTIME    : one tick takes 100ms of wall-clock time.
+ *   PACE_SCALED      : one tick takes 100ms / pace_scale, so pace_scale is
+ *                      how many times faster than real time to run.
+ *   PACE_UNTHROTTLED : no sleeping at all, so no system call per tick.
+ *
+ * Real-time and scaled pacing sleep until an absolute deadline worked out
+ * from the start of the run, so the time spent simulating a tick does not
+ * add up into drift.  A fast-forward jump is paced as the ticks it covers.
+ */
+typedef enum
+{
+    PACE_DEFAULT = 0,
+    PACE_REALTIME,
+    PACE_SCALED,
+    PACE_UNTHROTTLED
+} pacing_mode_t;
+
 /*
- * start_simulator() runs the OS simulation.  The number of CPUs (1-16) is
- * passed as the parameter.
+ * How the Gantt chart is printed.  The final statistics are printed the same
+ * way in every mode.
+ *
+ *   GANTT_FULL     : one line per tick.
+ *   GANTT_OFF      : no Gantt chart at all.
+ *   GANTT_CHANGES  : run-length compressed: a line only on the ticks where
+ *                    some CPU starts running a different process (or goes
+ *                    idle); the lines in between would repeat the CPUs.
+ *   GANTT_BUFFERED : one line per tick, formatted into a large buffer in
+ *                    memory and written out by a thread of its own, so the
+ *                    supervisor never waits for stdout.
  */
-extern void start_simulator(unsigned int cpu_count);
+typedef enum
+{
+    GANTT_FULL = 0,
+    GANTT_OFF,
+    GANTT_CHANGES,
+    GANTT_BUFFERED
+} gantt_mode_t;
+
+/*
+ * An I/O device services up to channels requests at once, each taking the
+ * time of its I/O burst.  Waiting requests are started in the order given
+ * by discipline:
+ *
+ *   IO_FIFO           : the order they were submitted in
+ *   IO_SHORTEST_FIRST : the shortest I/O burst first, like SSTF on a disk
+ *
+ * node is the NUMA node the device is attached to.
+ */
+typedef enum
+{
+    IO_FIFO = 0,
+    IO_SHORTEST_FIRST
+} io_discipline_t;
+
+typedef struct
+{
+    io_discipline_t discipline;
+    unsigned int channels;
+    unsigned int node;
+} io_device_config_t;
+
+/*
+ * Simulator options
+ *
+ *   engine : which simulation engine to use.
+ *
+ *   fast_forward : When set, the supervisor works out how many upcoming ticks
+ *                  contain no event (no burst completion, preemption timer
+ *                  expiry, I/O completion or process arrival) and jumps
+ *                  simulator_time over them instead of stepping one tick at
+ *                  a time.  The Gantt chart and statistics are unchanged.
+ *
+ *   quiet : Print nothing; the results are only returned through
+ *           simulator_stats_t.  Used when many simulations run at once.
+ *
+ *   gantt : How the Gantt chart is printed, unless quiet is set.
+ *
+ *   workload : The processes to simulate, in arrival order, or NULL for
+ *              the built-in processes[] table (see workload.h).  The
+ *              simulator works on its own copy of each process, taken when
+ *              it is created on the tick given by its arrival_time, and
+ *              every process that arrives by a tick is created in it.
+ *
+ *   workload_stream : When set, the processes are taken from this stream
+ *              instead of workload, each one read as it arrives, so their
+ *              number need not be known up front (see workload.h).  The
+ *              simulation ends once the stream runs out and every process
+ *              created has terminated; a stream that fails part way
+ *              through ends the program.  The caller closes the stream.
+ *
+ *   io_devices, io_device_count : The I/O devices.  With no devices the
+ *              simulator has a single IO_FIFO device with one channel.
+ *
+ *   pacing, pace_scale : How ticks are paced against the wall clock; see
+ *              pacing_mode_t.  pace_scale is only used by PACE_SCALED.
+ *
+ *   trace_path : When set, every scheduling event is recorded in a binary
+ *              trace file at this path (see trace.h).
+ *
+ *   migration_cost : The ticks a process spends on a CPU other than the
+ *              one it last ran on before its burst goes on, standing in
+ *              for the cold caches.  The ticks use up its time slice.
+ *              SMT threads of one core share its caches, so moving
+ *              between them costs nothing.
+ *
+ *   topology : The sockets, cores and SMT threads of the machine, which
+ *              must have cpu_count CPUs, or sockets == 0 for a flat one.
+ *              Each socket is a NUMA node.
+ *
+ *   remote_cost : The extra ticks of moving to a CPU on another node, on
+ *              top of migration_cost, and of an I/O burst on a device
+ *              attached to another node than the CPU that submits it.
+ *
+ *   checkpoint_path, checkpoint_at : When checkpoint_path is set, the whole
+ *              state of the simulation is written there at the start of
+ *              tick checkpoint_at, and the simulation goes on (see
+ *              checkpoint.h).  Fast-forward never jumps over that tick.
+ *
+ *   restore_path : When set, the simulation starts from the checkpoint at
+ *              this path instead of tick 0.  The workload, CPUs, topology,
+ *              I/O devices and scheduler must be the ones it was made
+ *              with; the rest of the options may differ.
+ *
+ *   metrics_path, metrics_interval_ms : When metrics_path is set, a
+ *              snapshot of the running simulation is written there every
+ *              metrics_interval_ms of wall-clock time, or
+ *              METRICS_DEFAULT_INTERVAL_MS when it is 0, and once more when
+ *              it ends (see metrics.h).
+ *
+ * Checkpoints need ENGINE_INLINE, the only engine whose state is settled
+ * between ticks; with CPU threads a callback may be part way through.
+ */
+typedef struct _workload_t workload_t;
+typedef struct _workload_stream_t workload_stream_t;
+
+typedef struct
+{
+    simulator_engine_t engine;
+    bool fast_forward;
+    bool quiet;
+    gantt_mode_t gantt;
+    const workload_t *workload;
+    workload_stream_t *workload_stream;
+    const io_device_config_t *io_devices;
+    unsigned int io_device_count;
+    pacing_mode_t pacing;
+    double pace_scale;
+    const char *trace_path;
+    unsigned int migration_cost;
+    cpu_topology_t topology;
+    unsigned int remote_cost;
+    const char *checkpoint_path;
+    unsigned int checkpoint_at;
+    const char *restore_path;
+    const char *metrics_path;
+    unsigned int metrics_interval_ms;
+} simulator_options_t;
+
+/*
+ * Per-CPU counters, kept by the simulator for each CPU and for the
+ * supervisor thread, which runs wake_up().  They tell the simulated CPUs'
+ * use of their time apart from the real cost of the simulator and the
+ * scheduler.
+ *
+ *         busy_ticks : ticks the CPU had a process
+ *         idle_ticks : ticks it had none
+ *   context_switches : context_switch() calls for the CPU
+ * forced_preemptions : processes force_preempt() took off the CPU
+ *  timer_preemptions : processes preempted when their time slice ran out
+ *         migrations : processes that started running on the CPU after
+ *                      last running on another one
+ *  remote_migrations : the migrations that came from another node
+ *          remote_io : I/O bursts submitted to a device on another node
+ *     callback_calls : scheduler callbacks run for the CPU, by callback
+ *        callback_ns : wall-clock nanoseconds spent in them, less the
+ *                      time spent parked
+ *          parked_ns : wall-clock nanoseconds the CPU's thread spent parked
+ *                      in idle() waiting for work
+ *         lock_waits : times a thread had to wait for a scheduler lock
+ *       lock_wait_ns : wall-clock nanoseconds spent waiting
+ *
+ * The lock counters belong to the thread that waited: a CPU's own thread,
+ * or the supervisor for wake_up() and for every callback of the inline
+ * engine.  The supervisor has no ticks of its own.
+ */
+typedef enum
+{
+    SIM_CALLBACK_IDLE = 0,
+    SIM_CALLBACK_PREEMPT,
+    SIM_CALLBACK_YIELD,
+    SIM_CALLBACK_TERMINATE,
+    SIM_CALLBACK_WAKE_UP,
+    SIM_CALLBACK_COUNT
+} simulator_callback_t;
+
+/* The scheduler locks: the ready queue(s), and current[] */
+typedef enum
+{
+    SIM_LOCK_QUEUE = 0,
+    SIM_LOCK_CURRENT,
+    SIM_LOCK_COUNT
+} simulator_lock_t;
+
+typedef struct
+{
+    unsigned long long busy_ticks;
+    unsigned long long idle_ticks;
+    unsigned long long context_switches;
+    unsigned long long forced_preemptions;
+    unsigned long long timer_preemptions;
+    unsigned long long migrations;
+    unsigned long long remote_migrations;
+    unsigned long long remote_io;
+    unsigned long long callback_calls[SIM_CALLBACK_COUNT];
+    unsigned long long callback_ns[SIM_CALLBACK_COUNT];
+    unsigned long long parked_ns;
+    unsigned long long lock_waits[SIM_LOCK_COUNT];
+    unsigned long long lock_wait_ns[SIM_LOCK_COUNT];
+} simulator_cpu_counters_t;
+
+/*
+ * The results of one simulation.  Times are in ticks; ready_time,
+ * running_time and waiting_time add up the number of processes in each
+ * state over every tick.
+ *
+ * The rest summarize every process, taken when it terminates:
+ *
+ *     response : from its arrival_time to when it first ran
+ *   ready_wait : the total time it spent in the ready queue
+ *   turnaround : from its arrival_time to when it terminated
+ *  preemptions : the number of times it was preempted
+ *
+ * counters is the sum of the counters of every CPU and the supervisor.
+ */
+typedef struct
+{
+    unsigned int context_switches;
+    unsigned int execution_time;
+    unsigned int ready_time;
+    unsigned int running_time;
+    unsigned int waiting_time;
+    histogram_summary_t response;
+    histogram_summary_t ready_wait;
+    histogram_summary_t turnaround;
+    histogram_summary_t preemptions;
+    simulator_cpu_counters_t counters;
+} simulator_stats_t;
+
+/*
+ * Each simulation keeps all of its state in a simulator_t, so that several
+ * can run in one process on different threads.
+ */
+typedef struct simulator simulator_t;
+
+/*
+ * start_simulator() runs an OS simulation to completion.
+ *
+ *        cpu_count : the number of CPUs (1 or more)
+ *          options : the simulator options, or NULL for the defaults
+ *   scheduler_data : the scheduler's state for this simulation, handed back
+ *                    by simulator_scheduler_data() on any of its threads
+ *            stats : filled in with the results, unless NULL
+ */
+extern void start_simulator(unsigned int cpu_count,
+                            const simulator_options_t *options,
+                            void *scheduler_data, simulator_stats_t *stats);
+
+/*
+ * simulator_scheduler_data() returns the scheduler_data pointer of the
+ * simulation that the calling thread belongs to.
+ */
+extern void *simulator_scheduler_data(void);
+
+/*
+ * The processes of the simulation that the calling thread belongs to, for
+ * a scheduler writing or reading a checkpoint.  Each process created gets
+ * an indexed slot of its own, which terminated processes hand on to later
+ * ones, so the indexes cover the processes that are live and the free
+ * slots, whose PCBs are PROCESS_TERMINATED.
+ *
+ * simulator_process_count() returns the number of slots.
+ * simulator_process() returns the PCB in the slot at index.
+ * simulator_process_index() returns the index of a PCB's slot.
+ */
+extern unsigned int simulator_process_count(void);
+extern pcb_t *simulator_process(unsigned int index);
+extern unsigned int simulator_process_index(const pcb_t *pcb);
 
 /*
  * context_switch() schedules a process on a CPU.  Note that it is
@@ -103,7 +475,87 @@ extern void force_preempt(unsigned int cpu_id);
 extern void mt_safe_usleep(long usec);
 
 /*
- * get_current_time() returns the current simulator time.  This function
- * is thread-safe.
+ * simulator_is_inline() returns true when the inline engine is running.  The
+ * scheduler callbacks then all run on one thread, so idle() must return
+ * instead of blocking when there is nothing to schedule.
+ */
+extern bool simulator_is_inline(void);
+
+/*
+ * The simulator clock.  Only the supervisor moves the clock, and it
+ * publishes each new time with a release store, so reading it is lock-free
+ * and never waits for the supervisor to finish a tick.
+ *
+ * get_current_time() returns the current simulator time, in ticks.
+ *
+ * get_tick_epoch() returns the time together with the clock's epoch, which
+ * goes up by one every time the clock moves: once per simulated tick, and
+ * once for a whole jump over quiet ticks in fast-forward mode.  Within one
+ * epoch the time and everything derived from it are fixed, so a scheduler
+ * can cache such values and tag them with the epoch they were computed in.
  */
+typedef struct {
+    unsigned int time;
+    unsigned int epoch;
+} simulator_tick_t;
+
 extern unsigned int get_current_time(void);
+extern simulator_tick_t get_tick_epoch(void);
+
+/*
+ * simulator_counters() takes a snapshot of the per-CPU counters of the
+ * simulation the calling thread belongs to, while it runs.  It takes no
+ * lock: each counter is read atomically, but they are not all read at the
+ * same instant.
+ *
+ *   counters : filled in with CPU 0 to cpu_count - 1, then the supervisor
+ *        max : the number of entries counters has room for
+ *
+ * @return cpu_count + 1, the number of entries there are
+ */
+extern unsigned int simulator_counters(simulator_cpu_counters_t *counters,
+                                       unsigned int max);
+
+/*
+ * The state of a running simulation, for exporting metrics while it runs
+ * (see metrics.h).
+ *
+ *                    time : the current tick
+ * ready, running, waiting : the processes in each state, as counted for the
+ *                           last Gantt line
+ *               io_queued : I/O requests waiting for a channel
+ *           io_in_service : I/O requests being serviced
+ *     created, terminated : the processes created and terminated so far
+ *   response, ready_wait, : the histograms behind simulator_stats_t, of the
+ * turnaround, preemptions   processes terminated so far
+ *                finished : the simulation has ended
+ *
+ * simulator_metrics() fills one in for the simulation the calling thread
+ * belongs to.  Like simulator_counters() it takes no lock: the supervisor
+ * publishes the counts with atomic stores once a tick, and the histograms
+ * are read with histogram_snapshot().  So the fields are each up to date,
+ * but not necessarily all from the same tick.
+ */
+typedef struct
+{
+    unsigned int time;
+    unsigned int ready, running, waiting;
+    unsigned int io_queued, io_in_service;
+    unsigned int created, terminated;
+    histogram_t response, ready_wait, turnaround, preemptions;
+    bool finished;
+} simulator_metrics_t;
+
+extern void simulator_metrics(simulator_metrics_t *metrics);
+
+/*
+ * simulator_lock_wait() is how the scheduler reports time the calling
+ * thread spent waiting for one of its locks.
+ */
+extern void simulator_lock_wait(simulator_lock_t lock, unsigned long long ns);
+
+/*
+ * simulator_idle_parked() is how idle() reports time the calling thread
+ * spent parked waiting for work.
+ */
+extern void simulator_idle_parked(unsigned long long ns);
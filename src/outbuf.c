@@ -0,0 +1,144 @@
+/*
+ * outbuf.c
+ *
+ * A double-buffered writer with a thread that does the writing.
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "outbuf.h"
+
+/**
+ * outbuf_thread() writes out each buffer it is handed, until the writer is
+ * closed and nothing is left.
+ */
+static void *outbuf_thread(void *data)
+{
+    outbuf_t *out = data;
+
+    pthread_mutex_lock(&out->mutex);
+    while (1) {
+        while (!out->busy && !out->closing)
+            pthread_cond_wait(&out->cond, &out->mutex);
+        if (!out->busy)
+            break;
+
+        pthread_mutex_unlock(&out->mutex);
+        fwrite(out->pending, 1, out->pending_used, out->file);
+        fflush(out->file);
+        pthread_mutex_lock(&out->mutex);
+
+        out->busy = false;
+        pthread_cond_broadcast(&out->cond);
+    }
+    pthread_mutex_unlock(&out->mutex);
+    return NULL;
+}
+
+/**
+ * outbuf_handoff() gives the filled buffer to the writer thread and takes
+ * the empty one, once the writer is done with it.
+ */
+static void outbuf_handoff(outbuf_t *out)
+{
+    char *buffer;
+    size_t size;
+
+    pthread_mutex_lock(&out->mutex);
+    while (out->busy)
+        pthread_cond_wait(&out->cond, &out->mutex);
+
+    buffer = out->pending;
+    size = out->pending_size;
+    out->pending = out->buffer;
+    out->pending_size = out->size;
+    out->pending_used = out->used;
+    out->buffer = buffer;
+    out->size = size;
+    out->used = 0;
+
+    out->busy = true;
+    pthread_cond_broadcast(&out->cond);
+    pthread_mutex_unlock(&out->mutex);
+}
+
+/**
+ * outbuf_init() starts a writer for file with two buffers of size bytes.
+ */
+void outbuf_init(outbuf_t *out, FILE *file, size_t size)
+{
+    out->file = file;
+    out->size = out->pending_size = size;
+    out->used = out->pending_used = 0;
+    out->buffer = malloc(size);
+    out->pending = malloc(size);
+    assert(out->buffer != NULL && out->pending != NULL);
+    out->busy = false;
+    out->closing = false;
+    pthread_mutex_init(&out->mutex, NULL);
+    pthread_cond_init(&out->cond, NULL);
+    pthread_create(&out->thread, NULL, outbuf_thread, out);
+}
+
+/**
+ * outbuf_vprintf() formats text into the buffer, handing the buffer to the
+ * writer first if the text does not fit.  Text longer than a whole buffer
+ * grows it.
+ */
+void outbuf_vprintf(outbuf_t *out, const char *format, va_list args)
+{
+    va_list copy;
+    int length;
+
+    while (1) {
+        va_copy(copy, args);
+        length = vsnprintf(out->buffer + out->used, out->size - out->used, format, copy);
+        va_end(copy);
+        assert(length >= 0);
+
+        if ((size_t)length < out->size - out->used) {
+            out->used += (size_t)length;
+            return;
+        }
+
+        if (out->used > 0) {
+            outbuf_handoff(out);
+        } else {
+            out->size = (size_t)length + 1;
+            out->buffer = realloc(out->buffer, out->size);
+            assert(out->buffer != NULL);
+        }
+    }
+}
+
+void outbuf_printf(outbuf_t *out, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    outbuf_vprintf(out, format, args);
+    va_end(args);
+}
+
+/**
+ * outbuf_close() writes out everything that is buffered, stops the writer
+ * thread and frees the buffers.  The file is left open.
+ */
+void outbuf_close(outbuf_t *out)
+{
+    if (out->used > 0)
+        outbuf_handoff(out);
+
+    pthread_mutex_lock(&out->mutex);
+    out->closing = true;
+    pthread_cond_broadcast(&out->cond);
+    pthread_mutex_unlock(&out->mutex);
+    pthread_join(out->thread, NULL);
+
+    pthread_mutex_destroy(&out->mutex);
+    pthread_cond_destroy(&out->cond);
+    free(out->buffer);
+    free(out->pending);
+}
@@ -0,0 +1,38 @@
+/*
+ * outbuf.h
+ *
+ * A buffered writer whose writes happen on a thread of its own.  Text is
+ * formatted into a large user-space buffer; when the buffer is full it is
+ * handed to the writer thread, which writes it out while a second buffer is
+ * filled.  So the thread producing the output never waits for the file
+ * unless it gets a whole buffer ahead.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef struct
+{
+    FILE *file;
+    char *buffer;            /* being filled by outbuf_printf() */
+    size_t used, size;
+    char *pending;           /* being written by the writer thread */
+    size_t pending_used, pending_size;
+    bool busy;               /* pending holds data not yet written */
+    bool closing;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} outbuf_t;
+
+/* Output buffer function declarations */
+void outbuf_init(outbuf_t *out, FILE *file, size_t size);
+void outbuf_printf(outbuf_t *out, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+void outbuf_vprintf(outbuf_t *out, const char *format, va_list args)
+    __attribute__((format(printf, 2, 0)));
+void outbuf_close(outbuf_t *out);
@@ -15,211 +15,213 @@
  * Note: The operations must alternate: OP_CPU, OP_IO, OP_CPU, ...
  * In addition, the first and last operations must be OP_CPU.  Otherwise,
  * the simulator will not work.
+ *
+ * Each op is {type, time, I/O device}; all of these use I/O device 0.
  */
 
 static op_t pid0_ops[] = {
-    {OP_CPU, 2},
-    {OP_IO, 2},
-    {OP_CPU, 3},
-    {OP_IO, 5},
-    {OP_CPU, 1},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 2},
-    {OP_CPU, 3},
-    {OP_IO, 5},
-    {OP_CPU, 1},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 2},
-    {OP_CPU, 3},
-    {OP_IO, 5},
-    {OP_CPU, 1},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 5},
-    {OP_CPU, 1},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 2},
-    {OP_CPU, 3},
-    {OP_IO, 5},
-    {OP_CPU, 1},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 2, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 3, 0},
+    {OP_IO, 5, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 3, 0},
+    {OP_IO, 5, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 3, 0},
+    {OP_IO, 5, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 5, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 3, 0},
+    {OP_IO, 5, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_TERMINATE, 0, 0}};
 
 static op_t pid1_ops[] = {
-    {OP_CPU, 3},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 6},
-    {OP_CPU, 1},
-    {OP_IO, 3},
-    {OP_CPU, 4},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 6},
-    {OP_CPU, 1},
-    {OP_IO, 3},
-    {OP_CPU, 4},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 6},
-    {OP_CPU, 1},
-    {OP_IO, 3},
-    {OP_CPU, 4},
-    {OP_IO, 3},
-    {OP_CPU, 4},
-    {OP_IO, 4},
-    {OP_CPU, 2},
-    {OP_IO, 6},
-    {OP_CPU, 1},
-    {OP_IO, 3},
-    {OP_CPU, 4},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 3, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 6, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 4, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 6, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 4, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 6, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 4, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 4, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 6, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 4, 0},
+    {OP_TERMINATE, 0, 0}};
 
 static op_t pid2_ops[] = {
-    {OP_CPU, 6},
-    {OP_IO, 12},
-    {OP_CPU, 3},
-    {OP_IO, 10},
-    {OP_CPU, 2},
-    {OP_IO, 15},
-    {OP_CPU, 5},
-    {OP_IO, 10},
-    {OP_CPU, 2},
-    {OP_IO, 4},
-    {OP_CPU, 1},
-    {OP_IO, 12},
-    {OP_CPU, 3},
-    {OP_IO, 15},
-    {OP_CPU, 2},
-    {OP_IO, 2},
-    {OP_CPU, 1},
-    {OP_IO, 6},
-    {OP_CPU, 1},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 6, 0},
+    {OP_IO, 12, 0},
+    {OP_CPU, 3, 0},
+    {OP_IO, 10, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 15, 0},
+    {OP_CPU, 5, 0},
+    {OP_IO, 10, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 12, 0},
+    {OP_CPU, 3, 0},
+    {OP_IO, 15, 0},
+    {OP_CPU, 2, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 1, 0},
+    {OP_IO, 6, 0},
+    {OP_CPU, 1, 0},
+    {OP_TERMINATE, 0, 0}};
 
 static op_t pid3_ops[] = {
-    {OP_CPU, 9},
-    {OP_IO, 1},
-    {OP_CPU, 6},
-    {OP_IO, 1},
-    {OP_CPU, 8},
-    {OP_IO, 1},
-    {OP_CPU, 7},
-    {OP_IO, 1},
-    {OP_CPU, 6},
-    {OP_IO, 1},
-    {OP_CPU, 8},
-    {OP_IO, 1},
-    {OP_CPU, 7},
-    {OP_IO, 1},
-    {OP_CPU, 6},
-    {OP_IO, 1},
-    {OP_CPU, 8},
-    {OP_IO, 1},
-    {OP_CPU, 8},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 9, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 6, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 8, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 7, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 6, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 8, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 7, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 6, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 8, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 8, 0},
+    {OP_TERMINATE, 0, 0}};
 
 static op_t pid4_ops[] = {
-    {OP_CPU, 10},
-    {OP_IO, 1},
-    {OP_CPU, 14},
-    {OP_IO, 1},
-    {OP_CPU, 7},
-    {OP_IO, 2},
-    {OP_CPU, 11},
-    {OP_IO, 1},
-    {OP_CPU, 14},
-    {OP_IO, 1},
-    {OP_CPU, 7},
-    {OP_IO, 2},
-    {OP_CPU, 11},
-    {OP_IO, 1},
-    {OP_CPU, 14},
-    {OP_IO, 1},
-    {OP_CPU, 7},
-    {OP_IO, 2},
-    {OP_CPU, 11},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 10, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 14, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 7, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 11, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 14, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 7, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 11, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 14, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 7, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 11, 0},
+    {OP_TERMINATE, 0, 0}};
 
 static op_t pid5_ops[] = {
-    {OP_CPU, 9},
-    {OP_IO, 1},
-    {OP_CPU, 10},
-    {OP_IO, 2},
-    {OP_CPU, 15},
-    {OP_IO, 1},
-    {OP_CPU, 8},
-    {OP_IO, 1},
-    {OP_CPU, 10},
-    {OP_IO, 2},
-    {OP_CPU, 15},
-    {OP_IO, 1},
-    {OP_CPU, 8},
-    {OP_IO, 1},
-    {OP_CPU, 10},
-    {OP_IO, 2},
-    {OP_CPU, 15},
-    {OP_IO, 1},
-    {OP_CPU, 8},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 9, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 10, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 15, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 8, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 10, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 15, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 8, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 10, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 15, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 8, 0},
+    {OP_TERMINATE, 0, 0}};
 
 static op_t pid6_ops[] = {
-    {OP_CPU, 6},
-    {OP_IO, 3},
-    {OP_CPU, 9},
-    {OP_IO, 1},
-    {OP_CPU, 14},
-    {OP_IO, 1},
-    {OP_CPU, 11},
-    {OP_IO, 3},
-    {OP_CPU, 9},
-    {OP_IO, 1},
-    {OP_CPU, 14},
-    {OP_IO, 1},
-    {OP_CPU, 11},
-    {OP_IO, 3},
-    {OP_CPU, 9},
-    {OP_IO, 1},
-    {OP_CPU, 14},
-    {OP_IO, 1},
-    {OP_CPU, 11},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 6, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 9, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 14, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 11, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 9, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 14, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 11, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 9, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 14, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 11, 0},
+    {OP_TERMINATE, 0, 0}};
 
 static op_t pid7_ops[] = {
-    {OP_CPU, 12},
-    {OP_IO, 3},
-    {OP_CPU, 10},
-    {OP_IO, 3},
-    {OP_CPU, 4},
-    {OP_IO, 1},
-    {OP_CPU, 5},
-    {OP_IO, 4},
-    {OP_CPU, 7},
-    {OP_IO, 4},
-    {OP_CPU, 15},
-    {OP_IO, 2},
-    {OP_CPU, 7},
-    {OP_IO, 1},
-    {OP_CPU, 20},
-    {OP_IO, 3},
-    {OP_CPU, 13},
-    {OP_IO, 5},
-    {OP_CPU, 5},
-    {OP_TERMINATE, 0}};
+    {OP_CPU, 12, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 10, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 4, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 5, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 7, 0},
+    {OP_IO, 4, 0},
+    {OP_CPU, 15, 0},
+    {OP_IO, 2, 0},
+    {OP_CPU, 7, 0},
+    {OP_IO, 1, 0},
+    {OP_CPU, 20, 0},
+    {OP_IO, 3, 0},
+    {OP_CPU, 13, 0},
+    {OP_IO, 5, 0},
+    {OP_CPU, 5, 0},
+    {OP_TERMINATE, 0, 0}};
 
 pcb_t processes[PROCESS_COUNT] = {
-    // {pid, name, time remaining, priority, state, *pc, *next, enqueue_time, arrival_time, total_time_remaining}
-    {0, "Iapache", 2, 1, PROCESS_NEW, pid0_ops, NULL, 0, 0, 82},
-    {1, "Ibash", 3, 2, PROCESS_NEW, pid1_ops, NULL, 0, 10, 90},
-    {2, "Imozilla", 1, 0, PROCESS_NEW, pid2_ops, NULL, 0, 20, 112},
-    {3, "Ccpu", 9, 3, PROCESS_NEW, pid3_ops, NULL, 0, 30, 82},
-    {4, "Cgcc", 10, 4, PROCESS_NEW, pid4_ops, NULL, 0, 40, 118},
-    {5, "Cspice", 9, 7, PROCESS_NEW, pid5_ops, NULL, 0, 50, 120},
-    {6, "Cmysql", 6, 6, PROCESS_NEW, pid6_ops, NULL, 0, 60, 123},
-    {7, "Csim", 6, 5, PROCESS_NEW, pid7_ops, NULL, 0, 70, 124}
+    // {pid, name, time remaining, priority, state, *pc, *next, enqueue_time, arrival_time, total_time_remaining, level, level_period, run_node, vruntime, weight, last_cpu, migration_ticks, *affinity, burst_estimate, burst_ticks}
+    {0, "Iapache", 2, 1, PROCESS_NEW, pid0_ops, NULL, 0, 0, 82, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0},
+    {1, "Ibash", 3, 2, PROCESS_NEW, pid1_ops, NULL, 0, 10, 90, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0},
+    {2, "Imozilla", 1, 0, PROCESS_NEW, pid2_ops, NULL, 0, 20, 112, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0},
+    {3, "Ccpu", 9, 3, PROCESS_NEW, pid3_ops, NULL, 0, 30, 82, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0},
+    {4, "Cgcc", 10, 4, PROCESS_NEW, pid4_ops, NULL, 0, 40, 118, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0},
+    {5, "Cspice", 9, 7, PROCESS_NEW, pid5_ops, NULL, 0, 50, 120, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0},
+    {6, "Cmysql", 6, 6, PROCESS_NEW, pid6_ops, NULL, 0, 60, 123, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0},
+    {7, "Csim", 6, 5, PROCESS_NEW, pid7_ops, NULL, 0, 70, 124, 0, 0, {NULL, NULL, NULL, false}, 0, 0, 0, 0, NULL, 0, 0}
     
     };
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "os-sim.h"
 
 #define PROCESS_COUNT 8
 extern pcb_t processes[PROCESS_COUNT];
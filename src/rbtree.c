@@ -0,0 +1,280 @@
+/*
+ * rbtree.c
+ *
+ * An intrusive red-black tree, ordered by a caller supplied comparison,
+ * with the leftmost node cached.
+ */
+
+#include "rbtree.h"
+
+void rb_init(rb_tree_t *tree, rb_order_t before)
+{
+    tree->root = NULL;
+    tree->leftmost = NULL;
+    tree->before = before;
+}
+
+static bool is_red(const rb_node_t *node)
+{
+    return node != NULL && node->red;
+}
+
+/**
+ * replace_child() makes new_child the child of parent that old_child was,
+ * or the root if old_child was the root.
+ */
+static void replace_child(rb_tree_t *tree, rb_node_t *parent, rb_node_t *old_child,
+                          rb_node_t *new_child)
+{
+    if (parent == NULL)
+        tree->root = new_child;
+    else if (parent->left == old_child)
+        parent->left = new_child;
+    else
+        parent->right = new_child;
+    if (new_child != NULL)
+        new_child->parent = parent;
+}
+
+/**
+ * rotate_left() / rotate_right() rotate the subtree at node, moving its
+ * right (left) child up into its place.
+ */
+static void rotate_left(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t *child = node->right;
+
+    node->right = child->left;
+    if (child->left != NULL)
+        child->left->parent = node;
+    replace_child(tree, node->parent, node, child);
+    child->left = node;
+    node->parent = child;
+}
+
+static void rotate_right(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t *child = node->left;
+
+    node->left = child->right;
+    if (child->right != NULL)
+        child->right->parent = node;
+    replace_child(tree, node->parent, node, child);
+    child->right = node;
+    node->parent = child;
+}
+
+/**
+ * insert_fixup() restores the red-black properties after a red node is
+ * linked in as a leaf.
+ */
+static void insert_fixup(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t *parent, *grandparent, *uncle;
+
+    while (is_red(parent = node->parent)) {
+        grandparent = parent->parent;
+
+        if (parent == grandparent->left) {
+            uncle = grandparent->right;
+            if (is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                grandparent->red = true;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rotate_left(tree, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_right(tree, grandparent);
+        } else {
+            uncle = grandparent->left;
+            if (is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                grandparent->red = true;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rotate_right(tree, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            grandparent->red = true;
+            rotate_left(tree, grandparent);
+        }
+    }
+    tree->root->red = false;
+}
+
+/**
+ * rb_insert() links a node into the tree, after any nodes that compare
+ * equal to it.
+ */
+void rb_insert(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t **link = &tree->root;
+    rb_node_t *parent = NULL;
+    bool leftmost = true;
+
+    while (*link != NULL) {
+        parent = *link;
+        if (tree->before(node, parent)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = parent;
+    node->red = true;
+    *link = node;
+    if (leftmost)
+        tree->leftmost = node;
+
+    insert_fixup(tree, node);
+}
+
+/**
+ * erase_fixup() restores the red-black properties after a black node is
+ * unlinked, leaving node (possibly NULL), a child of parent, one black
+ * node short.
+ */
+static void erase_fixup(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent)
+{
+    rb_node_t *sibling;
+
+    while (node != tree->root && !is_red(node)) {
+        if (node == parent->left) {
+            sibling = parent->right;
+            if (is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_left(tree, parent);
+                sibling = parent->right;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rotate_right(tree, sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rotate_left(tree, parent);
+        } else {
+            sibling = parent->left;
+            if (is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rotate_right(tree, parent);
+                sibling = parent->left;
+            }
+            if (!is_red(sibling->left) && !is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rotate_left(tree, sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rotate_right(tree, parent);
+        }
+        node = tree->root;
+    }
+    if (node != NULL)
+        node->red = false;
+}
+
+/**
+ * rb_erase() unlinks a node from the tree.
+ */
+void rb_erase(rb_tree_t *tree, rb_node_t *node)
+{
+    rb_node_t *child, *parent;
+    bool removed_red;
+
+    if (tree->leftmost == node)
+        tree->leftmost = rb_next(node);
+
+    if (node->left == NULL || node->right == NULL) {
+        /* At most one child, which takes the node's place */
+        child = (node->left != NULL) ? node->left : node->right;
+        parent = node->parent;
+        removed_red = node->red;
+        replace_child(tree, parent, node, child);
+    } else {
+        /* Two children: the successor, which has no left child, moves up */
+        rb_node_t *successor = node->right;
+
+        while (successor->left != NULL)
+            successor = successor->left;
+
+        child = successor->right;
+        removed_red = successor->red;
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            replace_child(tree, parent, successor, child);
+            successor->right = node->right;
+            successor->right->parent = successor;
+        }
+        replace_child(tree, node->parent, node, successor);
+        successor->left = node->left;
+        successor->left->parent = successor;
+        successor->red = node->red;
+    }
+
+    if (!removed_red)
+        erase_fixup(tree, child, parent);
+}
+
+rb_node_t *rb_first(const rb_tree_t *tree)
+{
+    return tree->leftmost;
+}
+
+/**
+ * rb_next() returns the node after node in order, or NULL if it is the
+ * last one.
+ */
+rb_node_t *rb_next(const rb_node_t *node)
+{
+    const rb_node_t *parent;
+
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL)
+            node = node->left;
+        return (rb_node_t *)(uintptr_t)node;
+    }
+
+    while ((parent = node->parent) != NULL && node == parent->right)
+        node = parent;
+    return (rb_node_t *)(uintptr_t)parent;
+}
@@ -0,0 +1,46 @@
+/*
+ * rbtree.h
+ *
+ * An intrusive red-black tree.  The nodes are embedded in the structures
+ * being ordered, so inserting and erasing never allocate.  The leftmost
+ * node is cached, so the first node in order is found in O(1), and insert
+ * and erase are O(log n).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct _rb_node_t
+{
+    struct _rb_node_t *left;
+    struct _rb_node_t *right;
+    struct _rb_node_t *parent;
+    bool red;
+} rb_node_t;
+
+/*
+ * An rb_order_t returns true if node a comes before node b.  Nodes that
+ * compare equal are kept in the order they were inserted.
+ */
+typedef bool (*rb_order_t)(const rb_node_t *a, const rb_node_t *b);
+
+typedef struct
+{
+    rb_node_t *root;
+    rb_node_t *leftmost;
+    rb_order_t before;
+} rb_tree_t;
+
+/* rb_entry() returns the structure of the given type an rb_node_t is in */
+#define rb_entry(node, type, member) \
+    ((type *)((uintptr_t)(node) - offsetof(type, member)))
+
+/* Red-black tree function declarations */
+void rb_init(rb_tree_t *tree, rb_order_t before);
+void rb_insert(rb_tree_t *tree, rb_node_t *node);
+void rb_erase(rb_tree_t *tree, rb_node_t *node);
+rb_node_t *rb_first(const rb_tree_t *tree);
+rb_node_t *rb_next(const rb_node_t *node);
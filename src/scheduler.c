@@ -10,9 +10,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <float.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "bench.h"
+#include "cpumask.h"
+#include "generator.h"
+#include "process.h"
 #include "scheduler.h"
+#include "sweep.h"
+#include "workload.h"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -24,8 +31,6 @@ extern void yield(unsigned int cpu_id);
 extern void terminate(unsigned int cpu_id);
 extern void wake_up(pcb_t *process);
 
-static unsigned int cpu_count;
-
 /*
  * current[] is an array of pointers to the currently running processes.
  * There is one array element corresponding to each CPU in the simulation.
@@ -34,31 +39,145 @@ static unsigned int cpu_count;
  * on a CPU. Since the current[] array is accessed by multiple threads, it
  * needs to use a mutex to protect it (current_mutex).
  *
- * rq is a pointer to a struct used for the ready queue.
- * The head of the queue corresponds to the process
+ * rq[] is an array of shared ready queues, one per NUMA node of topology,
+ * so a flat machine has just the one.
+ * The head of a queue corresponds to the process
  * that is about to be scheduled onto the CPU, and the tail is for
- * convenience in the enqueue function.
+ * convenience in the enqueue function.  For FCFS, PA and SRTF the ready
+ * queue is backed by a heap ordered on arrival_time, priority_key() and
+ * total_time_remaining, so schedule() picks the next process in O(log n)
+ * rather than scanning rq.  None of these change while a process waits, so
+ * each is read once, when the process is queued, and kept in its heap node.
  *
- * Similar to current[], rq is accessed by multiple threads,
- * so a mutex is used to protect it (ready_mutex).
+ * Similar to current[], rq[] is accessed by multiple threads, so each
+ * queue has a mutex to protect it.  Its nr_queued mirrors the number of
+ * processes in it and is read without the mutex.  A CPU takes from the
+ * queue of its own node, and only when that is empty from the busiest
+ * other node.  wake_up() queues a process on the node it last ran on,
+ * unless only another node has an idle CPU.
  *
- * The condition variable queue_not_empty is used
- * in conditional waits and signals.
+ * A CPU with nothing to run parks in idle() on its own cpu_rq[] condition
+ * variable, with its bit set in parked_cpus.  A waker claims one parked CPU
+ * by atomically clearing its bit and then wakes only that CPU, handing it
+ * the woken process directly when possible, so there is no thundering herd
+ * and the parked CPU does not have to take a queue lock to get its process.
+ * A CPU on the node the process last ran on is claimed first.
  *
  * The scheduler_algorithm variable and sched_algorithm_t enum help
  * keep track of the scheduler's current scheduling algorithm.
+ *
+ * When per_cpu_queues is set (--per-cpu-queues), rq is unused.  Instead each
+ * CPU owns the queue in its entry of cpu_rq[], with its own lock.
+ * wake_up() places processes on a CPU chosen by select_target_cpu(), and a
+ * CPU whose own queue is empty steals from the busiest peer, looking on its
+ * own node first.
+ *
+ * idle_cpus and running_max are kept in step with current[] under
+ * current_mutex.  idle_cpus has a bit set for every CPU with no process, and
+ * running_max (PA and SRTF only) is a max-heap of the busy CPUs keyed by
+ * running_key(), so wake_up() finds an idle CPU or its preemption victim
+ * without scanning current[].
+ *
+ * For MLFQ, the ready queue is levels[] instead, a FIFO queue per level
+ * with level 0 the highest, shared by every node and protected by the
+ * mutex of rq[0].
+ * level_mask has bit l set while levels[l] is not empty, so the next
+ * process comes from the level of the lowest set bit, found with one
+ * count-trailing-zeros instruction however many levels there are.  Every
+ * boost_ticks the levels are spliced onto level 0 in order, which is
+ * O(levels); a PCB's own level is then out of date, and mlfq_level() reads
+ * it as 0 because the boost period it was set in is over.
+ *
+ * For CFS, each rq[] (or cpu_rq[]) queue is a red-black tree ordered on
+ * vruntime, with its leftmost process cached, so the next process is found
+ * in O(1).  The simulator adds to the vruntime of each running process
+ * every tick, weighted by the process's CFS weight.  Instead of a fixed
+ * time slice, each process runs for its share of time_slice, the target
+ * latency: time_slice * weight / (weight + load), where load is the weight
+ * queued for the CPU.  min_vruntime is the vruntime of the last process
+ * dispatched, never going backwards; a new process starts there, and one
+ * waking from I/O is moved up to no less than half a target latency behind
+ * it, so that neither can starve everything else while it catches up.
+ *
+ * ARR is adaptive RR: a FIFO ready queue like RR, but each process gets a
+ * time slice of its own from its burst_estimate, which the simulator keeps
+ * as an exponential average of the CPU bursts it has completed; see
+ * arr_quantum().
+ *
+ * With per-CPU queues, a process may have an affinity mask, from the first
+ * entry of affinity[] that matches its pid.  wake_up() only hands it to,
+ * places it on or preempts a CPU in its mask, and it waits in the pinned
+ * queue of its CPU, so it is never stolen.  With cache_affinity, a woken
+ * process goes back to the CPU it last ran on if that CPU is parked or
+ * idle, or no busier than any other CPU it could go to.
+ *
+ * All of this lives in a scheduler_t, one per simulation, made by
+ * scheduler_create().
+ */
+typedef struct {
+    unsigned int first_pid;
+    unsigned int last_pid;
+    cpumask_t mask;
+} affinity_t;
+
+struct scheduler {
+    pcb_t **current;
+    node_rq_t *rq;                 /* one per node */
+    cpu_rq_t *cpu_rq;
+    bool per_cpu_queues;
+    cpumask_t idle_cpus;
+    cpu_heap_t running_max;
+    cpumask_t parked_cpus;
+    queue_t *levels;
+    unsigned long long level_mask;
+    unsigned int level_count;
+    unsigned int boost_ticks;      /* 0 for no boosts */
+    unsigned int boost_period;     /* the boost period levels[] is in */
+    unsigned long long min_vruntime;
+    bool cache_affinity;
+    affinity_t *affinity;
+    unsigned int affinity_count;
+
+    pthread_mutex_t current_mutex;
+
+    sched_algorithm_t scheduler_algorithm;
+    unsigned int cpu_count;
+    cpu_topology_t topology;
+    unsigned int node_count;
+    unsigned int node_cpus;        /* CPUs per node */
+    unsigned int age_weight;
+    unsigned int time_slice;
+};
+
+/*
+ * sched is the scheduler of the simulation that the calling thread is
+ * working for.  Every entry point from the simulator sets it from
+ * simulator_scheduler_data() before doing anything else.
+ */
+static __thread scheduler_t *sched;
+
+/**
+ * lock_counted() takes one of the scheduler's locks.  If it is held by
+ * another thread, the time spent waiting for it is reported to the
+ * simulator; taking a free lock costs no more than it did.
+ *
+ * @param mutex the lock to take
+ * @param lock which of the scheduler's locks it is
  */
-static pcb_t **current;
-static queue_t *rq;
+static void lock_counted(pthread_mutex_t *mutex, simulator_lock_t lock)
+{
+    struct timespec start, end;
 
-static pthread_mutex_t current_mutex;
-static pthread_mutex_t queue_mutex;
-static pthread_cond_t queue_not_empty;
+    if (pthread_mutex_trylock(mutex) == 0) {
+        return;
+    }
 
-static sched_algorithm_t scheduler_algorithm;
-static unsigned int cpu_count;
-static unsigned int age_weight;
-static unsigned int time_slice;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_mutex_lock(mutex);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    simulator_lock_wait(lock, (unsigned long long)(end.tv_sec - start.tv_sec) * 1000000000ull +
+                              (unsigned long long)end.tv_nsec - (unsigned long long)start.tv_nsec);
+}
 
 /**
  * priority_with_age() is a helper function to calculate the priority of a process
@@ -72,21 +191,116 @@ static unsigned int time_slice;
  * 
  */
 extern double priority_with_age(unsigned int current_time, pcb_t *process) {
-    return process->priority - (current_time - process->enqueue_time) * age_weight;
+    const scheduler_t *scheduler = simulator_scheduler_data();
+
+    return (double)process->priority -
+           (double)(current_time - process->enqueue_time) * scheduler->age_weight;
 }
 
 /**
- * enqueue() is a helper function to add a process to the ready queue.
+ * priority_key() is the time-invariant form of priority_with_age().
+ *
+ * Every waiting process ages at the same rate, so for any fixed current time
+ * ordering processes by priority_with_age() is the same as ordering them by
+ * Priority + Enqueue Time * Age Weight.  That key never changes while a
+ * process is queued, so the PA ready queue can be a heap and aging costs
+ * nothing per tick.
+ *
+ * @param process process that we need the key for
+ */
+static unsigned long long priority_key(const pcb_t *process)
+{
+    return process->priority +
+           (unsigned long long)process->enqueue_time * sched->age_weight;
+}
+
+/**
+ * pa_key() orders the PA ready queue by aged priority, breaking ties by
+ * arrival time.
+ */
+static heap_key_t pa_key(const pcb_t *process)
+{
+    return (heap_key_t){ priority_key(process), process->arrival_time };
+}
+
+/**
+ * fcfs_key() orders the FCFS ready queue by arrival time.
+ */
+static heap_key_t fcfs_key(const pcb_t *process)
+{
+    return (heap_key_t){ process->arrival_time, 0 };
+}
+
+/**
+ * srtf_key() orders the SRTF ready queue by total time remaining, which
+ * does not change while a process waits.
+ */
+static heap_key_t srtf_key(const pcb_t *process)
+{
+    return (heap_key_t){ process->total_time_remaining, 0 };
+}
+
+/**
+ * cfs_before() orders the CFS ready queue by vruntime.
+ */
+static bool cfs_before(const rb_node_t *a, const rb_node_t *b)
+{
+    return rb_entry(a, const pcb_t, run_node)->vruntime <
+           rb_entry(b, const pcb_t, run_node)->vruntime;
+}
+
+/*
+ * The CFS weight of each priority, from 0 up: the weights of nice 0 to 19.
+ * Each priority gets about 25% less CPU time than the one above it.
+ */
+static const unsigned int cfs_weights[] = {
+    1024, 820, 655, 526, 423, 335, 272, 215, 172, 137,
+    110, 87, 70, 56, 45, 36, 29, 23, 18, 15
+};
+
+/**
+ * cfs_weight() returns the CFS weight of a priority.  Priorities past the
+ * end of cfs_weights[] get the lowest weight.
+ */
+static unsigned int cfs_weight(unsigned int priority)
+{
+    unsigned int count = sizeof(cfs_weights) / sizeof(cfs_weights[0]);
+
+    return cfs_weights[priority < count ? priority : count - 1];
+}
+
+/**
+ * queue_init() is a helper function to set up an empty ready queue.
+ *
+ * @param queue pointer to the ready queue
+ * @param key_of key used to order the queue, or NULL for FIFO order
+ */
+void queue_init(queue_t *queue, pcb_key_t key_of)
+{
+    queue->head = NULL;
+    queue->tail = NULL;
+    heap_init(&queue->heap, key_of);
+    rb_init(&queue->tree, NULL);
+    queue->load = 0;
+}
+
+/**
+ * queue_insert() adds a process to the ready queue as it is, without
+ * touching its enqueue time.
  *
  * @param queue pointer to the ready queue
  * @param process process that we need to put in the ready queue
  */
-void enqueue(queue_t *queue, pcb_t *process)
+static void queue_insert(queue_t *queue, pcb_t *process)
 {
     process->next = NULL;
-    process->enqueue_time = get_current_time();
 
-    if (is_empty(queue)) {
+    if (queue->tree.before != NULL) {
+        rb_insert(&queue->tree, &process->run_node);
+        __atomic_add_fetch(&queue->load, process->weight, __ATOMIC_RELAXED);
+    } else if (queue->heap.key_of != NULL) {
+        heap_push(&queue->heap, process);
+    } else if (is_empty(queue)) {
         queue->head = process;
         queue->tail = process;
     } else {
@@ -95,8 +309,21 @@ void enqueue(queue_t *queue, pcb_t *process)
     }
 }
 
+/**
+ * enqueue() is a helper function to add a process to the ready queue.
+ *
+ * @param queue pointer to the ready queue
+ * @param process process that we need to put in the ready queue
+ */
+void enqueue(queue_t *queue, pcb_t *process)
+{
+    process->enqueue_time = get_current_time();
+    queue_insert(queue, process);
+}
+
 /**
  * dequeue() is a helper function to remove a process to the ready queue.
+ * For an ordered queue this is the process that comes first in its order.
  * 
  * @param queue pointer to the ready queue
  */
@@ -106,6 +333,17 @@ pcb_t *dequeue(queue_t *queue)
         return NULL;
     }
 
+    if (queue->tree.before != NULL) {
+        pcb_t *first = rb_entry(rb_first(&queue->tree), pcb_t, run_node);
+
+        rb_erase(&queue->tree, &first->run_node);
+        __atomic_sub_fetch(&queue->load, first->weight, __ATOMIC_RELAXED);
+        return first;
+    }
+    if (queue->heap.key_of != NULL) {
+        return heap_pop(&queue->heap);
+    }
+
     pcb_t *process = queue->head;
     queue->head = process->next;
     if (queue->head == NULL) {
@@ -115,6 +353,44 @@ pcb_t *dequeue(queue_t *queue)
     return process;
 }
 
+/**
+ * queue_peek() is a helper function that returns the process dequeue()
+ * would remove next, without removing it.
+ *
+ * @param queue pointer to the ready queue
+ */
+pcb_t *queue_peek(queue_t *queue)
+{
+    if (is_empty(queue)) {
+        return NULL;
+    }
+    if (queue->tree.before != NULL) {
+        return rb_entry(rb_first(&queue->tree), pcb_t, run_node);
+    }
+    if (queue->heap.key_of != NULL) {
+        return heap_peek(&queue->heap);
+    }
+    return queue->head;
+}
+
+/**
+ * comes_before() returns whether the next process of queue a comes before
+ * the next process of queue b.  Both queues must be in the same order and
+ * not empty; FIFO queues are compared on enqueue time.
+ */
+static bool comes_before(queue_t *a, queue_t *b)
+{
+    pcb_t *first_a = queue_peek(a), *first_b = queue_peek(b);
+
+    if (a->tree.before != NULL) {
+        return a->tree.before(&first_a->run_node, &first_b->run_node);
+    }
+    if (a->heap.key_of != NULL) {
+        return heap_key_before(&a->heap.nodes[0].key, &b->heap.nodes[0].key);
+    }
+    return first_a->enqueue_time < first_b->enqueue_time;
+}
+
 /**
  * is_empty() is a helper function that returns whether the ready queue
  * has any processes in it.
@@ -125,365 +401,2196 @@ pcb_t *dequeue(queue_t *queue)
  */
 bool is_empty(queue_t *queue)
 {
+    if (queue->tree.before != NULL) {
+        return queue->tree.root == NULL;
+    }
+    if (queue->heap.key_of != NULL) {
+        return queue->heap.size == 0;
+    }
     return queue->head == NULL;
 }
 
 /**
- * schedule() is the CPU scheduler.
- * 
- * @param cpu_id the target cpu we decide to put our process in
+ * time_to_finish() is how many ticks a running process still needs: its
+ * total_time_remaining, and the migration warm-up it has left, during which
+ * total_time_remaining stands still.
  */
-static void schedule(unsigned int cpu_id)
+static unsigned long long time_to_finish(const pcb_t *process)
 {
-    pcb_t *next_process = NULL;
-
-    pthread_mutex_lock(&queue_mutex);
-
-    if (!is_empty(rq)) {
-        if (scheduler_algorithm == FCFS) {
-            pcb_t *current_p = rq->head;
-            pcb_t *prev_p = NULL;
-            pcb_t *best_p = rq->head;
-            pcb_t *prev_best_p = NULL;
-            unsigned int earliest_arrival = best_p->arrival_time;
-
-            while (current_p != NULL) {
-                if (current_p->arrival_time < earliest_arrival) {
-                    earliest_arrival = current_p->arrival_time;
-                    best_p = current_p;
-                    prev_best_p = prev_p;
-                }
-                prev_p = current_p;
-                current_p = current_p->next;
-            }
-            next_process = best_p; 
-            if (prev_best_p == NULL) {
-                rq->head = next_process->next;
-            } else {
-                prev_best_p->next = next_process->next;
-            }
-            if (rq->tail == next_process) {
-                rq->tail = prev_best_p;
-            }
-
-        } else if (scheduler_algorithm == PA) {
-            unsigned int current_time = get_current_time();
-            pcb_t *current_p = rq->head;
-            pcb_t *prev_p = NULL;
-            pcb_t *best_p = rq->head;
-            pcb_t *prev_best_p = NULL;
-            double best_metric = priority_with_age(current_time, best_p);
-
-            while (current_p != NULL) {
-                double current_metric = priority_with_age(current_time, current_p);
-                if (current_metric < best_metric) {
-                    best_metric = current_metric;
-                    best_p = current_p;
-                    prev_best_p = prev_p;
-                } else if (current_metric == best_metric) {
-                    if (current_p->arrival_time < best_p->arrival_time) {
-                        best_p = current_p;
-                        prev_best_p = prev_p;
-                    }
-                }
-                prev_p = current_p;
-                current_p = current_p->next;
-            }
-            next_process = best_p;
-            if (prev_best_p == NULL) {
-                rq->head = next_process->next;
-            } else {
-                prev_best_p->next = next_process->next;
-            }
-            if (rq->tail == next_process) {
-                rq->tail = prev_best_p;
-            }
-
-        } else if (scheduler_algorithm == SRTF) {
-            pcb_t *current_p = rq->head;
-            pcb_t *prev_p = NULL;
-            pcb_t *best_p = rq->head;
-            pcb_t *prev_best_p = NULL;
-            unsigned int best_metric = best_p->total_time_remaining;
+    return (unsigned long long)process->total_time_remaining + process->migration_ticks;
+}
 
-            while (current_p != NULL) {
-                if (current_p->total_time_remaining < best_metric) {
-                    best_metric = current_p->total_time_remaining;
-                    best_p = current_p;
-                    prev_best_p = prev_p;
-                }
-                prev_p = current_p;
-                current_p = current_p->next;
-            }
-            next_process = best_p;
-            if (prev_best_p == NULL) {
-                rq->head = next_process->next;
-            } else {
-                prev_best_p->next = next_process->next;
-            }
-            if (rq->tail == next_process) {
-                rq->tail = prev_best_p;
-            }
+/**
+ * running_key() is the running_max key of a process that is being
+ * dispatched.  For PA this is priority_key().  For SRTF it is the time at
+ * which the process would finish if it kept running: every tick a running
+ * process either warms up or runs, so time_to_finish() falls by one every
+ * tick, and this orders the running processes by it without updating the
+ * heap on every tick.  The warm-up is only known once context_switch() has
+ * set it, so dispatch() keys the process again if it has one.
+ */
+static unsigned long long running_key(const pcb_t *process)
+{
+    if (sched->scheduler_algorithm == PA) {
+        return priority_key(process);
+    }
+    return time_to_finish(process) + get_current_time();
+}
 
-        } else {
-            next_process = dequeue(rq);
-        }
+/**
+ * set_current() records the process running on a CPU, and keeps idle_cpus
+ * and running_max in step.  current_mutex must be held.
+ *
+ * @param cpu_id the cpu whose process changes
+ * @param process the process now running on cpu_id, or NULL for idle
+ */
+static void set_current(unsigned int cpu_id, pcb_t *process)
+{
+    sched->current[cpu_id] = process;
 
-        if (next_process != NULL) {
-            next_process->next = NULL;
+    if (process == NULL) {
+        cpumask_set(&sched->idle_cpus, cpu_id);
+        cpu_heap_remove(&sched->running_max, cpu_id);
+    } else {
+        cpumask_clear(&sched->idle_cpus, cpu_id);
+        if (sched->scheduler_algorithm == PA || sched->scheduler_algorithm == SRTF) {
+            cpu_heap_update(&sched->running_max, cpu_id, running_key(process));
         }
     }
-    
-    pthread_mutex_unlock(&queue_mutex);
+}
 
-    pthread_mutex_lock(&current_mutex);
-    current[cpu_id] = next_process;
-    pthread_mutex_unlock(&current_mutex);
+/**
+ * ready_key() returns the ready queue key for the current algorithm.
+ */
+static pcb_key_t ready_key(void)
+{
+    switch (sched->scheduler_algorithm) {
+    case FCFS:
+        return fcfs_key;
+    case PA:
+        return pa_key;
+    case SRTF:
+        return srtf_key;
+    default:
+        return NULL;
+    }
+}
 
-    if (next_process != NULL) {
-        next_process->state = PROCESS_RUNNING;
+/**
+ * ready_queue_init() sets up an empty ready queue in the order of the
+ * current algorithm.
+ */
+static void ready_queue_init(queue_t *queue)
+{
+    queue_init(queue, ready_key());
+    if (sched->scheduler_algorithm == CFS) {
+        rb_init(&queue->tree, cfs_before);
     }
+}
 
-    int timeslice = (scheduler_algorithm == RR) ? time_slice : -1;
-    context_switch(cpu_id, next_process, timeslice);
+/**
+ * allowed_on() returns whether a process may run on a CPU.
+ */
+static bool allowed_on(const pcb_t *process, unsigned int cpu_id)
+{
+    return process->affinity == NULL || cpumask_test(process->affinity, cpu_id);
 }
 
-/** 
- * idle() is the idle process.  It is called by the simulator when the idle
- * process is scheduled. This function blocks until a process is added
- * to the ready queue.
- *
- * @param cpu_id the cpu that is waiting for process to come in
+/**
+ * affinity_of() returns the mask of the first affinity rule that matches a
+ * process, or NULL if none does.
  */
-extern void idle(unsigned int cpu_id)
+static const cpumask_t *affinity_of(const pcb_t *process)
 {
-    pthread_mutex_lock(&queue_mutex);
-    while (is_empty(rq)) {
-        pthread_cond_wait(&queue_not_empty, &queue_mutex);
+    for (unsigned int i = 0; i < sched->affinity_count; i++) {
+        if (process->pid >= sched->affinity[i].first_pid &&
+            process->pid <= sched->affinity[i].last_pid) {
+            return &sched->affinity[i].mask;
+        }
     }
-    pthread_mutex_unlock(&queue_mutex);
+    return NULL;
+}
 
-    schedule(cpu_id);
+/**
+ * cpu_rq_load() returns the number of processes queued for a CPU, pinned
+ * or not, without taking any lock.
+ */
+static unsigned int cpu_rq_load(unsigned int cpu_id)
+{
+    return __atomic_load_n(&sched->cpu_rq[cpu_id].nr_queued, __ATOMIC_SEQ_CST) +
+           __atomic_load_n(&sched->cpu_rq[cpu_id].nr_pinned, __ATOMIC_SEQ_CST);
+}
 
-    /*
-     * idle() must block when the ready queue is empty, or else the CPU threads
-     * will spin in a loop.
-     */ 
+/**
+ * node_of() returns the NUMA node of a CPU.
+ */
+static unsigned int node_of(unsigned int cpu_id)
+{
+    return topology_node_of(&sched->topology, cpu_id);
 }
 
 /**
- * preempt() is the handler used in Round-robin, Preemptive Priority, and SRTF scheduling.
- *
- * This function should place the currently running process back in the
- * ready queue, and call schedule() to select a new runnable process.
- * 
- * @param cpu_id the cpu in which we want to preempt process
+ * first_allowed_idle() returns the first idle CPU on a node that a process
+ * may run on, or on any node if node is -1, or returns -1 if there is
+ * none.  current_mutex must be held.
  */
-extern void preempt(unsigned int cpu_id)
+static int first_allowed_idle(const pcb_t *process, int node)
 {
-    pthread_mutex_lock(&current_mutex);
-    pcb_t *process = current[cpu_id];
-    pthread_mutex_unlock(&current_mutex);
+    unsigned int first = 0, end = sched->cpu_count;
+    int cpu_id;
 
-    if (process != NULL) {
-        process->state = PROCESS_READY;
-        pthread_mutex_lock(&queue_mutex);
-        enqueue(rq, process);
-        pthread_cond_signal(&queue_not_empty);
-        pthread_mutex_unlock(&queue_mutex);
+    if (node != -1) {
+        first = (unsigned int)node * sched->node_cpus;
+        end = first + sched->node_cpus;
+    }
+    cpu_id = cpumask_test(&sched->idle_cpus, first) ? (int)first :
+             cpumask_next(&sched->idle_cpus, first);
+    for (; cpu_id != -1 && (unsigned int)cpu_id < end;
+         cpu_id = cpumask_next(&sched->idle_cpus, (unsigned int)cpu_id)) {
+        if (allowed_on(process, (unsigned int)cpu_id)) {
+            return cpu_id;
+        }
     }
+    return -1;
+}
 
-    schedule(cpu_id);
+/**
+ * node_rq() returns the shared ready queue of a node.  MLFQ keeps its
+ * levels for every node under rq[0].
+ */
+static node_rq_t *node_rq(unsigned int node)
+{
+    return &sched->rq[sched->scheduler_algorithm == MLFQ ? 0 : node];
 }
 
 /**
- * yield() is the handler called by the simulator when a process yields the
- * CPU to perform an I/O request.
- *
- * @param cpu_id the cpu that is yielded by the process
+ * busiest_node() returns the node other than node with the most processes
+ * in its shared ready queue, or -1 if every other one is empty.  The queue
+ * lengths are read without taking any lock.
  */
-extern void yield(unsigned int cpu_id)
+static int busiest_node(unsigned int node)
 {
-    pthread_mutex_lock(&current_mutex);
-    pcb_t *process = current[cpu_id];
-    pthread_mutex_unlock(&current_mutex);
+    int busiest = -1;
+    unsigned int most_queued = 0;
 
-    if (process != NULL) {
-        process->state = PROCESS_WAITING;
+    for (unsigned int i = 0; i < sched->node_count; ++i) {
+        unsigned int queued = __atomic_load_n(&sched->rq[i].nr_queued, __ATOMIC_SEQ_CST);
+        if (i != node && queued > most_queued) {
+            most_queued = queued;
+            busiest = (int)i;
+        }
     }
-
-    schedule(cpu_id);
+    return busiest;
 }
 
 /**
- * terminate() is the handler called by the simulator when a process completes.
- * 
- * @param cpu_id the cpu we want to terminate
+ * cpu_rq_push() adds a process to the ready queue owned by a CPU, or to
+ * its pinned queue if the process has an affinity mask.
+ *
+ * @param cpu_id the cpu whose ready queue receives the process
+ * @param process process that we need to put in the ready queue
  */
-extern void terminate(unsigned int cpu_id)
+static void cpu_rq_push(unsigned int cpu_id, pcb_t *process)
 {
-    pthread_mutex_lock(&current_mutex);
-    pcb_t* process = current[cpu_id];
-    current[cpu_id] = NULL;
-    pthread_mutex_unlock(&current_mutex);
+    cpu_rq_t *target = &sched->cpu_rq[cpu_id];
 
-    if (process != NULL) {
-        process->state = PROCESS_TERMINATED;
+    lock_counted(&target->mutex, SIM_LOCK_QUEUE);
+    if (process->affinity != NULL) {
+        enqueue(&target->pinned, process);
+        __atomic_add_fetch(&target->nr_pinned, 1, __ATOMIC_SEQ_CST);
+    } else {
+        enqueue(&target->queue, process);
+        __atomic_add_fetch(&target->nr_queued, 1, __ATOMIC_SEQ_CST);
     }
-
-    schedule(cpu_id);
+    pthread_mutex_unlock(&target->mutex);
 }
 
 /**
- * wake_up() is the handler called by the simulator when a process's I/O
- * request completes. 
- * This method also handles priority and SRTF preemption.
- * 
- * @param process the process that finishes I/O and is ready to run on CPU
+ * cpu_rq_pop() removes the next process from the ready queue of a CPU.
+ * The CPU itself also takes from its pinned queue, whichever comes first;
+ * a thief only takes from the ready queue.
+ *
+ * @param cpu_id the cpu whose ready queue we take from
+ * @param own whether cpu_id is the calling CPU
+ *
+ * @return the next process, or NULL if the queue is empty
  */
-extern void wake_up(pcb_t *process)
+static pcb_t *cpu_rq_pop(unsigned int cpu_id, bool own)
 {
-    process->state = PROCESS_READY;
+    cpu_rq_t *source = &sched->cpu_rq[cpu_id];
+    pcb_t *process;
 
-    pthread_mutex_lock(&queue_mutex);
-    enqueue(rq, process);
-    pthread_cond_signal(&queue_not_empty);
-    pthread_mutex_unlock(&queue_mutex);
-
-    if (scheduler_algorithm == PA) {
-        unsigned int current_time = get_current_time();
-        double waking_priority = priority_with_age(current_time, process);
-        int target_cpu = -1;
-        double highest_running_priority = -DBL_MAX;
-        bool idle_cpu_found = false;
-
-        pthread_mutex_lock(&current_mutex);
-        for (unsigned int i = 0; i < cpu_count; ++i) {
-            if (current[i] == NULL) {
-                idle_cpu_found = true;
-                break;
-            }
+    lock_counted(&source->mutex, SIM_LOCK_QUEUE);
+    if (own && !is_empty(&source->pinned) &&
+        (is_empty(&source->queue) || comes_before(&source->pinned, &source->queue))) {
+        process = dequeue(&source->pinned);
+        __atomic_sub_fetch(&source->nr_pinned, 1, __ATOMIC_SEQ_CST);
+    } else {
+        process = dequeue(&source->queue);
+        if (process != NULL) {
+            __atomic_sub_fetch(&source->nr_queued, 1, __ATOMIC_SEQ_CST);
         }
+    }
+    pthread_mutex_unlock(&source->mutex);
 
-        if (!idle_cpu_found) {
-            for (unsigned int i = 0; i < cpu_count; ++i) {
-                pcb_t *running_process = current[i];
-                double running_priority = priority_with_age(current_time, running_process);
-                if (running_priority > highest_running_priority) {
-                    highest_running_priority = running_priority;
-                    target_cpu = i;
-                }
-            }
-        }
-        pthread_mutex_unlock(&current_mutex);
+    return process;
+}
 
-        if (!idle_cpu_found && target_cpu != -1 && waking_priority < highest_running_priority) {
-            force_preempt(target_cpu);
-        }
-    } else if (scheduler_algorithm == SRTF) {
-        unsigned int waking_remaining_time = process->total_time_remaining;
-        int target_cpu = -1;
-        unsigned int largest_remaining_time = 0;
-        bool idle_cpu_found = false;
+/**
+ * busiest_cpu() returns the CPU with the most queued processes, other than
+ * cpu_id, or -1 if every other queue is empty.  A CPU on the same node as
+ * cpu_id wins over any on another node.  The queue lengths are read
+ * without taking any lock.
+ */
+static int busiest_cpu(unsigned int cpu_id)
+{
+    int busiest = -1, busiest_near = -1;
+    unsigned int most_queued = 0, most_near = 0;
 
-        pthread_mutex_lock(&current_mutex);
-        for (unsigned int i = 0; i < cpu_count; ++i) {
-            if (current[i] == NULL) {
-                idle_cpu_found = true;
-                break;
-            }
+    for (unsigned int i = 0; i < sched->cpu_count; ++i) {
+        unsigned int queued = __atomic_load_n(&sched->cpu_rq[i].nr_queued, __ATOMIC_SEQ_CST);
+        if (i == cpu_id) {
+            continue;
         }
-        
-        if (!idle_cpu_found) {
-            for (unsigned int i = 0; i < cpu_count; ++i) {
-                pcb_t *running_process = current[i];
-                unsigned int running_remaining_time = running_process->total_time_remaining;
-                if (running_remaining_time > largest_remaining_time) {
-                    largest_remaining_time = running_remaining_time;
-                    target_cpu = i;
-                }
-            }
+        if (queued > most_queued) {
+            most_queued = queued;
+            busiest = (int)i;
         }
-        pthread_mutex_unlock(&current_mutex);
-
-        if (!idle_cpu_found && target_cpu != -1 && waking_remaining_time < largest_remaining_time) {
-            force_preempt(target_cpu);
+        if (queued > most_near && node_of(i) == node_of(cpu_id)) {
+            most_near = queued;
+            busiest_near = (int)i;
         }
     }
+    return busiest_near != -1 ? busiest_near : busiest;
 }
 
 /**
- * main() simply parses command line arguments, then calls start_simulator().
+ * steal() takes the next process from the busiest peer of an idle CPU.
+ *
+ * @param cpu_id the cpu that is looking for work
+ *
+ * @return the stolen process, or NULL if no peer has any queued processes
  */
-int main(int argc, char *argv[])
+static pcb_t *steal(unsigned int cpu_id)
 {
-    scheduler_algorithm = FCFS;
-    age_weight = 0;
-    time_slice = -1;
+    int victim;
 
-    if (argc < 2) {
-        fprintf(stderr, "Multithreaded OS Simulator\n"
-                        "Usage: ./os-sim <# CPUs> [ -r <time slice> | -p <age weight> | -s ]\n"
-                        "    Default : FCFS Scheduler\n"
-                        "         -r : Round-Robin Scheduler\n1\n"
-                        "         -p : Priority Aging Scheduler\n"
-                        "         -s : Shortest Remaining Time First\n");
-        return -1;
+    while ((victim = busiest_cpu(cpu_id)) != -1) {
+        pcb_t *process = cpu_rq_pop((unsigned int)victim, false);
+        if (process != NULL) {
+            return process;
+        }
     }
+    return NULL;
+}
 
-    /* Parse the command line arguments */
-    cpu_count = strtoul(argv[1], NULL, 0);
-    if (cpu_count == 0) {
-        fprintf(stderr, "Error: Invalid number of CPUs specified.\n");
-        return -1;
+/**
+ * work_available() returns whether there is a queued process that cpu_id
+ * could pick up, without taking any lock.
+ */
+static bool work_available(unsigned int cpu_id)
+{
+    if (sched->per_cpu_queues) {
+        return cpu_rq_load(cpu_id) > 0 || busiest_cpu(cpu_id) != -1;
+    }
+    return __atomic_load_n(&node_rq(node_of(cpu_id))->nr_queued, __ATOMIC_SEQ_CST) > 0 ||
+           busiest_node(node_of(cpu_id)) != -1;
+}
+
+/**
+ * wake_parked_cpu() wakes a CPU that has been claimed from parked_cpus,
+ * either handing it a process or, if process is NULL, telling it to look
+ * at the ready queues again.
+ */
+static void wake_parked_cpu(unsigned int cpu_id, pcb_t *process)
+{
+    cpu_rq_t *target = &sched->cpu_rq[cpu_id];
+
+    pthread_mutex_lock(&target->mutex);
+    if (process != NULL) {
+        target->handoff = process;
+    } else {
+        target->kicked = true;
+    }
+    pthread_cond_signal(&target->wakeup);
+    pthread_mutex_unlock(&target->mutex);
+}
+
+/**
+ * claim_parked_cpu() claims a parked CPU that a process may run on: the
+ * one it last ran on with cache_affinity, if that one is parked, or else
+ * the first parked CPU in its affinity mask, preferring the node it last
+ * ran on.
+ *
+ * @return the claimed cpu, or -1 if there is none
+ */
+static int claim_parked_cpu(const pcb_t *process)
+{
+    if (sched->cache_affinity && process->last_cpu != -1 &&
+        allowed_on(process, (unsigned int)process->last_cpu) &&
+        cpumask_test_and_clear_atomic(&sched->parked_cpus, (unsigned int)process->last_cpu)) {
+        return process->last_cpu;
+    }
+    if (process->affinity == NULL) {
+        if (sched->node_count > 1 && process->last_cpu != -1) {
+            unsigned int first = node_of((unsigned int)process->last_cpu) * sched->node_cpus;
+            int cpu_id = cpumask_claim_range_atomic(&sched->parked_cpus, first,
+                                                    first + sched->node_cpus);
+            if (cpu_id != -1) {
+                return cpu_id;
+            }
+        }
+        return cpumask_claim_first_atomic(&sched->parked_cpus);
+    }
+    for (int cpu_id = cpumask_first(process->affinity); cpu_id != -1;
+         cpu_id = cpumask_next(process->affinity, (unsigned int)cpu_id)) {
+        if (cpumask_test_and_clear_atomic(&sched->parked_cpus, (unsigned int)cpu_id)) {
+            return cpu_id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * hand_off() gives a process straight to a parked CPU, if there is one
+ * it may run on.
+ *
+ * A CPU only parks once every ready queue it can take from is empty, so
+ * handing it the process is the same as enqueueing and then dequeueing it,
+ * without either side taking a queue lock.
+ *
+ * @return true if the process was handed off
+ */
+static bool hand_off(pcb_t *process)
+{
+    int cpu_id = claim_parked_cpu(process);
+
+    if (cpu_id == -1) {
+        return false;
+    }
+    wake_parked_cpu((unsigned int)cpu_id, process);
+    return true;
+}
+
+/**
+ * kick_parked_cpu() wakes one parked CPU, if there is one, after work has
+ * been queued on a node, preferring a CPU of that node.
+ *
+ * The queue length is published before parked_cpus is read, and idle()
+ * sets its bit before reading the queue lengths, so one of the two always
+ * sees the other and no wakeup is lost.
+ */
+static void kick_parked_cpu(unsigned int node)
+{
+    int cpu_id = -1;
+
+    if (sched->node_count > 1) {
+        cpu_id = cpumask_claim_range_atomic(&sched->parked_cpus, node * sched->node_cpus,
+                                            (node + 1) * sched->node_cpus);
+    }
+    if (cpu_id == -1) {
+        cpu_id = cpumask_claim_first_atomic(&sched->parked_cpus);
+    }
+
+    if (cpu_id != -1) {
+        wake_parked_cpu((unsigned int)cpu_id, NULL);
+    }
+}
+
+/**
+ * least_loaded_cpu() returns the CPU with the shortest ready queue that a
+ * process may run on, preferring a CPU that is idle, and an idle CPU on the
+ * node it last ran on.  With cache_affinity the CPU it last ran on wins
+ * over any other that is no better.
+ */
+static unsigned int least_loaded_cpu(const pcb_t *process)
+{
+    int warm = -1, best = -1;
+    unsigned int fewest_queued = 0;
+
+    if (sched->cache_affinity && process->last_cpu != -1 &&
+        allowed_on(process, (unsigned int)process->last_cpu)) {
+        warm = process->last_cpu;
+    }
+
+    lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+    int idle_cpu = -1;
+    if (warm != -1 && cpumask_test(&sched->idle_cpus, (unsigned int)warm)) {
+        idle_cpu = warm;
+    }
+    if (idle_cpu == -1 && process->last_cpu != -1) {
+        idle_cpu = first_allowed_idle(process, (int)node_of((unsigned int)process->last_cpu));
+    }
+    if (idle_cpu == -1) {
+        idle_cpu = first_allowed_idle(process, -1);
+    }
+    pthread_mutex_unlock(&sched->current_mutex);
+
+    if (idle_cpu != -1) {
+        return (unsigned int)idle_cpu;
+    }
+
+    if (warm != -1) {
+        best = warm;
+        fewest_queued = cpu_rq_load((unsigned int)warm);
+    }
+    for (unsigned int i = 0; i < sched->cpu_count; ++i) {
+        unsigned int queued;
+
+        if (!allowed_on(process, i)) {
+            continue;
+        }
+        queued = cpu_rq_load(i);
+        if (best == -1 || queued < fewest_queued) {
+            fewest_queued = queued;
+            best = (int)i;
+        }
+    }
+    return (unsigned int)best;
+}
+
+/**
+ * select_target_cpu() is the per-algorithm placement policy used in per-CPU
+ * mode.  It decides which CPU's ready queue a woken process lands on.
+ *
+ *   FCFS, RR : the least loaded CPU, which keeps waiting time even
+ *   PA, SRTF : the CPU that is about to be preempted for this process, so
+ *              that it is picked up by that CPU's schedule(); otherwise the
+ *              least loaded CPU
+ *
+ * Either way, only CPUs in the process's affinity mask are considered.
+ *
+ * @param victim the cpu that wake_up() is going to preempt, or -1
+ * @param process the process that is waking up
+ */
+static unsigned int select_target_cpu(int victim, const pcb_t *process)
+{
+    switch (sched->scheduler_algorithm) {
+    case PA:
+    case SRTF:
+        if (victim != -1) {
+            return (unsigned int)victim;
+        }
+        return least_loaded_cpu(process);
+    default:
+        return least_loaded_cpu(process);
+    }
+}
+
+/**
+ * mlfq_current_period() returns the number of MLFQ boosts there have been
+ * by now.
+ */
+static unsigned int mlfq_current_period(void)
+{
+    return sched->boost_ticks ? get_current_time() / sched->boost_ticks : 0;
+}
+
+/**
+ * mlfq_level() returns the MLFQ level of a process: the one it was given,
+ * unless there has been a boost since, which puts it on level 0.
+ */
+static unsigned int mlfq_level(const pcb_t *process)
+{
+    return process->level_period == mlfq_current_period() ? process->level : 0;
+}
+
+/**
+ * mlfq_move() moves a process up a level (change < 0), down one
+ * (change > 0) or leaves it where it is.  Levels stop at 0 and
+ * level_count - 1.
+ */
+static void mlfq_move(pcb_t *process, int change)
+{
+    unsigned int level = mlfq_level(process);
+
+    if (change < 0 && level > 0) {
+        level--;
+    } else if (change > 0 && level + 1 < sched->level_count) {
+        level++;
+    }
+    process->level = level;
+    process->level_period = mlfq_current_period();
+}
+
+/**
+ * mlfq_quantum() returns the time slice of a process on its MLFQ level:
+ * the base time slice, doubled for every level below the top.
+ */
+static int mlfq_quantum(const pcb_t *process)
+{
+    unsigned long long quantum = (unsigned long long)sched->time_slice << mlfq_level(process);
+
+    return quantum < 0x7fffffffull ? (int)quantum : 0x7fffffff;
+}
+
+/**
+ * arr_quantum() returns the time slice of a process under adaptive RR.  A
+ * process whose bursts have been short gets long enough to finish its
+ * current one, if it runs as long as the estimate and a quarter more, so
+ * it is not preempted just before it would have yielded.  That slice is at
+ * least the base time slice and at most ARR_MAX_SLICES of them.  A process
+ * with no estimate yet, one that has already run past it, or one whose
+ * bursts are longer than that (a CPU hog), gets the base time slice.
+ */
+static int arr_quantum(const pcb_t *process)
+{
+    unsigned long long expected = ((unsigned long long)process->burst_estimate * 5 / 4 +
+                                   PCB_BURST_SCALE - 1) / PCB_BURST_SCALE;
+    unsigned long long left;
+
+    if (process->burst_estimate == 0 || expected <= process->burst_ticks ||
+        expected > (unsigned long long)sched->time_slice * ARR_MAX_SLICES) {
+        return (int)sched->time_slice;
+    }
+    left = expected - process->burst_ticks;
+    return left > sched->time_slice ? (int)left : (int)sched->time_slice;
+}
+
+/**
+ * mlfq_boost() applies any priority boost that is due, by splicing every
+ * level onto the end of level 0 in order.  The mutex of rq[0] must be held.
+ */
+static void mlfq_boost(void)
+{
+    unsigned int period = mlfq_current_period();
+    queue_t *top = &sched->levels[0];
+    unsigned long long rest;
+
+    if (period == sched->boost_period) {
+        return;
+    }
+    sched->boost_period = period;
+
+    for (rest = sched->level_mask & ~1ull; rest != 0; rest &= rest - 1) {
+        queue_t *level = &sched->levels[__builtin_ctzll(rest)];
+
+        if (is_empty(top)) {
+            top->head = level->head;
+        } else {
+            top->tail->next = level->head;
+        }
+        top->tail = level->tail;
+        level->head = NULL;
+        level->tail = NULL;
+    }
+    sched->level_mask = is_empty(top) ? 0 : 1ull;
+}
+
+/**
+ * rq_push() adds a process to a shared ready queue, or for MLFQ to the
+ * level of the process.  The queue's mutex must be held.
+ */
+static void rq_push(node_rq_t *rq, pcb_t *process)
+{
+    unsigned int level;
+
+    if (sched->scheduler_algorithm != MLFQ) {
+        enqueue(&rq->queue, process);
+        return;
+    }
+
+    mlfq_boost();
+    level = mlfq_level(process);
+    enqueue(&sched->levels[level], process);
+    sched->level_mask |= 1ull << level;
+}
+
+/**
+ * rq_pop() removes the next process from a shared ready queue, or returns
+ * NULL if it is empty.  For MLFQ that is the head of the highest level
+ * with any processes.  The queue's mutex must be held.
+ */
+static pcb_t *rq_pop(node_rq_t *rq)
+{
+    unsigned int level;
+    pcb_t *process;
+
+    if (sched->scheduler_algorithm != MLFQ) {
+        return dequeue(&rq->queue);
+    }
+
+    mlfq_boost();
+    if (sched->level_mask == 0) {
+        return NULL;
+    }
+    level = (unsigned int)__builtin_ctzll(sched->level_mask);
+    process = dequeue(&sched->levels[level]);
+    if (is_empty(&sched->levels[level])) {
+        sched->level_mask &= ~(1ull << level);
+    }
+    return process;
+}
+
+/**
+ * node_rq_push() adds a process to the shared ready queue of a node.
+ */
+static void node_rq_push(unsigned int node, pcb_t *process)
+{
+    node_rq_t *target = node_rq(node);
+
+    lock_counted(&target->mutex, SIM_LOCK_QUEUE);
+    rq_push(target, process);
+    __atomic_add_fetch(&target->nr_queued, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&target->mutex);
+}
+
+/**
+ * node_rq_pop() removes the next process from the shared ready queue of a
+ * node, or returns NULL if it is empty.
+ */
+static pcb_t *node_rq_pop(unsigned int node)
+{
+    node_rq_t *source = node_rq(node);
+    pcb_t *process;
+
+    lock_counted(&source->mutex, SIM_LOCK_QUEUE);
+    process = rq_pop(source);
+    if (process != NULL) {
+        __atomic_sub_fetch(&source->nr_queued, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&source->mutex);
+
+    return process;
+}
+
+/**
+ * steal_remote() takes the next process from the shared ready queue of the
+ * busiest other node, for a CPU whose own node has nothing queued.
+ *
+ * @param node the node of the cpu that is looking for work
+ *
+ * @return the stolen process, or NULL if no other node has any queued
+ */
+static pcb_t *steal_remote(unsigned int node)
+{
+    int victim;
+
+    while ((victim = busiest_node(node)) != -1) {
+        pcb_t *process = node_rq_pop((unsigned int)victim);
+        if (process != NULL) {
+            return process;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * select_target_node() decides which node's shared ready queue a woken
+ * process lands on: the node it last ran on, whose memory it has been
+ * using, unless that node has no idle CPU and another one has.  A new
+ * process goes to the node of the first idle CPU, or else to the node
+ * with the fewest processes queued.
+ */
+static unsigned int select_target_node(const pcb_t *process)
+{
+    int home = -1, idle_cpu = -1;
+    unsigned int best = 0, fewest_queued;
+
+    if (sched->node_count == 1 || sched->scheduler_algorithm == MLFQ) {
+        return 0;
+    }
+    if (process->last_cpu != -1) {
+        home = (int)node_of((unsigned int)process->last_cpu);
+    }
+
+    lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+    if (home != -1) {
+        idle_cpu = first_allowed_idle(process, home);
+    }
+    if (idle_cpu == -1) {
+        idle_cpu = first_allowed_idle(process, -1);
+    }
+    pthread_mutex_unlock(&sched->current_mutex);
+
+    if (idle_cpu != -1) {
+        return node_of((unsigned int)idle_cpu);
+    }
+    if (home != -1) {
+        return (unsigned int)home;
+    }
+
+    fewest_queued = __atomic_load_n(&sched->rq[0].nr_queued, __ATOMIC_SEQ_CST);
+    for (unsigned int i = 1; i < sched->node_count; ++i) {
+        unsigned int queued = __atomic_load_n(&sched->rq[i].nr_queued, __ATOMIC_SEQ_CST);
+        if (queued < fewest_queued) {
+            fewest_queued = queued;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/**
+ * cfs_slice() returns the time slice of a process under CFS: its share of
+ * the target latency against the weight queued for cpu_id, and at least
+ * one tick.  For a shared ready queue, that is the CPU's share of the
+ * weight queued on its node.
+ */
+static int cfs_slice(unsigned int cpu_id, const pcb_t *process)
+{
+    unsigned long long load, slice;
+
+    if (sched->per_cpu_queues) {
+        load = __atomic_load_n(&sched->cpu_rq[cpu_id].queue.load, __ATOMIC_RELAXED) +
+               __atomic_load_n(&sched->cpu_rq[cpu_id].pinned.load, __ATOMIC_RELAXED);
+    } else {
+        load = __atomic_load_n(&sched->rq[node_of(cpu_id)].queue.load, __ATOMIC_RELAXED) /
+               sched->node_cpus;
+    }
+
+    slice = (unsigned long long)sched->time_slice * process->weight / (process->weight + load);
+    return slice > 0 ? (int)slice : 1;
+}
+
+/**
+ * cfs_advance_min_vruntime() moves min_vruntime up to the vruntime of a
+ * process being dispatched, if that is further on.
+ */
+static void cfs_advance_min_vruntime(const pcb_t *process)
+{
+    unsigned long long min = __atomic_load_n(&sched->min_vruntime, __ATOMIC_RELAXED);
+
+    while (process->vruntime > min &&
+           !__atomic_compare_exchange_n(&sched->min_vruntime, &min, process->vruntime, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * cfs_place() sets the vruntime of a process joining the ready queue from
+ * outside it: at min_vruntime for a new process, and for one waking from
+ * I/O at no less than half a target latency behind min_vruntime.  A new
+ * process also gets the weight of its priority.
+ */
+static void cfs_place(pcb_t *process)
+{
+    unsigned long long min = __atomic_load_n(&sched->min_vruntime, __ATOMIC_RELAXED);
+    unsigned long long credit = sched->time_slice * PCB_VRUNTIME_TICK / 2;
+
+    if (process->state == PROCESS_NEW) {
+        process->weight = cfs_weight(process->priority);
+        process->vruntime = min;
+    } else if (process->vruntime + credit < min) {
+        process->vruntime = min - credit;
+    }
+}
+
+/**
+ * dispatch() puts a chosen process (or the idle process, if NULL) on a CPU.
+ *
+ * @param cpu_id the cpu the process runs on
+ * @param next_process the process to run
+ */
+static void dispatch(unsigned int cpu_id, pcb_t *next_process)
+{
+    lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+    set_current(cpu_id, next_process);
+    pthread_mutex_unlock(&sched->current_mutex);
+
+    if (next_process != NULL) {
+        next_process->state = PROCESS_RUNNING;
+    }
+
+    int timeslice = (sched->scheduler_algorithm == RR) ? (int)sched->time_slice : -1;
+    if (sched->scheduler_algorithm == ARR && next_process != NULL) {
+        timeslice = arr_quantum(next_process);
+    }
+    if (sched->scheduler_algorithm == MLFQ && next_process != NULL) {
+        timeslice = mlfq_quantum(next_process);
+    }
+    if (sched->scheduler_algorithm == CFS && next_process != NULL) {
+        cfs_advance_min_vruntime(next_process);
+        timeslice = cfs_slice(cpu_id, next_process);
+    }
+    context_switch(cpu_id, next_process, timeslice);
+
+    /* A migration warm-up puts off when an SRTF process finishes */
+    if (sched->scheduler_algorithm == SRTF && next_process != NULL &&
+        next_process->migration_ticks > 0) {
+        lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+        if (sched->current[cpu_id] == next_process) {
+            cpu_heap_update(&sched->running_max, cpu_id, running_key(next_process));
+        }
+        pthread_mutex_unlock(&sched->current_mutex);
+    }
+}
+
+/**
+ * schedule() is the CPU scheduler.
+ * 
+ * @param cpu_id the target cpu we decide to put our process in
+ */
+static void schedule(unsigned int cpu_id)
+{
+    pcb_t *next_process = NULL;
+
+    if (sched->per_cpu_queues) {
+        next_process = cpu_rq_pop(cpu_id, true);
+        if (next_process == NULL) {
+            next_process = steal(cpu_id);
+        }
+    } else {
+        next_process = node_rq_pop(node_of(cpu_id));
+        if (next_process == NULL) {
+            next_process = steal_remote(node_of(cpu_id));
+        }
+    }
+
+    dispatch(cpu_id, next_process);
+}
+
+/** 
+ * idle() is the idle process.  It is called by the simulator when the idle
+ * process is scheduled. This function blocks until a process is added
+ * to the ready queue.
+ *
+ * The CPU parks by setting its bit in parked_cpus and waits on its own
+ * condition variable until a waker claims it.  If work shows up before
+ * anyone claims it, it clears its own bit and schedules normally.
+ *
+ * @param cpu_id the cpu that is waiting for process to come in
+ */
+extern void idle(unsigned int cpu_id)
+{
+    cpu_rq_t *own;
+    pcb_t *handoff;
+
+    sched = simulator_scheduler_data();
+    own = &sched->cpu_rq[cpu_id];
+
+    /* There is no thread to park with the inline engine */
+    if (simulator_is_inline()) {
+        if (work_available(cpu_id)) {
+            schedule(cpu_id);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&own->mutex);
+    own->kicked = false;
+    cpumask_set_atomic(&sched->parked_cpus, cpu_id);
+
+    if (work_available(cpu_id) && cpumask_test_and_clear_atomic(&sched->parked_cpus, cpu_id)) {
+        pthread_mutex_unlock(&own->mutex);
+        schedule(cpu_id);
+        return;
+    }
+
+    /*
+     * Either nothing is queued, or a waker already claimed us: wait for it.
+     * The time parked is reported so that it is not taken for the cost of
+     * idle() itself.
+     */
+    if (own->handoff == NULL && !own->kicked) {
+        struct timespec start, end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (own->handoff == NULL && !own->kicked) {
+            pthread_cond_wait(&own->wakeup, &own->mutex);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        simulator_idle_parked((unsigned long long)(end.tv_sec - start.tv_sec) * 1000000000ull +
+                              (unsigned long long)end.tv_nsec - (unsigned long long)start.tv_nsec);
+    }
+    handoff = own->handoff;
+    own->handoff = NULL;
+    own->kicked = false;
+    pthread_mutex_unlock(&own->mutex);
+
+    if (handoff != NULL) {
+        dispatch(cpu_id, handoff);
+    } else {
+        schedule(cpu_id);
+    }
+
+    /*
+     * idle() must block when the ready queue is empty, or else the CPU threads
+     * will spin in a loop.
+     */ 
+}
+
+/**
+ * preempt() is the handler used in Round-robin (fixed and adaptive), Preemptive Priority, and SRTF scheduling.
+ *
+ * This function should place the currently running process back in the
+ * ready queue, and call schedule() to select a new runnable process.
+ * MLFQ never forces a preemption, so a process preempted under MLFQ has
+ * used its whole quantum, and moves down a level.
+ * 
+ * @param cpu_id the cpu in which we want to preempt process
+ */
+extern void preempt(unsigned int cpu_id)
+{
+    sched = simulator_scheduler_data();
+
+    lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+    pcb_t *process = sched->current[cpu_id];
+    pthread_mutex_unlock(&sched->current_mutex);
+
+    if (process != NULL) {
+        process->state = PROCESS_READY;
+        if (sched->scheduler_algorithm == MLFQ) {
+            mlfq_move(process, 1);
+        }
+        /* This CPU schedules straight away, so there is no one to wake */
+        if (sched->per_cpu_queues) {
+            cpu_rq_push(cpu_id, process);
+        } else {
+            node_rq_push(node_of(cpu_id), process);
+        }
+    }
+
+    schedule(cpu_id);
+}
+
+/**
+ * yield() is the handler called by the simulator when a process yields the
+ * CPU to perform an I/O request.
+ *
+ * @param cpu_id the cpu that is yielded by the process
+ */
+extern void yield(unsigned int cpu_id)
+{
+    sched = simulator_scheduler_data();
+
+    lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+    pcb_t *process = sched->current[cpu_id];
+    pthread_mutex_unlock(&sched->current_mutex);
+
+    if (process != NULL) {
+        process->state = PROCESS_WAITING;
+    }
+
+    schedule(cpu_id);
+}
+
+/**
+ * terminate() is the handler called by the simulator when a process completes.
+ * 
+ * @param cpu_id the cpu we want to terminate
+ */
+extern void terminate(unsigned int cpu_id)
+{
+    sched = simulator_scheduler_data();
+
+    lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+    pcb_t* process = sched->current[cpu_id];
+    set_current(cpu_id, NULL);
+    pthread_mutex_unlock(&sched->current_mutex);
+
+    if (process != NULL) {
+        process->state = PROCESS_TERMINATED;
+    }
+
+    schedule(cpu_id);
+}
+
+/**
+ * should_preempt() returns whether a woken process should preempt the one
+ * running on a CPU: whether its running_key() is lower than the CPU's key
+ * in running_max.  A process that is not running has no warm-up, so under
+ * SRTF this compares its total_time_remaining with the running process's
+ * time_to_finish().  The keys are kept under current_mutex, which must be
+ * held, so this reads nothing that the running process's own CPU changes.
+ */
+static bool should_preempt(const pcb_t *process, unsigned int cpu_id)
+{
+    return running_key(process) < cpu_heap_key(&sched->running_max, cpu_id);
+}
+
+/**
+ * pinned_victim() is find_preemption_victim() for a process with an
+ * affinity mask.  Only the CPUs in the mask count: it is not preempted
+ * while one of those is idle, and the victim is the one of them with the
+ * largest key.  Pinned processes are the exception, so the mask is scanned
+ * rather than kept in a heap of its own.  current_mutex must be held.
+ */
+static int pinned_victim(const pcb_t *process)
+{
+    unsigned long long worst = 0;
+    int target_cpu = -1;
+
+    for (int cpu_id = cpumask_first(process->affinity); cpu_id != -1;
+         cpu_id = cpumask_next(process->affinity, (unsigned int)cpu_id)) {
+        unsigned long long key;
+
+        if (cpumask_test(&sched->idle_cpus, (unsigned int)cpu_id)) {
+            return -1;
+        }
+        key = cpu_heap_key(&sched->running_max, (unsigned int)cpu_id);
+        if (target_cpu == -1 || key > worst) {
+            worst = key;
+            target_cpu = cpu_id;
+        }
+    }
+
+    return (target_cpu != -1 && should_preempt(process, (unsigned int)target_cpu)) ?
+           target_cpu : -1;
+}
+
+/**
+ * find_preemption_victim() decides whether a woken process should preempt a
+ * running one under PA or SRTF.
+ *
+ * PA compares priority_key(), which orders the same as the aged priority.
+ * SRTF compares total_time_remaining with the running process's
+ * time_to_finish(); see should_preempt().  No process is preempted while any CPU it may run on
+ * is idle.  For a process that may run anywhere the candidate is the top of
+ * running_max, so this is O(1); one with an affinity mask goes to
+ * pinned_victim().
+ *
+ * @param process the process that is waking up
+ *
+ * @return the cpu to preempt, or -1 if no CPU should be preempted
+ */
+static int find_preemption_victim(pcb_t *process)
+{
+    int target_cpu = -1;
+
+    if (sched->scheduler_algorithm != PA && sched->scheduler_algorithm != SRTF) {
+        return -1;
+    }
+
+    lock_counted(&sched->current_mutex, SIM_LOCK_CURRENT);
+    if (process->affinity != NULL) {
+        target_cpu = pinned_victim(process);
+    } else if (cpumask_first(&sched->idle_cpus) == -1) {
+        int top = cpu_heap_max(&sched->running_max);
+
+        if (top != -1 && should_preempt(process, (unsigned int)top)) {
+            target_cpu = top;
+        }
+    }
+    pthread_mutex_unlock(&sched->current_mutex);
+
+    return target_cpu;
+}
+
+/**
+ * wake_up() is the handler called by the simulator when a process's I/O
+ * request completes. 
+ * This method also handles priority and SRTF preemption.  Under MLFQ a
+ * process coming back from I/O moves up a level; a new one starts on
+ * level 0.  Under CFS, cfs_place() sets where it starts in vruntime.
+ * 
+ * @param process the process that finishes I/O and is ready to run on CPU
+ */
+extern void wake_up(pcb_t *process)
+{
+    int victim;
+
+    sched = simulator_scheduler_data();
+
+    if (process->state == PROCESS_NEW) {
+        process->affinity = affinity_of(process);
+    }
+    if (sched->scheduler_algorithm == CFS) {
+        cfs_place(process);
+    }
+    process->state = PROCESS_READY;
+    process->enqueue_time = get_current_time();
+    if (sched->scheduler_algorithm == MLFQ) {
+        mlfq_move(process, -1);
+    }
+
+    /* A parked CPU means nothing is queued and nothing needs preempting */
+    if (hand_off(process)) {
+        return;
+    }
+
+    if (sched->per_cpu_queues) {
+        /* The victim is chosen first, so the process lands on that CPU */
+        unsigned int target;
+
+        victim = find_preemption_victim(process);
+        target = select_target_cpu(victim, process);
+        cpu_rq_push(target, process);
+
+        /* The target itself may have parked since; a pinned process can't be stolen */
+        if (cpumask_test_and_clear_atomic(&sched->parked_cpus, target)) {
+            wake_parked_cpu(target, NULL);
+        } else if (process->affinity == NULL) {
+            kick_parked_cpu(node_of(target));
+        }
+    } else {
+        unsigned int node = select_target_node(process);
+
+        node_rq_push(node, process);
+        kick_parked_cpu(node);
+        victim = find_preemption_victim(process);
+    }
+
+    if (victim != -1) {
+        force_preempt((unsigned int)victim);
+    }
+}
+
+/**
+ * write_queue() writes a ready queue to a checkpoint in the order it is
+ * dequeued in.  A heap is written as its nodes as they are, so the keys
+ * and the push order of equal keys come back unchanged.
+ */
+static void write_queue(checkpoint_t *checkpoint, queue_t *queue)
+{
+    unsigned int count = 0;
+
+    if (queue->heap.key_of != NULL) {
+        checkpoint_write_u32(checkpoint, queue->heap.size);
+        checkpoint_write_u64(checkpoint, queue->heap.seq);
+        for (unsigned int i = 0; i < queue->heap.size; i++) {
+            checkpoint_write_u64(checkpoint, queue->heap.nodes[i].key.key);
+            checkpoint_write_u64(checkpoint, queue->heap.nodes[i].key.tie);
+            checkpoint_write_u64(checkpoint, queue->heap.nodes[i].seq);
+            checkpoint_write_pcb(checkpoint, queue->heap.nodes[i].pcb);
+        }
+        return;
+    }
+
+    if (queue->tree.before != NULL) {
+        for (rb_node_t *node = rb_first(&queue->tree); node != NULL; node = rb_next(node)) {
+            count++;
+        }
+        checkpoint_write_u32(checkpoint, count);
+        for (rb_node_t *node = rb_first(&queue->tree); node != NULL; node = rb_next(node)) {
+            checkpoint_write_pcb(checkpoint, rb_entry(node, pcb_t, run_node));
+        }
+        return;
+    }
+
+    for (pcb_t *process = queue->head; process != NULL; process = process->next) {
+        count++;
+    }
+    checkpoint_write_u32(checkpoint, count);
+    for (pcb_t *process = queue->head; process != NULL; process = process->next) {
+        checkpoint_write_pcb(checkpoint, process);
+    }
+}
+
+/**
+ * read_queue() reads a ready queue written by write_queue() into an empty
+ * queue of the same kind.
+ *
+ * @return the number of processes in the queue
+ */
+static unsigned int read_queue(checkpoint_t *checkpoint, queue_t *queue)
+{
+    unsigned int count = checkpoint_read_u32(checkpoint);
+
+    if (count > simulator_process_count()) {
+        checkpoint_fail(checkpoint, "checkpoint has a ready queue longer than the process slots");
+        return 0;
+    }
+
+    if (queue->heap.key_of != NULL) {
+        heap_node_t *nodes = malloc(sizeof(heap_node_t) * (count ? count : 1));
+        unsigned long seq = (unsigned long)checkpoint_read_u64(checkpoint);
+
+        assert(nodes != NULL);
+        for (unsigned int i = 0; i < count; i++) {
+            nodes[i].key.key = checkpoint_read_u64(checkpoint);
+            nodes[i].key.tie = checkpoint_read_u64(checkpoint);
+            nodes[i].seq = (unsigned long)checkpoint_read_u64(checkpoint);
+            nodes[i].pcb = checkpoint_read_pcb(checkpoint);
+            if (nodes[i].pcb == NULL) {
+                checkpoint_fail(checkpoint, "checkpoint has an empty ready queue entry");
+            }
+        }
+        if (!checkpoint->failed) {
+            heap_load(&queue->heap, nodes, count, seq);
+        }
+        free(nodes);
+        return checkpoint->failed ? 0 : count;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        pcb_t *process = checkpoint_read_pcb(checkpoint);
+
+        if (process == NULL) {
+            checkpoint_fail(checkpoint, "checkpoint has an empty ready queue entry");
+            return i;
+        }
+        queue_insert(queue, process);
+    }
+    return count;
+}
+
+/**
+ * write_config() and check_config() write and check what a checkpoint's
+ * scheduler state only makes sense with: the algorithm, the ready queues
+ * and the affinity rules.
+ */
+static void write_config(checkpoint_t *checkpoint)
+{
+    checkpoint_write_u32(checkpoint, (unsigned int)sched->scheduler_algorithm);
+    checkpoint_write_u32(checkpoint, sched->per_cpu_queues);
+    checkpoint_write_u32(checkpoint, sched->cpu_count);
+    checkpoint_write_u32(checkpoint, sched->node_count);
+    checkpoint_write_u32(checkpoint, sched->level_count);
+    checkpoint_write_u32(checkpoint, sched->affinity_count);
+    for (unsigned int i = 0; i < sched->affinity_count; i++) {
+        const affinity_t *affinity = &sched->affinity[i];
+
+        checkpoint_write_u32(checkpoint, affinity->first_pid);
+        checkpoint_write_u32(checkpoint, affinity->last_pid);
+        for (unsigned int w = 0; w < affinity->mask.word_count; w++) {
+            checkpoint_write_u64(checkpoint, affinity->mask.words[w]);
+        }
+    }
+}
+
+static void check_config(checkpoint_t *checkpoint)
+{
+    static const char *other = "checkpoint was made with another scheduler configuration";
+
+    checkpoint_expect_u32(checkpoint, (unsigned int)sched->scheduler_algorithm,
+                          "checkpoint was made with another scheduling algorithm");
+    checkpoint_expect_u32(checkpoint, sched->per_cpu_queues, other);
+    checkpoint_expect_u32(checkpoint, sched->cpu_count, other);
+    checkpoint_expect_u32(checkpoint, sched->node_count, other);
+    checkpoint_expect_u32(checkpoint, sched->level_count, other);
+    checkpoint_expect_u32(checkpoint, sched->affinity_count,
+                          "checkpoint was made with other affinity rules");
+    for (unsigned int i = 0; i < sched->affinity_count && !checkpoint->failed; i++) {
+        const affinity_t *affinity = &sched->affinity[i];
+
+        checkpoint_expect_u32(checkpoint, affinity->first_pid,
+                              "checkpoint was made with other affinity rules");
+        checkpoint_expect_u32(checkpoint, affinity->last_pid,
+                              "checkpoint was made with other affinity rules");
+        for (unsigned int w = 0; w < affinity->mask.word_count; w++) {
+            if (checkpoint_read_u64(checkpoint) != affinity->mask.words[w]) {
+                checkpoint_fail(checkpoint, "checkpoint was made with other affinity rules");
+            }
+        }
+    }
+}
+
+/**
+ * scheduler_checkpoint() writes the scheduler's state to a checkpoint:
+ * current[], running_max as it is (its order among equal keys depends on
+ * how it got there), and every ready queue in dequeue order.  idle_cpus,
+ * the queue lengths, level_mask and the affinity of each process follow
+ * from those, and nothing is parked with the inline engine.
+ *
+ * @param checkpoint the checkpoint being written
+ */
+extern void scheduler_checkpoint(checkpoint_t *checkpoint)
+{
+    sched = simulator_scheduler_data();
+
+    write_config(checkpoint);
+    checkpoint_write_u64(checkpoint, sched->min_vruntime);
+    checkpoint_write_u32(checkpoint, sched->boost_period);
+
+    for (unsigned int i = 0; i < sched->cpu_count; i++) {
+        checkpoint_write_pcb(checkpoint, sched->current[i]);
+    }
+    checkpoint_write_u32(checkpoint, sched->running_max.size);
+    for (unsigned int i = 0; i < sched->running_max.size; i++) {
+        unsigned int cpu_id = sched->running_max.cpus[i];
+
+        checkpoint_write_u32(checkpoint, cpu_id);
+        checkpoint_write_u64(checkpoint, sched->running_max.keys[cpu_id]);
+    }
+
+    if (sched->per_cpu_queues) {
+        for (unsigned int i = 0; i < sched->cpu_count; i++) {
+            write_queue(checkpoint, &sched->cpu_rq[i].queue);
+            write_queue(checkpoint, &sched->cpu_rq[i].pinned);
+        }
+    } else if (sched->scheduler_algorithm == MLFQ) {
+        for (unsigned int i = 0; i < sched->level_count; i++) {
+            write_queue(checkpoint, &sched->levels[i]);
+        }
+    } else {
+        for (unsigned int i = 0; i < sched->node_count; i++) {
+            write_queue(checkpoint, &sched->rq[i].queue);
+        }
+    }
+}
+
+/**
+ * scheduler_restore() reads the scheduler's state back from a checkpoint
+ * into a scheduler that has not run yet.  The queues are filled without
+ * touching the enqueue times the simulator has restored.
+ *
+ * @param checkpoint the checkpoint being read
+ */
+extern void scheduler_restore(checkpoint_t *checkpoint)
+{
+    unsigned int size;
+
+    sched = simulator_scheduler_data();
+
+    check_config(checkpoint);
+    if (checkpoint->failed) {
+        return;
+    }
+    sched->min_vruntime = checkpoint_read_u64(checkpoint);
+    sched->boost_period = checkpoint_read_u32(checkpoint);
+
+    for (unsigned int i = 0; i < simulator_process_count(); i++) {
+        pcb_t *process = simulator_process(i);
+
+        if (process->state != PROCESS_NEW) {
+            process->affinity = affinity_of(process);
+        }
+    }
+
+    for (unsigned int i = 0; i < sched->cpu_count; i++) {
+        sched->current[i] = checkpoint_read_pcb(checkpoint);
+        if (sched->current[i] != NULL) {
+            cpumask_clear(&sched->idle_cpus, i);
+        }
+    }
+    size = checkpoint_read_u32(checkpoint);
+    if (size > sched->cpu_count) {
+        checkpoint_fail(checkpoint, "checkpoint has more running CPUs than CPUs");
+        return;
+    }
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned int cpu_id = checkpoint_read_u32(checkpoint);
+        unsigned long long key = checkpoint_read_u64(checkpoint);
+
+        if (cpu_id >= sched->cpu_count) {
+            checkpoint_fail(checkpoint, "checkpoint has a CPU past the end of the CPUs");
+            return;
+        }
+        sched->running_max.cpus[i] = cpu_id;
+        sched->running_max.pos[cpu_id] = (int)i;
+        sched->running_max.keys[cpu_id] = key;
+    }
+    sched->running_max.size = size;
+
+    if (sched->per_cpu_queues) {
+        for (unsigned int i = 0; i < sched->cpu_count; i++) {
+            sched->cpu_rq[i].nr_queued = read_queue(checkpoint, &sched->cpu_rq[i].queue);
+            sched->cpu_rq[i].nr_pinned = read_queue(checkpoint, &sched->cpu_rq[i].pinned);
+        }
+    } else if (sched->scheduler_algorithm == MLFQ) {
+        for (unsigned int i = 0; i < sched->level_count; i++) {
+            unsigned int queued = read_queue(checkpoint, &sched->levels[i]);
+
+            if (queued > 0) {
+                sched->level_mask |= 1ull << i;
+            }
+            sched->rq[0].nr_queued += queued;
+        }
+    } else {
+        for (unsigned int i = 0; i < sched->node_count; i++) {
+            sched->rq[i].nr_queued = read_queue(checkpoint, &sched->rq[i].queue);
+        }
+    }
+}
+
+/**
+ * scheduler_create() allocates the scheduler state for one simulation.
+ *
+ * @param cpu_count the number of CPUs in the simulation
+ * @param config the scheduling algorithm and its parameters
+ */
+extern scheduler_t *scheduler_create(unsigned int cpu_count,
+                                     const scheduler_config_t *config)
+{
+    scheduler_t *scheduler = calloc(1, sizeof(scheduler_t));
+    assert(scheduler != NULL);
+
+    scheduler->scheduler_algorithm = config->algorithm;
+    scheduler->age_weight = config->age_weight;
+    scheduler->per_cpu_queues = config->per_cpu_queues && config->algorithm != MLFQ;
+    scheduler->cache_affinity = config->cache_affinity;
+    scheduler->cpu_count = cpu_count;
+    scheduler->topology = config->topology;
+    if (scheduler->topology.sockets == 0) {
+        topology_flat(&scheduler->topology, cpu_count);
+    }
+    assert(topology_cpu_count(&scheduler->topology) == cpu_count);
+    scheduler->node_count = topology_node_count(&scheduler->topology);
+    scheduler->node_cpus = cpu_count / scheduler->node_count;
+    scheduler->time_slice = config->time_slice_ms / 100;
+    if (scheduler->time_slice == 0 && config->time_slice_ms > 0) {
+        scheduler->time_slice = 1;
+    }
+
+    /* Allocate the MLFQ levels; the first boost is after boost_ticks */
+    scheduler->level_count = config->mlfq_levels ? config->mlfq_levels : MLFQ_DEFAULT_LEVELS;
+    assert(scheduler->level_count <= MLFQ_MAX_LEVELS);
+    scheduler->boost_ticks = config->mlfq_boost_ms / 100;
+    if (scheduler->boost_ticks == 0 && config->mlfq_boost_ms > 0) {
+        scheduler->boost_ticks = 1;
+    }
+    scheduler->levels = malloc(sizeof(queue_t) * scheduler->level_count);
+    assert(scheduler->levels != NULL);
+    for (unsigned int i = 0; i < scheduler->level_count; i++) {
+        queue_init(&scheduler->levels[i], NULL);
+    }
+
+    /* Build the affinity masks; they need per-CPU queues to be honoured */
+    scheduler->affinity = calloc(config->affinity_count ? config->affinity_count : 1,
+                                 sizeof(affinity_t));
+    assert(scheduler->affinity != NULL);
+    for (unsigned int i = 0; scheduler->per_cpu_queues && i < config->affinity_count; i++) {
+        const affinity_rule_t *rule = &config->affinity[i];
+        affinity_t *affinity = &scheduler->affinity[scheduler->affinity_count];
+
+        affinity->first_pid = rule->first_pid;
+        affinity->last_pid = rule->last_pid;
+        cpumask_init(&affinity->mask, cpu_count);
+        for (unsigned int cpu = rule->first_cpu; cpu <= rule->last_cpu && cpu < cpu_count; cpu++) {
+            cpumask_set(&affinity->mask, cpu);
+        }
+        if (cpumask_weight(&affinity->mask) == 0) {
+            free(affinity->mask.words);
+            continue;
+        }
+        scheduler->affinity_count++;
+    }
+
+    /* ready_key() looks at the algorithm through sched */
+    sched = scheduler;
+
+    /* Allocate the current[] array and its mutex */
+    scheduler->current = calloc(cpu_count, sizeof(pcb_t *));
+    assert(scheduler->current != NULL);
+    cpumask_init(&scheduler->idle_cpus, cpu_count);
+    for (unsigned int i = 0; i < cpu_count; i++) {
+        cpumask_set(&scheduler->idle_cpus, i);
+    }
+    cpu_heap_init(&scheduler->running_max, cpu_count);
+    pthread_mutex_init(&scheduler->current_mutex, NULL);
+
+    /* Allocate the shared ready queue of each node */
+    scheduler->rq = malloc(sizeof(node_rq_t) * scheduler->node_count);
+    assert(scheduler->rq != NULL);
+    for (unsigned int i = 0; i < scheduler->node_count; i++) {
+        ready_queue_init(&scheduler->rq[i].queue);
+        pthread_mutex_init(&scheduler->rq[i].mutex, NULL);
+        scheduler->rq[i].nr_queued = 0;
+    }
+
+    /* Allocate the per-CPU state and ready queues */
+    cpumask_init(&scheduler->parked_cpus, cpu_count);
+    scheduler->cpu_rq = malloc(sizeof(cpu_rq_t) * cpu_count);
+    assert(scheduler->cpu_rq != NULL);
+    for (unsigned int i = 0; i < cpu_count; i++) {
+        ready_queue_init(&scheduler->cpu_rq[i].queue);
+        ready_queue_init(&scheduler->cpu_rq[i].pinned);
+        pthread_mutex_init(&scheduler->cpu_rq[i].mutex, NULL);
+        pthread_cond_init(&scheduler->cpu_rq[i].wakeup, NULL);
+        scheduler->cpu_rq[i].nr_queued = 0;
+        scheduler->cpu_rq[i].nr_pinned = 0;
+        scheduler->cpu_rq[i].handoff = NULL;
+        scheduler->cpu_rq[i].kicked = false;
+    }
+
+    return scheduler;
+}
+
+/**
+ * scheduler_destroy() frees the scheduler state of a finished simulation.
+ * Its CPUs must no longer be running, so this is only used with the inline
+ * engine.
+ *
+ * @param scheduler the scheduler made by scheduler_create()
+ */
+extern void scheduler_destroy(scheduler_t *scheduler)
+{
+    for (unsigned int i = 0; i < scheduler->cpu_count; i++) {
+        heap_destroy(&scheduler->cpu_rq[i].queue.heap);
+        heap_destroy(&scheduler->cpu_rq[i].pinned.heap);
+        pthread_mutex_destroy(&scheduler->cpu_rq[i].mutex);
+        pthread_cond_destroy(&scheduler->cpu_rq[i].wakeup);
+    }
+    free(scheduler->cpu_rq);
+    for (unsigned int i = 0; i < scheduler->affinity_count; i++) {
+        free(scheduler->affinity[i].mask.words);
+    }
+    free(scheduler->affinity);
+    free(scheduler->levels);
+    free(scheduler->parked_cpus.words);
+    for (unsigned int i = 0; i < scheduler->node_count; i++) {
+        heap_destroy(&scheduler->rq[i].queue.heap);
+        pthread_mutex_destroy(&scheduler->rq[i].mutex);
+    }
+    free(scheduler->rq);
+    pthread_mutex_destroy(&scheduler->current_mutex);
+    cpu_heap_destroy(&scheduler->running_max);
+    free(scheduler->idle_cpus.words);
+    free(scheduler->current);
+    if (sched == scheduler) {
+        sched = NULL;
+    }
+    free(scheduler);
+}
+
+/**
+ * scheduler_algorithm_name() returns the name of an algorithm, as used in
+ * sweep and benchmark results.
+ */
+extern const char *scheduler_algorithm_name(sched_algorithm_t algorithm)
+{
+    switch (algorithm) {
+    case PA:
+        return "PA";
+    case RR:
+        return "RR";
+    case SRTF:
+        return "SRTF";
+    case MLFQ:
+        return "MLFQ";
+    case CFS:
+        return "CFS";
+    case ARR:
+        return "ARR";
+    default:
+        return "FCFS";
+    }
+}
+
+/**
+ * parse_io_devices() parses a comma-separated list of I/O devices, each
+ * fifo or sstf with an optional :channels and then an optional @node,
+ * e.g. "fifo,sstf,fifo:8@1".
+ *
+ * @return the devices, or NULL if spec is not valid
+ */
+static io_device_config_t *parse_io_devices(const char *spec, unsigned int *count)
+{
+    io_device_config_t *devices;
+    const char *text = spec;
+    unsigned int n = 1;
+
+    for (const char *c = spec; *c != '\0'; c++) {
+        n += (*c == ',');
+    }
+    devices = calloc(n, sizeof(io_device_config_t));
+    assert(devices != NULL);
+
+    for (*count = 0; *count < n; (*count)++) {
+        io_device_config_t *device = &devices[*count];
+        char *end;
+
+        if (strncmp(text, "fifo", 4) == 0) {
+            device->discipline = IO_FIFO;
+        } else if (strncmp(text, "sstf", 4) == 0) {
+            device->discipline = IO_SHORTEST_FIRST;
+        } else {
+            break;
+        }
+        text += 4;
+
+        device->channels = 1;
+        if (*text == ':') {
+            unsigned long channels = strtoul(text + 1, &end, 10);
+            if (end == text + 1 || channels == 0 || channels > 0xffffffffUL) {
+                break;
+            }
+            device->channels = (unsigned int)channels;
+            text = end;
+        }
+
+        if (*text == '@') {
+            unsigned long node = strtoul(text + 1, &end, 10);
+            if (end == text + 1 || node > 0xffffUL) {
+                break;
+            }
+            device->node = (unsigned int)node;
+            text = end;
+        }
+
+        if (*text == ',') {
+            text++;
+        } else if (*text != '\0') {
+            break;
+        }
+    }
+
+    if (*count != n) {
+        free(devices);
+        return NULL;
+    }
+    return devices;
+}
+
+/**
+ * parse_id_range() parses "n" or "first-last" from the start of text.
+ *
+ * @return the end of the range, or NULL if there is no valid range
+ */
+static const char *parse_id_range(const char *text, unsigned int *first, unsigned int *last)
+{
+    char *end;
+    unsigned long value = strtoul(text, &end, 10);
+
+    if (end == text || value > 0xffffffffUL) {
+        return NULL;
+    }
+    *first = *last = (unsigned int)value;
+    if (*end == '-') {
+        text = end + 1;
+        value = strtoul(text, &end, 10);
+        if (end == text || value > 0xffffffffUL || value < *first) {
+            return NULL;
+        }
+        *last = (unsigned int)value;
+    }
+    return end;
+}
+
+/**
+ * parse_uint() parses text, all of it, as a decimal number.
+ *
+ * @return false if text is not a number that fits an unsigned int
+ */
+static bool parse_uint(const char *text, unsigned int *value)
+{
+    char *end;
+    unsigned long parsed = strtoul(text, &end, 10);
+
+    if (end == text || *end != '\0' || *text == '-' || parsed > 0xffffffffUL) {
+        return false;
+    }
+    *value = (unsigned int)parsed;
+    return true;
+}
+
+/**
+ * parse_affinity() parses an affinity rule, <pids>:<cpus> with each a
+ * number or a first-last range, e.g. "0-99:0-3".
+ *
+ * @return false if spec is not a valid rule
+ */
+static bool parse_affinity(const char *spec, affinity_rule_t *rule)
+{
+    const char *text = parse_id_range(spec, &rule->first_pid, &rule->last_pid);
+
+    if (text == NULL || *text != ':') {
+        return false;
+    }
+    text = parse_id_range(text + 1, &rule->first_cpu, &rule->last_cpu);
+    return text != NULL && *text == '\0';
+}
+
+/**
+ * add_axis() adds an algorithm flag to the sweep, if there is room.
+ *
+ * @return false if there are already SWEEP_MAX_AXES algorithm flags
+ */
+static bool add_axis(sweep_t *sweep, sched_algorithm_t algorithm,
+                     const sweep_range_t *param)
+{
+    if (sweep->axis_count == SWEEP_MAX_AXES) {
+        fprintf(stderr, "Error: At most %d algorithm options are allowed.\n",
+                SWEEP_MAX_AXES);
+        return false;
+    }
+    sweep->axes[sweep->axis_count].algorithm = algorithm;
+    sweep->axes[sweep->axis_count].param = *param;
+    sweep->axis_count++;
+    return true;
+}
+
+/**
+ * has_axis() returns true if the sweep runs an algorithm.
+ */
+static bool has_axis(const sweep_t *sweep, sched_algorithm_t algorithm)
+{
+    for (unsigned int n = 0; n < sweep->axis_count; n++) {
+        if (sweep->axes[n].algorithm == algorithm) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * main() simply parses command line arguments, then calls start_simulator(),
+ * or run_sweep() when any of them asks for more than one simulation, or
+ * run_bench() for --bench.
+ */
+int main(int argc, char *argv[])
+{
+    simulator_options_t options = { .engine = ENGINE_THREADS, .fast_forward = false };
+    sweep_t sweep = { .axis_count = 0, .per_cpu_queues = false, .jobs = 0,
+                      .mlfq_levels = MLFQ_DEFAULT_LEVELS,
+                      .mlfq_boost_ms = MLFQ_DEFAULT_BOOST_MS };
+    sweep_range_t range;
+    bool is_sweep;
+    const char *workload_path = NULL, *write_path = NULL;
+    bool generate = false;
+    generator_config_t generator;
+    workload_t workload;
+    workload_stream_t stream;
+    affinity_rule_t *affinity = NULL;
+
+    if (argc < 2) {
+        fprintf(stderr, "Multithreaded OS Simulator\n"
+                        "Usage: ./os-sim <# CPUs | topology> [ -r <time slice> | -p <age weight> | -s | -m <quantum> |\n"
+                        "                          -c <latency> | -a <time slice> ] [options]\n"
+                        "    Default : FCFS Scheduler\n"
+                        "         -r : Round-Robin Scheduler\n"
+                        "         -p : Priority Aging Scheduler\n"
+                        "         -s : Shortest Remaining Time First\n"
+                        "         -m : Multi-Level Feedback Queue, with the top level's quantum\n"
+                        "         -c : Completely Fair Scheduler, with the target latency\n"
+                        "         -a : Adaptive Round-Robin, with the base time slice; each process's\n"
+                        "              slice follows an average of its CPU bursts\n"
+                        "    Topology:\n"
+                        "         <sockets>x<cores>x<threads>, e.g. 2x4x2, in place of the # of CPUs;\n"
+                        "         each socket is a NUMA node with its own ready queue\n"
+                        "    Options:\n"
+                        "         --per-cpu-queues : one ready queue per CPU, with work stealing (not\n"
+                        "                            with -m)\n"
+                        "         --affinity <pids>:<cpus> : run processes only on the given CPUs, e.g.\n"
+                        "                            0-99:0-3; may be repeated, and needs --per-cpu-queues\n"
+                        "         --cache-affinity : prefer the CPU a process last ran on\n"
+                        "         --migration-cost <ticks> : ticks a process loses on moving to another core\n"
+                        "         --remote-cost <ticks> : extra ticks of moving to, or doing I/O on a device\n"
+                        "                            of, another node\n"
+                        "         --mlfq-levels <n> : the number of MLFQ levels, 1 to 64 (default 8)\n"
+                        "         --mlfq-boost <ms> : the time between MLFQ priority boosts, 0 for none\n"
+                        "                            (default 5000)\n"
+                        "         --fast-forward   : jump over ticks in which nothing happens\n"
+                        "         --engine <threads|inline|batched> : run CPUs on their own threads\n"
+                        "                            (default), every callback inline on one thread, or\n"
+                        "                            on threads with each tick's events dispatched together\n"
+                        "         --workload <file> : simulate the processes in a workload file, binary\n"
+                        "                            or text (name,priority,arrival,cpu,io,...,cpu), or\n"
+                        "                            - for text on stdin.  Outside sweeps, each process\n"
+                        "                            is read as it arrives, so the file can be endless\n");
+        fprintf(stderr, "         --generate <key=value,...> : simulate a synthetic workload, e.g.\n"
+                        "                            count=100000,seed=7,cpu-bound=0.3,arrival=2,\n"
+                        "                            bursts=uniform:5:25,io-io=pareto:4:1.5 (see generator.h)\n"
+                        "         --write-workload <file> : write the workload in the binary format and exit\n"
+                        "         --io-devices <list> : I/O devices, each fifo or sstf (shortest first) with\n"
+                        "                            an optional :channels and @node, e.g. fifo,sstf:2@1.\n"
+                        "                            An I/O burst for device d goes to device d mod the count\n"
+                        "         --gantt <full|off|changes|buffered> : a Gantt line every tick\n"
+                        "                            (default), none, only when a CPU changes process,\n"
+                        "                            or every tick written out by a separate thread\n"
+                        "         --trace <file>   : record every scheduling event in a binary trace\n"
+                        "         --pace <realtime|unthrottled|speed> : run ticks at 100ms of wall-clock\n"
+                        "                            time, with no sleeping at all, or speed times\n"
+                        "                            faster than real time (e.g. 10)\n"
+                        "         --checkpoint <tick>:<file> : write the whole simulation state to file\n"
+                        "                            at the start of tick, and carry on\n"
+                        "         --restore <file> : start from a checkpoint instead of tick 0, with the\n"
+                        "                            same workload, CPUs, I/O devices and scheduler.\n"
+                        "                            Both need --engine inline\n"
+                        "         --metrics <file>[:<ms>] : write live metrics to file, in the Prometheus\n"
+                        "                            text format, every ms of wall-clock time (default\n"
+                        "                            1000) and once more at the end\n"
+                        "    Sweeps:\n"
+                        "         The # of CPUs and each algorithm's parameter also take a range,\n"
+                        "         first:last[:step], and several algorithm options may be given.\n"
+                        "         Every combination is run with the inline engine and one table\n"
+                        "         of results is printed.\n"
+                        "         --jobs <n>       : run the sweep on n threads (default: one per core)\n"
+                        "    Benchmark:\n"
+                        "         ./os-sim --bench [quick] [--per-cpu-queues] runs every algorithm over\n"
+                        "         generated workloads of 8 to 100000 processes on 1 to 256 CPUs (up to\n"
+                        "         10000 and 64 with quick) and prints the scheduler's cost as CSV;\n"
+                        "         --per-cpu-queues leaves out MLFQ\n");
+        return -1;
+    }
+
+    if (strcmp(argv[1], "--bench") == 0) {
+        bench_t bench = { .quick = false, .per_cpu_queues = false };
+
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "quick") == 0) {
+                bench.quick = true;
+            } else if (strcmp(argv[i], "--per-cpu-queues") == 0) {
+                bench.per_cpu_queues = true;
+            } else {
+                fprintf(stderr, "Error: Invalid benchmark option: %s\n", argv[i]);
+                return -1;
+            }
+        }
+        return run_bench(&bench);
+    }
+
+    /* Parse the command line arguments */
+    if (strchr(argv[1], 'x') != NULL) {
+        if (!topology_parse(argv[1], &options.topology)) {
+            fprintf(stderr, "Error: Invalid topology specified.\n");
+            return -1;
+        }
+        sweep.cpus.first = sweep.cpus.last = topology_cpu_count(&options.topology);
+        sweep.cpus.step = 1;
+    } else if (!parse_sweep_range(argv[1], &sweep.cpus) || sweep.cpus.first == 0) {
+        fprintf(stderr, "Error: Invalid number of CPUs specified.\n");
+        return -1;
     }
 
-    if (argc > 2) {
-        if (strcmp(argv[2], "-r") == 0) {
-            if (argc != 4) {
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            if (i + 1 >= argc) {
                  fprintf(stderr, "Error: -r option requires a timeslice value.\n");
                  return -1;
             }
-            scheduler_algorithm = RR;
-            unsigned int timeslice_ms = strtoul(argv[3], NULL, 0);
-            if (timeslice_ms == 0) {
+            if (!parse_sweep_range(argv[++i], &range) || range.first == 0) {
                  fprintf(stderr, "Error: Invalid time slice specified for -r.\n");
                  return -1;
             }
-            time_slice = timeslice_ms / 100;
-            if (time_slice == 0 && timeslice_ms > 0) {
-                time_slice = 1;
+            if (!add_axis(&sweep, RR, &range)) {
+                 return -1;
+            }
+        } else if (strcmp(argv[i], "-a") == 0) {
+            if (i + 1 >= argc) {
+                 fprintf(stderr, "Error: -a option requires a timeslice value.\n");
+                 return -1;
+            }
+            if (!parse_sweep_range(argv[++i], &range) || range.first == 0) {
+                 fprintf(stderr, "Error: Invalid time slice specified for -a.\n");
+                 return -1;
+            }
+            if (!add_axis(&sweep, ARR, &range)) {
+                 return -1;
             }
-        } else if (strcmp(argv[2], "-p") == 0) {
-             if (argc != 4) {
+        } else if (strcmp(argv[i], "-p") == 0) {
+             if (i + 1 >= argc) {
                  fprintf(stderr, "Error: -p option requires an age weight value.\n");
                  return -1;
              }
-             scheduler_algorithm = PA;
-             age_weight = strtoul(argv[3], NULL, 0);
-        } else if (strcmp(argv[2], "-s") == 0) {
-            if (argc != 3) {
-                fprintf(stderr, "Error: -s option does not take any arguments.\n");
+             if (!parse_sweep_range(argv[++i], &range)) {
+                 fprintf(stderr, "Error: Invalid age weight specified for -p.\n");
+                 return -1;
+             }
+             if (!add_axis(&sweep, PA, &range)) {
+                 return -1;
+             }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -m option requires a quantum value.\n");
+                return -1;
+            }
+            if (!parse_sweep_range(argv[++i], &range) || range.first == 0) {
+                fprintf(stderr, "Error: Invalid quantum specified for -m.\n");
+                return -1;
+            }
+            if (!add_axis(&sweep, MLFQ, &range)) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-c") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -c option requires a target latency value.\n");
+                return -1;
+            }
+            if (!parse_sweep_range(argv[++i], &range) || range.first == 0) {
+                fprintf(stderr, "Error: Invalid target latency specified for -c.\n");
+                return -1;
+            }
+            if (!add_axis(&sweep, CFS, &range)) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--mlfq-levels") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --mlfq-levels option requires a level count.\n");
+                return -1;
+            }
+            if (!parse_uint(argv[++i], &sweep.mlfq_levels) ||
+                sweep.mlfq_levels == 0 || sweep.mlfq_levels > MLFQ_MAX_LEVELS) {
+                fprintf(stderr, "Error: Invalid level count specified for --mlfq-levels.\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--mlfq-boost") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --mlfq-boost option requires a time in ms.\n");
+                return -1;
+            }
+            if (!parse_uint(argv[++i], &sweep.mlfq_boost_ms)) {
+                fprintf(stderr, "Error: Invalid boost interval specified for --mlfq-boost.\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-s") == 0) {
+             range = (sweep_range_t){ .first = 0, .last = 0, .step = 1 };
+             if (!add_axis(&sweep, SRTF, &range)) {
+                 return -1;
+             }
+        } else if (strcmp(argv[i], "--per-cpu-queues") == 0) {
+             sweep.per_cpu_queues = true;
+        } else if (strcmp(argv[i], "--affinity") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --affinity option requires <pids>:<cpus>.\n");
+                return -1;
+            }
+            affinity = realloc(affinity, sizeof(affinity_rule_t) * (sweep.affinity_count + 1));
+            assert(affinity != NULL);
+            if (!parse_affinity(argv[++i], &affinity[sweep.affinity_count])) {
+                fprintf(stderr, "Error: Invalid affinity rule: %s\n", argv[i]);
+                return -1;
+            }
+            sweep.affinity = affinity;
+            sweep.affinity_count++;
+        } else if (strcmp(argv[i], "--cache-affinity") == 0) {
+            sweep.cache_affinity = true;
+        } else if (strcmp(argv[i], "--migration-cost") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --migration-cost option requires a tick count.\n");
+                return -1;
+            }
+            if (!parse_uint(argv[++i], &options.migration_cost)) {
+                fprintf(stderr, "Error: Invalid migration cost specified for --migration-cost.\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--remote-cost") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --remote-cost option requires a tick count.\n");
+                return -1;
+            }
+            if (!parse_uint(argv[++i], &options.remote_cost)) {
+                fprintf(stderr, "Error: Invalid remote cost specified for --remote-cost.\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--fast-forward") == 0) {
+             options.fast_forward = true;
+        } else if (strcmp(argv[i], "--engine") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --engine option requires threads, inline or batched.\n");
+                return -1;
+            }
+            i++;
+            if (strcmp(argv[i], "threads") == 0) {
+                options.engine = ENGINE_THREADS;
+            } else if (strcmp(argv[i], "inline") == 0) {
+                options.engine = ENGINE_INLINE;
+            } else if (strcmp(argv[i], "batched") == 0) {
+                options.engine = ENGINE_BATCHED;
+            } else {
+                fprintf(stderr, "Error: Invalid engine: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--workload") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --workload option requires a file.\n");
+                return -1;
+            }
+            workload_path = argv[++i];
+        } else if (strcmp(argv[i], "--generate") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --generate option requires generator settings.\n");
+                return -1;
+            }
+            if (!generate) {
+                generator_defaults(&generator);
+                generate = true;
+            }
+            if (!generator_parse(&generator, argv[++i])) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--io-devices") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --io-devices option requires a device list.\n");
+                return -1;
+            }
+            options.io_devices = parse_io_devices(argv[++i], &options.io_device_count);
+            if (options.io_devices == NULL) {
+                fprintf(stderr, "Error: Invalid I/O devices: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--write-workload") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --write-workload option requires a file.\n");
+                return -1;
+            }
+            write_path = argv[++i];
+        } else if (strcmp(argv[i], "--gantt") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --gantt option requires full, off, changes or buffered.\n");
+                return -1;
+            }
+            i++;
+            if (strcmp(argv[i], "full") == 0) {
+                options.gantt = GANTT_FULL;
+            } else if (strcmp(argv[i], "off") == 0) {
+                options.gantt = GANTT_OFF;
+            } else if (strcmp(argv[i], "changes") == 0) {
+                options.gantt = GANTT_CHANGES;
+            } else if (strcmp(argv[i], "buffered") == 0) {
+                options.gantt = GANTT_BUFFERED;
+            } else {
+                fprintf(stderr, "Error: Invalid Gantt mode: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --trace option requires a file.\n");
+                return -1;
+            }
+            options.trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--pace") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --pace option requires realtime, unthrottled or a speed.\n");
+                return -1;
+            }
+            i++;
+            if (strcmp(argv[i], "realtime") == 0) {
+                options.pacing = PACE_REALTIME;
+            } else if (strcmp(argv[i], "unthrottled") == 0) {
+                options.pacing = PACE_UNTHROTTLED;
+            } else {
+                char *end;
+                options.pacing = PACE_SCALED;
+                options.pace_scale = strtod(argv[i], &end);
+                if (end == argv[i] || *end != '\0' || !(options.pace_scale > 0.0)) {
+                    fprintf(stderr, "Error: Invalid pace: %s\n", argv[i]);
+                    return -1;
+                }
+            }
+        } else if (strcmp(argv[i], "--checkpoint") == 0) {
+            char *end;
+            unsigned long tick;
+
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --checkpoint option requires <tick>:<file>.\n");
+                return -1;
+            }
+            i++;
+            tick = strtoul(argv[i], &end, 10);
+            if (end == argv[i] || *end != ':' || end[1] == '\0' || tick > 0xffffffffUL) {
+                fprintf(stderr, "Error: Invalid checkpoint: %s\n", argv[i]);
+                return -1;
+            }
+            options.checkpoint_at = (unsigned int)tick;
+            options.checkpoint_path = end + 1;
+        } else if (strcmp(argv[i], "--restore") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --restore option requires a file.\n");
+                return -1;
+            }
+            options.restore_path = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            char *colon;
+
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --metrics option requires <file>[:<ms>].\n");
+                return -1;
+            }
+            options.metrics_path = argv[++i];
+            colon = strrchr(argv[i], ':');
+            if (colon != NULL) {
+                char *end;
+                unsigned long interval = strtoul(colon + 1, &end, 10);
+
+                if (colon == argv[i] || end == colon + 1 || *end != '\0' ||
+                    interval == 0 || interval > 0xffffffffUL) {
+                    fprintf(stderr, "Error: Invalid metrics interval: %s\n", argv[i]);
+                    return -1;
+                }
+                *colon = '\0';
+                options.metrics_interval_ms = (unsigned int)interval;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --jobs option requires a thread count.\n");
+                return -1;
+            }
+            sweep.jobs = (unsigned int)strtoul(argv[++i], NULL, 0);
+            if (sweep.jobs == 0) {
+                fprintf(stderr, "Error: Invalid thread count specified for --jobs.\n");
                 return -1;
             }
-             scheduler_algorithm = SRTF;
         } else {
-            fprintf(stderr, "Error: Invalid scheduling algorithm option: %s\n", argv[2]);
+            fprintf(stderr, "Error: Invalid option: %s\n", argv[i]);
             return -1;
         }
     }
 
-    /* Allocate the current[] array and its mutex */
-    current = malloc(sizeof(pcb_t *) * cpu_count);
-    assert(current != NULL);
-    pthread_mutex_init(&current_mutex, NULL);
-    pthread_mutex_init(&queue_mutex, NULL);
-    pthread_cond_init(&queue_not_empty, NULL);
-    rq = (queue_t *)malloc(sizeof(queue_t));
-    assert(rq != NULL);
+    /* MLFQ keeps its levels shared, so it has no per-CPU queues */
+    if (sweep.affinity_count > 0 && has_axis(&sweep, MLFQ)) {
+        fprintf(stderr, "Error: --affinity cannot be used with -m.\n");
+        return -1;
+    }
+    if (sweep.per_cpu_queues && has_axis(&sweep, MLFQ)) {
+        fprintf(stderr, "Error: --per-cpu-queues cannot be used with -m.\n");
+        return -1;
+    }
+    if (sweep.affinity_count > 0 && !sweep.per_cpu_queues) {
+        fprintf(stderr, "Error: --affinity needs --per-cpu-queues.\n");
+        return -1;
+    }
+
+    if (sweep.axis_count == 0) {
+        range = (sweep_range_t){ .first = 0, .last = 0, .step = 1 };
+        add_axis(&sweep, FCFS, &range);
+    }
+
+    is_sweep = sweep.axis_count > 1 || !sweep_range_is_single(&sweep.cpus) ||
+               !sweep_range_is_single(&sweep.axes[0].param);
+
+    /*
+     * Load or generate the workload, or use the built-in processes[] table.
+     * A single simulation reads a workload file as a stream instead, one
+     * process at a time as it arrives; a sweep runs it many times over.
+     */
+    if (workload_path != NULL && generate) {
+        fprintf(stderr, "Error: --workload and --generate cannot be used together.\n");
+        return -1;
+    } else if (generate) {
+        generate_workload(&workload, &generator);
+    } else if (workload_path != NULL && !is_sweep && write_path == NULL) {
+        if (!workload_stream_open(&stream, workload_path)) {
+            return -1;
+        }
+        options.workload_stream = &stream;
+    } else if (workload_path != NULL) {
+        if (!workload_load(&workload, workload_path)) {
+            return -1;
+        }
+    } else {
+        workload_copy(&workload, processes, PROCESS_COUNT);
+    }
+    if (write_path != NULL) {
+        return workload_write_binary(&workload, write_path) ? 0 : -1;
+    }
+    if (options.workload_stream == NULL) {
+        options.workload = &workload;
+    }
+
+    if (is_sweep) {
+        if (options.checkpoint_path != NULL || options.restore_path != NULL) {
+            fprintf(stderr, "Error: --checkpoint and --restore cannot be used in a sweep.\n");
+            return -1;
+        }
+        if (options.metrics_path != NULL) {
+            fprintf(stderr, "Error: --metrics cannot be used in a sweep.\n");
+            return -1;
+        }
+        if (options.trace_path != NULL) {
+            fprintf(stderr, "Error: --trace cannot be used in a sweep.\n");
+            return -1;
+        }
+        sweep.options = options;
+        if (sweep.jobs == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            sweep.jobs = cores > 0 ? (unsigned int)cores : 1;
+        }
+        return run_sweep(&sweep);
+    }
+
+    scheduler_config_t config = {
+        .algorithm = sweep.axes[0].algorithm,
+        .age_weight = (sweep.axes[0].algorithm == PA) ? sweep.axes[0].param.first : 0,
+        .time_slice_ms = (sweep.axes[0].algorithm == RR || sweep.axes[0].algorithm == ARR ||
+                          sweep.axes[0].algorithm == MLFQ || sweep.axes[0].algorithm == CFS) ?
+                         sweep.axes[0].param.first : 0,
+        .per_cpu_queues = sweep.per_cpu_queues,
+        .mlfq_levels = sweep.mlfq_levels,
+        .mlfq_boost_ms = sweep.mlfq_boost_ms,
+        .cache_affinity = sweep.cache_affinity,
+        .affinity = sweep.affinity,
+        .affinity_count = sweep.affinity_count,
+        .topology = options.topology
+    };
 
     /* Start the simulator in the library */
-    start_simulator(cpu_count);
+    start_simulator(sweep.cpus.first, &options,
+                    scheduler_create(sweep.cpus.first, &config), NULL);
+    if (options.workload_stream != NULL) {
+        workload_stream_close(options.workload_stream);
+    }
 
     return 0;
 }
@@ -5,25 +5,161 @@
 
 #pragma once
 
+#include <pthread.h>
+
+#include "checkpoint.h"
 #include "os-sim.h"
 #include "stdbool.h"
+#include "heap.h"
 
-/* Ready queue struct definition */
+/*
+ * Ready queue struct definition
+ *
+ * When heap.key_of is NULL the queue is a plain FIFO linked list through
+ * head and tail.  Otherwise the processes are kept in heap, and dequeue()
+ * returns the process with the lowest key.
+ *
+ * For CFS, tree.before is set instead, and the processes are kept in a
+ * red-black tree through their run_node, ordered on vruntime.  load is
+ * then the sum of their weights; it is only accessed with atomic builtins,
+ * so that it can be read without the queue's lock.
+ */
 typedef struct
 {
     pcb_t *head;
     pcb_t *tail;
+    pcb_heap_t heap;
+    rb_tree_t tree;
+    unsigned long long load;
 } queue_t;
 
+/*
+ * Per-CPU scheduler state.
+ *
+ * queue is the CPU's own ready queue, used with --per-cpu-queues.
+ * pinned holds the queued processes that have an affinity mask; only this
+ * CPU takes from it, so they are never stolen, and it takes from whichever
+ * of the two queues has the process that comes first.  nr_queued and
+ * nr_pinned count the processes in each, and are read by other CPUs
+ * without taking mutex, so they are only accessed with atomic builtins.
+ *
+ * handoff and kicked are how another thread wakes this CPU while it is
+ * parked in idle(): either a process is handed straight to it, or it is
+ * told to look at the ready queues again.  Both are protected by mutex and
+ * signalled on wakeup.
+ */
+typedef struct
+{
+    queue_t queue;
+    queue_t pinned;
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeup;
+    unsigned int nr_queued;
+    unsigned int nr_pinned;
+    pcb_t *handoff;
+    bool kicked;
+} cpu_rq_t;
+
+/*
+ * Per-node scheduler state.
+ *
+ * queue is the shared ready queue of the CPUs of a NUMA node, used without
+ * --per-cpu-queues, and protected by mutex.  nr_queued counts the processes
+ * in it, and is read by CPUs of other nodes without taking mutex, so it is
+ * only accessed with atomic builtins.
+ */
+typedef struct
+{
+    queue_t queue;
+    pthread_mutex_t mutex;
+    unsigned int nr_queued;
+} node_rq_t;
+
 /* Type of scheduling algorithm */
 typedef enum sched_algorithm_type
 {
     FCFS = 0x00,
     PA = 0x01,
     RR = 0x02,
-    SRTF = 0x03
+    SRTF = 0x03,
+    MLFQ = 0x04,
+    CFS = 0x05,
+    ARR = 0x06
 } sched_algorithm_t;
 
+/* MLFQ levels: the default and the most there can be (one bit each) */
+#define MLFQ_DEFAULT_LEVELS 8
+#define MLFQ_MAX_LEVELS 64
+
+/* The default time between MLFQ priority boosts, in milliseconds */
+#define MLFQ_DEFAULT_BOOST_MS 5000
+
+/* The longest adaptive RR time slice, in base time slices */
+#define ARR_MAX_SLICES 4
+
+/*
+ * An affinity rule: the processes from first_pid to last_pid may only run
+ * on the CPUs from first_cpu to last_cpu.  CPUs past the end of the
+ * simulation are left out, and a rule left with no CPUs does nothing.
+ */
+typedef struct
+{
+    unsigned int first_pid;
+    unsigned int last_pid;
+    unsigned int first_cpu;
+    unsigned int last_cpu;
+} affinity_rule_t;
+
+/*
+ * Scheduler configuration
+ *
+ *        algorithm : the scheduling algorithm
+ *       age_weight : the age weight for PA
+ *    time_slice_ms : the time slice in milliseconds for RR, the base time
+ *                    slice for ARR, the quantum of the top level for MLFQ,
+ *                    and the target latency for CFS; it is rounded down to
+ *                    whole 100ms ticks, but is at least one tick
+ *   per_cpu_queues : one ready queue per CPU, with work stealing; MLFQ
+ *                    always uses its shared levels
+ *      mlfq_levels : the number of MLFQ levels, 1 to MLFQ_MAX_LEVELS, or 0
+ *                    for MLFQ_DEFAULT_LEVELS
+ *    mlfq_boost_ms : the time between MLFQ priority boosts in milliseconds,
+ *                    or 0 for none
+ *   cache_affinity : prefer to run a process on the CPU it last ran on,
+ *                    whose caches are still warm
+ *         affinity : affinity rules, the first one that matches a process
+ *                    giving its affinity mask; they are only applied with
+ *                    per-CPU queues
+ *   affinity_count : the number of affinity rules
+ *         topology : the sockets, cores and SMT threads of the CPUs, each
+ *                    socket being a NUMA node with its own shared ready
+ *                    queue; sockets 0 for a flat machine of one node
+ */
+typedef struct
+{
+    sched_algorithm_t algorithm;
+    unsigned int age_weight;
+    unsigned int time_slice_ms;
+    bool per_cpu_queues;
+    unsigned int mlfq_levels;
+    unsigned int mlfq_boost_ms;
+    bool cache_affinity;
+    const affinity_rule_t *affinity;
+    unsigned int affinity_count;
+    cpu_topology_t topology;
+} scheduler_config_t;
+
+/*
+ * All the state of the scheduler for one simulation.  It is passed to
+ * start_simulator() as its scheduler_data.
+ */
+typedef struct scheduler scheduler_t;
+
+extern scheduler_t *scheduler_create(unsigned int cpu_count,
+                                     const scheduler_config_t *config);
+extern void scheduler_destroy(scheduler_t *scheduler);
+extern const char *scheduler_algorithm_name(sched_algorithm_t algorithm);
+
 /* Scheduling function declarations */
 extern void idle(unsigned int cpu_id);
 extern void preempt(unsigned int cpu_id);
@@ -31,9 +167,21 @@ extern void yield(unsigned int cpu_id);
 extern void terminate(unsigned int cpu_id);
 extern void wake_up(pcb_t *process);
 
+/*
+ * Checkpoint function declarations.  The simulator calls these with the
+ * inline engine, between ticks, to write the scheduler's part of a
+ * checkpoint after its own and to read it back; see checkpoint.h.
+ * scheduler_restore() fails the checkpoint if it was made with another
+ * algorithm, other ready queues or other affinity rules.
+ */
+extern void scheduler_checkpoint(checkpoint_t *checkpoint);
+extern void scheduler_restore(checkpoint_t *checkpoint);
+
 /* Ready queue function declarations */
+void queue_init(queue_t *queue, pcb_key_t key_of);
 void enqueue(queue_t *queue, pcb_t *process);
 pcb_t *dequeue(queue_t *queue);
+pcb_t *queue_peek(queue_t *queue);
 bool is_empty(queue_t *queue);
 
 /* Priority aging algorithm function declarations */
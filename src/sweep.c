@@ -0,0 +1,224 @@
+/*
+ * sweep.c
+ *
+ * Runs a sweep of simulations on a pool of worker threads.
+ *
+ * Every simulation keeps its state in its own simulator_t and scheduler_t,
+ * so the runs are independent.  Each one uses the inline engine, which
+ * keeps the whole simulation on the worker thread that runs it, with
+ * fast-forward on and the Gantt chart off.  The results are stored by job
+ * index and printed in a fixed order once every job is done, so the output
+ * does not depend on the number of workers.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sweep.h"
+
+/* One simulation of the sweep */
+typedef struct
+{
+    scheduler_config_t config;
+    const simulator_options_t *options;
+    unsigned int param;
+    unsigned int cpu_count;
+    simulator_stats_t stats;
+} sweep_job_t;
+
+typedef struct
+{
+    sweep_job_t *jobs;
+    unsigned int job_count;
+    unsigned int next_job;
+} sweep_state_t;
+
+/**
+ * parse_value() parses one unsigned number, stopping at ':' or the end.
+ *
+ * @return a pointer past the number, or NULL if there is none
+ */
+static const char *parse_value(const char *arg, unsigned int *value)
+{
+    char *end;
+    unsigned long parsed;
+
+    if (*arg < '0' || *arg > '9') {
+        return NULL;
+    }
+    errno = 0;
+    parsed = strtoul(arg, &end, 0);
+    if (errno != 0 || parsed > 0xffffffffUL || (*end != '\0' && *end != ':')) {
+        return NULL;
+    }
+    *value = (unsigned int)parsed;
+    return end;
+}
+
+extern bool parse_sweep_range(const char *arg, sweep_range_t *range)
+{
+    const char *next = parse_value(arg, &range->first);
+
+    if (next == NULL) {
+        return false;
+    }
+    range->last = range->first;
+    range->step = 1;
+
+    if (*next == ':') {
+        next = parse_value(next + 1, &range->last);
+        if (next == NULL) {
+            return false;
+        }
+        if (*next == ':') {
+            next = parse_value(next + 1, &range->step);
+            if (next == NULL || *next != '\0') {
+                return false;
+            }
+        }
+    }
+    return range->last >= range->first && range->step > 0;
+}
+
+extern bool sweep_range_is_single(const sweep_range_t *range)
+{
+    return range->first == range->last;
+}
+
+/**
+ * range_count() returns the number of values in a range.
+ */
+static unsigned int range_count(const sweep_range_t *range)
+{
+    return (range->last - range->first) / range->step + 1;
+}
+
+/**
+ * run_job() runs one simulation of the sweep on the calling thread.
+ */
+static void run_job(sweep_job_t *job)
+{
+    simulator_options_t options = *job->options;
+    scheduler_t *scheduler = scheduler_create(job->cpu_count, &job->config);
+
+    options.engine = ENGINE_INLINE;
+    options.fast_forward = true;
+    options.quiet = true;
+    options.pacing = PACE_UNTHROTTLED;
+
+    start_simulator(job->cpu_count, &options, scheduler, &job->stats);
+    scheduler_destroy(scheduler);
+}
+
+/**
+ * sweep_worker() takes jobs until there are none left.
+ */
+static void *sweep_worker(void *data)
+{
+    sweep_state_t *state = data;
+    unsigned int n;
+
+    while ((n = __atomic_fetch_add(&state->next_job, 1, __ATOMIC_RELAXED)) < state->job_count) {
+        run_job(&state->jobs[n]);
+    }
+    return NULL;
+}
+
+/**
+ * print_results() prints one line per simulation, in job order.
+ */
+static void print_results(const sweep_state_t *state)
+{
+    printf("%-9s %-6s %-4s %-16s %-15s %-12s %s\n", "Algorithm", "Param", "CPUs",
+           "Context Switches", "Execution Time", "Ready Time", "Wait p99");
+
+    for (unsigned int n = 0; n < state->job_count; n++) {
+        const sweep_job_t *job = &state->jobs[n];
+        bool has_param = job->config.algorithm == RR || job->config.algorithm == ARR ||
+                         job->config.algorithm == PA || job->config.algorithm == MLFQ ||
+                         job->config.algorithm == CFS;
+        char param[16] = "-";
+        char execution_time[32], ready_time[32];
+
+        if (has_param) {
+            snprintf(param, sizeof(param), "%u", job->param);
+        }
+        snprintf(execution_time, sizeof(execution_time), "%.1f s",
+                 (double)job->stats.execution_time / 10.0);
+        snprintf(ready_time, sizeof(ready_time), "%.1f s",
+                 (double)job->stats.ready_time / 10.0);
+        printf("%-9s %-6s %-4u %-16u %-15s %-12s %.1f s\n",
+               scheduler_algorithm_name(job->config.algorithm), param, job->cpu_count,
+               job->stats.context_switches, execution_time, ready_time,
+               (double)job->stats.ready_wait.p99 / 10.0);
+    }
+}
+
+extern int run_sweep(const sweep_t *sweep)
+{
+    sweep_state_t state = { .job_count = 0, .next_job = 0 };
+    unsigned int workers, n = 0;
+    pthread_t *threads;
+
+    for (unsigned int a = 0; a < sweep->axis_count; a++) {
+        state.job_count += range_count(&sweep->axes[a].param) * range_count(&sweep->cpus);
+    }
+    state.jobs = calloc(state.job_count, sizeof(sweep_job_t));
+    assert(state.jobs != NULL);
+
+    /* Jobs are laid out by algorithm, then parameter, then CPU count */
+    for (unsigned int a = 0; a < sweep->axis_count; a++) {
+        const sweep_axis_t *axis = &sweep->axes[a];
+
+        for (unsigned int p = 0; p < range_count(&axis->param); p++) {
+            unsigned int param = axis->param.first + p * axis->param.step;
+
+            for (unsigned int c = 0; c < range_count(&sweep->cpus); c++) {
+                sweep_job_t *job = &state.jobs[n++];
+
+                job->options = &sweep->options;
+                job->param = param;
+                job->cpu_count = sweep->cpus.first + c * sweep->cpus.step;
+                job->config.algorithm = axis->algorithm;
+                job->config.age_weight = (axis->algorithm == PA) ? param : 0;
+                job->config.time_slice_ms =
+                    (axis->algorithm == RR || axis->algorithm == ARR ||
+                     axis->algorithm == MLFQ || axis->algorithm == CFS) ? param : 0;
+                job->config.per_cpu_queues = sweep->per_cpu_queues;
+                job->config.mlfq_levels = sweep->mlfq_levels;
+                job->config.mlfq_boost_ms = sweep->mlfq_boost_ms;
+                job->config.cache_affinity = sweep->cache_affinity;
+                job->config.affinity = sweep->affinity;
+                job->config.affinity_count = sweep->affinity_count;
+                job->config.topology = sweep->options.topology;
+            }
+        }
+    }
+
+    /* The calling thread works too, so start one thread fewer */
+    workers = sweep->jobs;
+    if (workers > state.job_count) {
+        workers = state.job_count;
+    }
+    threads = malloc(sizeof(pthread_t) * workers);
+    assert(threads != NULL);
+    for (n = 0; n + 1 < workers; n++) {
+        if (pthread_create(&threads[n], NULL, sweep_worker, &state) != 0) {
+            break;
+        }
+    }
+    workers = n;
+    sweep_worker(&state);
+    for (n = 0; n < workers; n++) {
+        pthread_join(threads[n], NULL);
+    }
+
+    print_results(&state);
+
+    free(threads);
+    free(state.jobs);
+    return 0;
+}
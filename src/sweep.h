@@ -0,0 +1,82 @@
+/*
+ * sweep.h
+ *
+ * Parameter sweeps: many independent simulations run on a pool of worker
+ * threads, with one table of results printed at the end.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "scheduler.h"
+
+/* The most algorithm flags one sweep accepts */
+#define SWEEP_MAX_AXES 8
+
+/*
+ * An inclusive range of values, first, first + step, ... up to last.  A
+ * single value has first == last.
+ */
+typedef struct
+{
+    unsigned int first;
+    unsigned int last;
+    unsigned int step;
+} sweep_range_t;
+
+/*
+ * One algorithm to sweep, and the range of its parameter: the time slice
+ * in milliseconds for RR, the base time slice in milliseconds for ARR, the
+ * top level's quantum in milliseconds for MLFQ, the target latency in
+ * milliseconds for CFS, the age weight for PA.  FCFS and SRTF have no
+ * parameter and use a single value.
+ */
+typedef struct
+{
+    sched_algorithm_t algorithm;
+    sweep_range_t param;
+} sweep_axis_t;
+
+/*
+ * A sweep runs every combination of cpus and (axis, param), each with the
+ * inline engine on one of jobs worker threads.  Every simulation uses
+ * options, such as the workload and I/O devices, except that the engine,
+ * fast_forward, quiet and pacing are always ENGINE_INLINE, true, true and
+ * PACE_UNTHROTTLED, and runs are never traced.  per_cpu_queues,
+ * mlfq_levels, mlfq_boost_ms, cache_affinity and the affinity rules go
+ * into every scheduler_config_t.
+ */
+typedef struct
+{
+    sweep_range_t cpus;
+    sweep_axis_t axes[SWEEP_MAX_AXES];
+    unsigned int axis_count;
+    bool per_cpu_queues;
+    unsigned int mlfq_levels;
+    unsigned int mlfq_boost_ms;
+    bool cache_affinity;
+    const affinity_rule_t *affinity;
+    unsigned int affinity_count;
+    unsigned int jobs;
+    simulator_options_t options;
+} sweep_t;
+
+/*
+ * parse_sweep_range() parses "n", "first:last" or "first:last:step".
+ *
+ * @return false if arg is not a valid range
+ */
+extern bool parse_sweep_range(const char *arg, sweep_range_t *range);
+
+/* sweep_range_is_single() returns whether a range holds only one value */
+extern bool sweep_range_is_single(const sweep_range_t *range);
+
+/*
+ * run_sweep() runs every simulation of a sweep and prints the results.  If
+ * fewer worker threads can be started than asked for, the sweep runs on
+ * the ones that could.
+ *
+ * @return 0, to be used as the exit status
+ */
+extern int run_sweep(const sweep_t *sweep);
@@ -0,0 +1,66 @@
+/*
+ * topology.c
+ *
+ * Sockets, cores and SMT threads.
+ */
+
+#include <stdlib.h>
+
+#include "topology.h"
+
+/**
+ * topology_parse() parses a topology, <sockets>x<cores>x<threads>, e.g.
+ * "2x8x2".  Each count must be at least 1.
+ *
+ * @return false if spec is not a valid topology
+ */
+bool topology_parse(const char *spec, cpu_topology_t *topology)
+{
+    unsigned int *counts[] = { &topology->sockets, &topology->cores, &topology->threads };
+    const char *text = spec;
+
+    for (unsigned int n = 0; n < 3; n++) {
+        char *end;
+        unsigned long value = strtoul(text, &end, 10);
+
+        if (end == text || value == 0 || value > 0xffffUL)
+            return false;
+        *counts[n] = (unsigned int)value;
+        if (n < 2 && *end != 'x')
+            return false;
+        text = end + 1;
+        if (n == 2 && *end != '\0')
+            return false;
+    }
+    return true;
+}
+
+/**
+ * topology_flat() makes a topology one node of cpu_count single-thread cores.
+ */
+void topology_flat(cpu_topology_t *topology, unsigned int cpu_count)
+{
+    topology->sockets = 1;
+    topology->cores = cpu_count;
+    topology->threads = 1;
+}
+
+unsigned int topology_cpu_count(const cpu_topology_t *topology)
+{
+    return topology->sockets * topology->cores * topology->threads;
+}
+
+unsigned int topology_node_count(const cpu_topology_t *topology)
+{
+    return topology->sockets;
+}
+
+unsigned int topology_node_of(const cpu_topology_t *topology, unsigned int cpu_id)
+{
+    return cpu_id / (topology->cores * topology->threads);
+}
+
+unsigned int topology_core_of(const cpu_topology_t *topology, unsigned int cpu_id)
+{
+    return cpu_id / topology->threads;
+}
@@ -0,0 +1,33 @@
+/*
+ * topology.h
+ *
+ * The shape of the simulated machine: sockets of cores, each core with one
+ * or more SMT threads.  Every socket is a NUMA node.  CPUs are numbered
+ * thread by thread, core by core, socket by socket, so the CPUs of a core
+ * and of a node are contiguous:
+ *
+ *   cpu = (socket * cores + core) * threads + thread
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * A topology has sockets * cores * threads CPUs.  One with sockets == 0 is
+ * flat, meaning one node with a core of a single thread per CPU.
+ */
+typedef struct
+{
+    unsigned int sockets;
+    unsigned int cores;
+    unsigned int threads;
+} cpu_topology_t;
+
+/* Topology function declarations */
+bool topology_parse(const char *spec, cpu_topology_t *topology);
+void topology_flat(cpu_topology_t *topology, unsigned int cpu_count);
+unsigned int topology_cpu_count(const cpu_topology_t *topology);
+unsigned int topology_node_count(const cpu_topology_t *topology);
+unsigned int topology_node_of(const cpu_topology_t *topology, unsigned int cpu_id);
+unsigned int topology_core_of(const cpu_topology_t *topology, unsigned int cpu_id);
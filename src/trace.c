@@ -0,0 +1,131 @@
+/*
+ * trace.c
+ *
+ * The binary trace: per-thread ring buffers and the thread that drains them
+ * to the trace file.
+ */
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* Records per ring; 64K records is 1 MiB per recording thread */
+#define TRACE_RING_SIZE (1u << 16)
+
+/* How long the drain thread sleeps when every ring is empty */
+#define TRACE_DRAIN_INTERVAL_NS 1000000L
+
+/**
+ * drain_ring() writes out every record in a ring, and returns how many
+ * there were.
+ */
+static unsigned int drain_ring(trace_t *trace, trace_ring_t *ring)
+{
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    unsigned int tail = ring->tail;
+    unsigned int count = head - tail;
+    unsigned int first = tail & ring->mask;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    /* The records may wrap around the end of the ring */
+    if (first + count > ring->mask + 1) {
+        unsigned int part = ring->mask + 1 - first;
+        fwrite(&ring->records[first], sizeof(trace_record_t), part, trace->file);
+        fwrite(&ring->records[0], sizeof(trace_record_t), count - part, trace->file);
+    } else {
+        fwrite(&ring->records[first], sizeof(trace_record_t), count, trace->file);
+    }
+
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+/**
+ * drain_thread() drains the rings until the trace is closed, then drains
+ * them one last time.
+ */
+static void *drain_thread(void *data)
+{
+    trace_t *trace = data;
+    struct timespec interval = { 0, TRACE_DRAIN_INTERVAL_NS };
+
+    while (!__atomic_load_n(&trace->stopping, __ATOMIC_ACQUIRE)) {
+        unsigned int drained = 0;
+
+        for (unsigned int n = 0; n < trace->ring_count; n++) {
+            drained += drain_ring(trace, &trace->rings[n]);
+        }
+        if (drained == 0) {
+            nanosleep(&interval, NULL);
+        }
+    }
+
+    for (unsigned int n = 0; n < trace->ring_count; n++) {
+        drain_ring(trace, &trace->rings[n]);
+    }
+    return NULL;
+}
+
+extern bool trace_open(trace_t *trace, const char *path,
+                       unsigned int ring_count, unsigned int cpu_count)
+{
+    trace_header_t header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .record_size = sizeof(trace_record_t),
+        .cpu_count = cpu_count
+    };
+
+    trace->file = fopen(path, "wb");
+    if (trace->file == NULL) {
+        perror(path);
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, trace->file);
+
+    trace->ring_count = ring_count;
+    trace->rings = calloc(ring_count, sizeof(trace_ring_t));
+    assert(trace->rings != NULL);
+    for (unsigned int n = 0; n < ring_count; n++) {
+        trace->rings[n].records = malloc(sizeof(trace_record_t) * TRACE_RING_SIZE);
+        assert(trace->rings[n].records != NULL);
+        trace->rings[n].mask = TRACE_RING_SIZE - 1;
+    }
+
+    trace->stopping = false;
+    pthread_create(&trace->thread, NULL, drain_thread, trace);
+    return true;
+}
+
+extern void trace_emit(trace_ring_t *ring, const trace_record_t *record)
+{
+    unsigned int head = ring->head;
+
+    /* A full ring waits for the drain thread instead of dropping records */
+    while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+        sched_yield();
+    }
+
+    ring->records[head & ring->mask] = *record;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+extern void trace_close(trace_t *trace)
+{
+    __atomic_store_n(&trace->stopping, true, __ATOMIC_RELEASE);
+    pthread_join(trace->thread, NULL);
+
+    if (fclose(trace->file) != 0) {
+        perror("trace");
+    }
+    for (unsigned int n = 0; n < trace->ring_count; n++) {
+        free(trace->rings[n].records);
+    }
+    free(trace->rings);
+}
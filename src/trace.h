@@ -0,0 +1,119 @@
+/*
+ * trace.h
+ *
+ * A binary trace of the scheduling events of a simulation, for offline
+ * analysis.
+ *
+ * A trace file is a header followed by fixed-size records, all fields in
+ * native byte order, so a tool can mmap() the file and index it directly:
+ *
+ *   header : magic ("OSTR"), version (1), size of a record in bytes (16),
+ *            number of CPUs
+ *   records: trace_record_t, see below
+ *
+ * Every thread that records events has a ring buffer of its own, with one
+ * producer and one consumer, so recording takes no lock and never contends
+ * with another thread.  A drain thread copies the rings to the file.  The
+ * records of each thread are in the order they happened; records of
+ * different threads are interleaved in the order they were drained, so a
+ * tool wanting one timeline sorts on time (a stable sort keeps each
+ * thread's order).
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_MAGIC 0x5254534fu   /* "OSTR" in little-endian byte order */
+#define TRACE_VERSION 1
+
+/* cpu or pid when an event has none */
+#define TRACE_NONE_CPU 0xffffu
+#define TRACE_NONE_PID 0xffffffffu
+
+/*
+ * Trace events, and what cpu, pid and arg hold for each
+ *
+ *   TRACE_CONTEXT_SWITCH : the CPU, the process switched to (or none for
+ *                          idle), the preemption time in ticks (0xffffffff
+ *                          for none)
+ *   TRACE_FORCE_PREEMPT  : the CPU, its process, 1 if it was preempted or 0
+ *                          if it was already leaving the CPU
+ *   TRACE_IO_SUBMIT      : the CPU the process leaves, the process, the
+ *                          I/O device
+ *   TRACE_IO_COMPLETE    : none, the process, the I/O device
+ *   TRACE_STATE          : the CPU if the change happened on one, the
+ *                          process, its old process_state_t in the high 16
+ *                          bits and its new one in the low 16 bits
+ */
+typedef enum
+{
+    TRACE_CONTEXT_SWITCH = 1,
+    TRACE_FORCE_PREEMPT,
+    TRACE_IO_SUBMIT,
+    TRACE_IO_COMPLETE,
+    TRACE_STATE
+} trace_event_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t cpu_count;
+} trace_header_t;
+
+typedef struct
+{
+    uint32_t time;     /* the simulator tick */
+    uint16_t type;     /* trace_event_t */
+    uint16_t cpu;
+    uint32_t pid;
+    uint32_t arg;
+} trace_record_t;
+
+/*
+ * A single-producer, single-consumer ring of records.  head is only written
+ * by the producer and tail only by the drain thread.
+ */
+typedef struct
+{
+    trace_record_t *records;
+    unsigned int mask;   /* capacity - 1; the capacity is a power of two */
+    unsigned int head;   /* next record to write */
+    unsigned int tail;   /* next record to drain */
+} trace_ring_t;
+
+typedef struct
+{
+    FILE *file;
+    trace_ring_t *rings;
+    unsigned int ring_count;
+    bool stopping;
+    pthread_t thread;
+} trace_t;
+
+/*
+ * trace_open() creates a trace file and starts draining ring_count rings
+ * into it.
+ *
+ * @return false, after printing why, if the file cannot be created
+ */
+extern bool trace_open(trace_t *trace, const char *path,
+                       unsigned int ring_count, unsigned int cpu_count);
+
+/*
+ * trace_emit() appends a record to a ring.  Only one thread may emit into
+ * a ring.  If the ring is full it waits for the drain thread to make room,
+ * rather than lose the record.
+ */
+extern void trace_emit(trace_ring_t *ring, const trace_record_t *record);
+
+/*
+ * trace_close() drains every ring, stops the drain thread and closes the
+ * file.  Nothing may be emitted into the trace after this.
+ */
+extern void trace_close(trace_t *trace);
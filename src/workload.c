@@ -0,0 +1,777 @@
+/*
+ * workload.c
+ *
+ * Loading, copying and writing workloads.  See workload.h for the file
+ * formats.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "workload.h"
+
+#define WORKLOAD_MAGIC 0x4c57534fu /* "OSWL" read as a little-endian word */
+#define WORKLOAD_VERSION 2
+
+/* The binary format, see workload.h */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t process_count;
+    uint32_t op_count;
+    uint32_t names_size;
+    uint32_t reserved;
+} workload_header_t;
+
+typedef struct
+{
+    uint32_t priority;
+    uint32_t arrival_time;
+    uint32_t first_op;
+    uint32_t op_count;
+    uint32_t name_offset;
+} workload_record_t;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t time;
+    uint32_t device;
+} workload_op_t;
+
+/* Version 1 ops had no I/O device; they all use device 0 */
+typedef struct
+{
+    uint32_t type;
+    uint32_t time;
+} workload_op_v1_t;
+
+/* Whether a workload_op_t can be used in place as an op_t */
+#define OPS_IN_PLACE (sizeof(op_t) == sizeof(workload_op_t) && \
+                      sizeof(op_type) == sizeof(uint32_t) && \
+                      offsetof(op_t, time) == offsetof(workload_op_t, time) && \
+                      offsetof(op_t, device) == offsetof(workload_op_t, device))
+
+/**
+ * op_count() returns the number of ops from pc up to and including the
+ * OP_TERMINATE that ends them.
+ */
+static unsigned int op_count(const op_t *pc)
+{
+    unsigned int n = 1;
+
+    while (pc->type != OP_TERMINATE) {
+        pc++;
+        n++;
+    }
+    return n;
+}
+
+extern void workload_copy(workload_t *copy, const pcb_t *source,
+                          unsigned int count)
+{
+    unsigned int n, total_ops = 0;
+    op_t *ops;
+
+    for (n = 0; n < count; n++)
+        total_ops += op_count(source[n].pc);
+
+    /* pcb_t has a const pid, so the PCBs are copied with memcpy */
+    copy->arena = malloc(sizeof(pcb_t) * count + sizeof(op_t) * total_ops);
+    assert(copy->arena != NULL);
+    copy->count = count;
+    copy->processes = copy->arena;
+    copy->ops = (op_t *)(void *)(copy->processes + count);
+    memcpy(copy->processes, source, sizeof(pcb_t) * count);
+    copy->names = NULL;
+    copy->mapping = NULL;
+    copy->mapping_size = 0;
+
+    ops = copy->ops;
+    for (n = 0; n < count; n++) {
+        unsigned int length = op_count(source[n].pc);
+
+        memcpy(ops, source[n].pc, sizeof(op_t) * length);
+        copy->processes[n].pc = ops;
+        copy->processes[n].next = NULL;
+        ops += length;
+    }
+}
+
+extern void workload_free(workload_t *workload)
+{
+    if (workload->arena != NULL) {
+        free(workload->arena);
+    } else if (workload->mapping != NULL) {
+        /* ops and names point into the mapping, unless ops were converted */
+        free(workload->processes);
+        if ((char *)workload->ops < (char *)workload->mapping ||
+            (char *)workload->ops >= (char *)workload->mapping + workload->mapping_size) {
+            free(workload->ops);
+        }
+        munmap(workload->mapping, workload->mapping_size);
+    } else {
+        free(workload->processes);
+        free(workload->ops);
+        free(workload->names);
+    }
+    workload->processes = NULL;
+    workload->ops = NULL;
+    workload->names = NULL;
+    workload->arena = NULL;
+    workload->mapping = NULL;
+    workload->mapping_size = 0;
+    workload->count = 0;
+}
+
+/* FNV-1a, 64 bits, one 32-bit word at a time */
+#define FINGERPRINT_PRIME 0x100000001b3ull
+
+static unsigned long long fingerprint_add(unsigned long long hash, unsigned int word)
+{
+    return (hash ^ word) * FINGERPRINT_PRIME;
+}
+
+extern unsigned long long workload_fingerprint(unsigned long long hash, const pcb_t *process)
+{
+    const op_t *pc = process->pc;
+
+    hash = fingerprint_add(hash, process->priority);
+    hash = fingerprint_add(hash, process->arrival_time);
+    do {
+        hash = fingerprint_add(hash, (unsigned int)pc->type);
+        hash = fingerprint_add(hash, pc->time);
+        hash = fingerprint_add(hash, pc->device);
+    } while ((pc++)->type != OP_TERMINATE);
+    return hash;
+}
+
+/**
+ * check_ops() checks that a process's ops alternate CPU and I/O bursts,
+ * starting and ending with a CPU burst, and are ended by OP_TERMINATE.
+ *
+ * @param total set to the total CPU and I/O time of the ops
+ *
+ * @return false if the ops are not valid
+ */
+static bool check_ops(const op_t *ops, unsigned int count, unsigned int *total)
+{
+    unsigned long long sum = 0;
+
+    if (count < 2 || count % 2 != 0 || ops[count - 1].type != OP_TERMINATE) {
+        return false;
+    }
+    for (unsigned int n = 0; n + 1 < count; n++) {
+        if (ops[n].type != (n % 2 == 0 ? OP_CPU : OP_IO) || ops[n].time == 0) {
+            return false;
+        }
+        sum += ops[n].time;
+    }
+    if (sum > UINT32_MAX) {
+        return false;
+    }
+    *total = (unsigned int)sum;
+    return true;
+}
+
+/**
+ * fill_pcb() fills in the PCB of a process from its record, with ops its
+ * first op and total the time of all of its bursts.
+ */
+static void fill_pcb(pcb_t *pcb, unsigned int pid, const char *name,
+                     const workload_record_t *record, op_t *ops, unsigned int total)
+{
+    /* pcb_t has a const pid, so each PCB is filled in with memcpy */
+    pcb_t filled = {
+        .pid = pid,
+        .name = name,
+        .time_in_CPU_burst = ops->time,
+        .priority = record->priority,
+        .state = PROCESS_NEW,
+        .pc = ops,
+        .next = NULL,
+        .enqueue_time = 0,
+        .arrival_time = record->arrival_time,
+        .total_time_remaining = total
+    };
+    memcpy(pcb, &filled, sizeof(pcb_t));
+}
+
+/**
+ * build_processes() makes the PCBs of a workload from its process records.
+ * workload->ops and workload->names must already be set up.
+ *
+ * @param source the name of the file, for error messages
+ *
+ * @return false, after printing why, if a record is not valid
+ */
+static bool build_processes(workload_t *workload, const workload_record_t *records,
+                            unsigned int count, unsigned int total_ops,
+                            size_t names_size, const char *source)
+{
+    workload->processes = malloc(sizeof(pcb_t) * (count ? count : 1));
+    assert(workload->processes != NULL);
+    workload->count = 0;
+
+    for (unsigned int n = 0; n < count; n++) {
+        const workload_record_t *record = &records[n];
+        unsigned int total;
+
+        if (record->first_op > total_ops || record->op_count > total_ops - record->first_op ||
+            !check_ops(&workload->ops[record->first_op], record->op_count, &total)) {
+            fprintf(stderr, "Error: %s: process %u has invalid ops.\n", source, n);
+            return false;
+        }
+        if (record->name_offset >= names_size) {
+            fprintf(stderr, "Error: %s: process %u has an invalid name.\n", source, n);
+            return false;
+        }
+        if (n > 0 && record->arrival_time < records[n - 1].arrival_time) {
+            fprintf(stderr, "Error: %s: process %u arrives before the one ahead of it.\n",
+                    source, n);
+            return false;
+        }
+
+        fill_pcb(&workload->processes[n], n, workload->names + record->name_offset,
+                 record, &workload->ops[record->first_op], total);
+        workload->count++;
+    }
+    return true;
+}
+
+/**
+ * load_binary() maps a binary workload file and uses it in place.
+ */
+static bool load_binary(workload_t *workload, const char *path)
+{
+    const workload_header_t *header;
+    struct stat st;
+    size_t records_end, ops_end, op_size;
+    void *mapping;
+    int fd;
+    bool loaded;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    if ((size_t)st.st_size < sizeof(workload_header_t)) {
+        fprintf(stderr, "Error: %s: truncated workload header.\n", path);
+        close(fd);
+        return false;
+    }
+    mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    workload->mapping = mapping;
+    workload->mapping_size = (size_t)st.st_size;
+
+    header = mapping;
+    op_size = (header->version == 1) ? sizeof(workload_op_v1_t) : sizeof(workload_op_t);
+    records_end = sizeof(workload_header_t) +
+                  (size_t)header->process_count * sizeof(workload_record_t);
+    ops_end = records_end + (size_t)header->op_count * op_size;
+    if (header->version != 1 && header->version != WORKLOAD_VERSION) {
+        fprintf(stderr, "Error: %s: unsupported workload version %u.\n", path,
+                header->version);
+        workload_free(workload);
+        return false;
+    }
+    if (ops_end + header->names_size != workload->mapping_size ||
+        header->names_size == 0 ||
+        ((const char *)mapping)[workload->mapping_size - 1] != '\0') {
+        fprintf(stderr, "Error: %s: workload file has the wrong size.\n", path);
+        workload_free(workload);
+        return false;
+    }
+
+    /* The names and, where the layout allows, the ops are used in place */
+    workload->names = (char *)mapping + ops_end;
+    if (OPS_IN_PLACE && header->version == WORKLOAD_VERSION) {
+        workload->ops = (op_t *)(void *)((char *)mapping + records_end);
+    } else {
+        const char *ops = (const char *)mapping + records_end;
+
+        workload->ops = malloc(sizeof(op_t) * (header->op_count ? header->op_count : 1));
+        assert(workload->ops != NULL);
+        for (unsigned int n = 0; n < header->op_count; n++) {
+            workload_op_t op = { 0, 0, 0 };
+
+            memcpy(&op, ops + (size_t)n * op_size, op_size);
+            workload->ops[n].type = (op_type)op.type;
+            workload->ops[n].time = op.time;
+            workload->ops[n].device = op.device;
+        }
+    }
+
+    loaded = build_processes(workload,
+                             (const workload_record_t *)(const void *)(header + 1),
+                             header->process_count, header->op_count,
+                             header->names_size, path);
+    if (!loaded) {
+        workload_free(workload);
+    }
+    return loaded;
+}
+
+/**
+ * grow() makes sure an array has room for one more element.
+ */
+static void grow(void **array, unsigned int *capacity, unsigned int count, size_t size)
+{
+    if (count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        *array = realloc(*array, size * *capacity);
+        assert(*array != NULL);
+    }
+}
+
+/**
+ * parse_unsigned() parses an unsigned number with surrounding blanks.
+ *
+ * @return a pointer past the number and blanks, or NULL if there is none
+ */
+static char *parse_unsigned(char *field, unsigned int *value)
+{
+    char *end;
+    unsigned long parsed;
+
+    while (*field == ' ' || *field == '\t') {
+        field++;
+    }
+    if (*field < '0' || *field > '9') {
+        return NULL;
+    }
+    errno = 0;
+    parsed = strtoul(field, &end, 10);
+    while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') {
+        end++;
+    }
+    if (errno != 0 || parsed > UINT32_MAX) {
+        return NULL;
+    }
+    *value = (unsigned int)parsed;
+    return end;
+}
+
+/**
+ * end_field() steps past the comma that ends a field.
+ *
+ * @return a pointer to the next field, or NULL if the field does not end
+ */
+static char *end_field(char *end)
+{
+    if (end == NULL || (*end != ',' && *end != '\0')) {
+        return NULL;
+    }
+    return (*end == ',') ? end + 1 : end;
+}
+
+/**
+ * parse_number() parses one comma-separated unsigned number field.
+ *
+ * @return a pointer past the field and its comma, or NULL if there is none
+ */
+static char *parse_number(char *field, unsigned int *value)
+{
+    return end_field(parse_unsigned(field, value));
+}
+
+/**
+ * parse_burst() parses one burst field, time or time@device.
+ *
+ * @return a pointer past the field and its comma, or NULL if there is none
+ */
+static char *parse_burst(char *field, unsigned int *time, unsigned int *device)
+{
+    char *end = parse_unsigned(field, time);
+
+    *device = 0;
+    if (end != NULL && *end == '@') {
+        end = parse_unsigned(end + 1, device);
+    }
+    return end_field(end);
+}
+
+/**
+ * parse_line() parses one line of a text workload into a process record.
+ * Its ops are added to *ops from *op_total on, and record->first_op and
+ * op_count say where they are; name and name_length give its name within
+ * the line.  record->name_offset is left to the caller.
+ *
+ * @return 1 for a process, 0 for a blank or comment line, or -1, after
+ *         printing why, for a line that is not valid
+ */
+static int parse_line(char *line, const char *path, unsigned int line_number,
+                      workload_record_t *record, const char **name, size_t *name_length,
+                      op_t **ops, unsigned int *op_total, unsigned int *op_capacity)
+{
+    char *start = line, *field, *name_end;
+    unsigned int burst, device;
+
+    while (*start == ' ' || *start == '\t') {
+        start++;
+    }
+    if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0') {
+        return 0;
+    }
+
+    field = strchr(start, ',');
+    if (field == NULL || field == start) {
+        fprintf(stderr, "Error: %s:%u: expected name,priority,arrival_time,bursts...\n",
+                path, line_number);
+        return -1;
+    }
+    for (name_end = field; name_end > start && (name_end[-1] == ' ' || name_end[-1] == '\t');) {
+        name_end--;
+    }
+    *name = start;
+    *name_length = (size_t)(name_end - start);
+
+    field++;
+    if ((field = parse_number(field, &record->priority)) == NULL ||
+        (field = parse_number(field, &record->arrival_time)) == NULL) {
+        fprintf(stderr, "Error: %s:%u: invalid priority or arrival time.\n",
+                path, line_number);
+        return -1;
+    }
+
+    /* The bursts alternate CPU and I/O, so the op types follow from them */
+    record->first_op = *op_total;
+    while (*field != '\0') {
+        op_type type = ((*op_total - record->first_op) % 2 == 0) ? OP_CPU : OP_IO;
+
+        if ((field = parse_burst(field, &burst, &device)) == NULL ||
+            (type == OP_CPU && device != 0)) {
+            fprintf(stderr, "Error: %s:%u: invalid burst.\n", path, line_number);
+            return -1;
+        }
+        grow((void **)ops, op_capacity, *op_total, sizeof(op_t));
+        (*ops)[*op_total].type = type;
+        (*ops)[*op_total].time = burst;
+        (*ops)[*op_total].device = device;
+        (*op_total)++;
+    }
+    grow((void **)ops, op_capacity, *op_total, sizeof(op_t));
+    (*ops)[*op_total].type = OP_TERMINATE;
+    (*ops)[*op_total].time = 0;
+    (*ops)[*op_total].device = 0;
+    (*op_total)++;
+    record->op_count = *op_total - record->first_op;
+    return 1;
+}
+
+/**
+ * load_text() reads a text workload one line at a time.
+ */
+static bool load_text(workload_t *workload, FILE *file, const char *path)
+{
+    workload_record_t *records = NULL;
+    unsigned int record_count = 0, record_capacity = 0;
+    unsigned int op_total = 0, op_capacity = 0;
+    unsigned int names_size = 0, names_capacity = 0;
+    unsigned int line_number = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    bool loaded = true;
+
+    workload->ops = NULL;
+    workload->names = NULL;
+
+    while (getline(&line, &line_capacity, file) != -1) {
+        workload_record_t *record;
+        const char *name;
+        size_t name_length;
+        int parsed;
+
+        line_number++;
+        grow((void **)&records, &record_capacity, record_count, sizeof(workload_record_t));
+        record = &records[record_count];
+        parsed = parse_line(line, path, line_number, record, &name, &name_length,
+                            &workload->ops, &op_total, &op_capacity);
+        if (parsed < 0) {
+            loaded = false;
+            break;
+        }
+        if (parsed == 0) {
+            continue;
+        }
+
+        record->name_offset = names_size;
+        while (names_capacity < names_size + name_length + 1) {
+            names_capacity = names_capacity ? names_capacity * 2 : 4096;
+            workload->names = realloc(workload->names, names_capacity);
+            assert(workload->names != NULL);
+        }
+        memcpy(workload->names + names_size, name, name_length);
+        names_size += (unsigned int)name_length;
+        workload->names[names_size++] = '\0';
+
+        record_count++;
+    }
+    if (loaded && ferror(file)) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        loaded = false;
+    }
+    free(line);
+
+    /* Names only reach their final address once every line is read */
+    loaded = loaded && build_processes(workload, records, record_count, op_total,
+                                       names_size, path);
+    free(records);
+    if (!loaded) {
+        workload_free(workload);
+    }
+    return loaded;
+}
+
+extern bool workload_load(workload_t *workload, const char *path)
+{
+    uint32_t magic = 0;
+    FILE *file;
+    bool loaded;
+
+    memset(workload, 0, sizeof(workload_t));
+
+    if (strcmp(path, "-") == 0) {
+        return load_text(workload, stdin, "<stdin>");
+    }
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (fread(&magic, sizeof(magic), 1, file) == 1 && magic == WORKLOAD_MAGIC) {
+        fclose(file);
+        return load_binary(workload, path);
+    }
+    rewind(file);
+    loaded = load_text(workload, file, path);
+    fclose(file);
+    return loaded;
+}
+
+extern void workload_stream_init(workload_stream_t *stream, const pcb_t *processes,
+                                 unsigned int count)
+{
+    memset(stream, 0, sizeof(workload_stream_t));
+    stream->processes = processes;
+    stream->count = count;
+}
+
+extern bool workload_stream_open(workload_stream_t *stream, const char *path)
+{
+    uint32_t magic = 0;
+    FILE *file;
+
+    workload_stream_init(stream, NULL, 0);
+
+    if (strcmp(path, "-") == 0) {
+        stream->file = stdin;
+        stream->path = "<stdin>";
+        return true;
+    }
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    /* A binary file is mapped whole; only its pages in use are read in */
+    if (fread(&magic, sizeof(magic), 1, file) == 1 && magic == WORKLOAD_MAGIC) {
+        fclose(file);
+        if (!workload_load(&stream->loaded, path)) {
+            return false;
+        }
+        stream->processes = stream->loaded.processes;
+        stream->count = stream->loaded.count;
+        return true;
+    }
+    rewind(file);
+    stream->file = file;
+    stream->path = path;
+    return true;
+}
+
+/**
+ * read_process() reads the lines of a text stream up to its next process,
+ * and makes it the pending one.
+ *
+ * @return false at the end of the file, or, with failed set after printing
+ *         why, if the process is not valid
+ */
+static bool read_process(workload_stream_t *stream)
+{
+    workload_record_t record;
+    const char *name = NULL;
+    size_t name_length = 0;
+    unsigned int op_total = 0, total;
+    int parsed = 0;
+
+    while (parsed == 0) {
+        if (getline(&stream->line, &stream->line_capacity, stream->file) == -1) {
+            if (ferror(stream->file)) {
+                fprintf(stderr, "Error: %s: %s\n", stream->path, strerror(errno));
+                stream->failed = true;
+            }
+            return false;
+        }
+        stream->line_number++;
+        op_total = 0;
+        parsed = parse_line(stream->line, stream->path, stream->line_number, &record,
+                            &name, &name_length, &stream->ops, &op_total,
+                            &stream->op_capacity);
+    }
+    if (parsed < 0) {
+        stream->failed = true;
+        return false;
+    }
+    if (!check_ops(stream->ops, record.op_count, &total)) {
+        fprintf(stderr, "Error: %s: process %u has invalid ops.\n", stream->path,
+                stream->read);
+        stream->failed = true;
+        return false;
+    }
+    if (stream->read > 0 && record.arrival_time < stream->last_arrival) {
+        fprintf(stderr, "Error: %s: process %u arrives before the one ahead of it.\n",
+                stream->path, stream->read);
+        stream->failed = true;
+        return false;
+    }
+
+    if (stream->name_capacity < name_length + 1) {
+        stream->name_capacity = name_length + 1;
+        stream->name = realloc(stream->name, stream->name_capacity);
+        assert(stream->name != NULL);
+    }
+    memcpy(stream->name, name, name_length);
+    stream->name[name_length] = '\0';
+
+    fill_pcb(&stream->pending, stream->read, stream->name, &record, stream->ops, total);
+    stream->has_pending = true;
+    stream->last_arrival = record.arrival_time;
+    stream->read++;
+    return true;
+}
+
+extern const pcb_t *workload_stream_peek(workload_stream_t *stream)
+{
+    if (stream->file == NULL) {
+        return (stream->next < stream->count) ? &stream->processes[stream->next] : NULL;
+    }
+    if (!stream->has_pending && (stream->failed || !read_process(stream))) {
+        return NULL;
+    }
+    return &stream->pending;
+}
+
+extern void workload_stream_next(workload_stream_t *stream)
+{
+    if (stream->file == NULL) {
+        if (stream->next < stream->count) {
+            stream->next++;
+        }
+    } else {
+        stream->has_pending = false;
+    }
+}
+
+extern void workload_stream_close(workload_stream_t *stream)
+{
+    if (stream->file != NULL && stream->file != stdin) {
+        fclose(stream->file);
+    }
+    free(stream->line);
+    free(stream->ops);
+    free(stream->name);
+    workload_free(&stream->loaded);
+    memset(stream, 0, sizeof(workload_stream_t));
+}
+
+extern bool workload_write_binary(const workload_t *workload, const char *path)
+{
+    workload_header_t header = {
+        .magic = WORKLOAD_MAGIC,
+        .version = WORKLOAD_VERSION,
+        .process_count = workload->count,
+        .op_count = 0,
+        .names_size = 0,
+        .reserved = 0
+    };
+    FILE *file;
+    bool written = true;
+
+    for (unsigned int n = 0; n < workload->count; n++) {
+        header.op_count += op_count(workload->processes[n].pc);
+        header.names_size += (uint32_t)strlen(workload->processes[n].name) + 1;
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Error: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    written = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    /* Process records, with each process's ops and name laid out in order */
+    uint32_t first_op = 0, name_offset = 0;
+    for (unsigned int n = 0; written && n < workload->count; n++) {
+        const pcb_t *pcb = &workload->processes[n];
+        workload_record_t record = {
+            .priority = pcb->priority,
+            .arrival_time = pcb->arrival_time,
+            .first_op = first_op,
+            .op_count = op_count(pcb->pc),
+            .name_offset = name_offset
+        };
+
+        written = fwrite(&record, sizeof(record), 1, file) == 1;
+        first_op += record.op_count;
+        name_offset += (uint32_t)strlen(pcb->name) + 1;
+    }
+
+    for (unsigned int n = 0; written && n < workload->count; n++) {
+        const op_t *pc = workload->processes[n].pc;
+
+        do {
+            workload_op_t op = {
+                .type = (uint32_t)pc->type,
+                .time = pc->time,
+                .device = pc->device
+            };
+            written = fwrite(&op, sizeof(op), 1, file) == 1;
+        } while (written && (pc++)->type != OP_TERMINATE);
+    }
+
+    for (unsigned int n = 0; written && n < workload->count; n++) {
+        const char *name = workload->processes[n].name;
+        written = fwrite(name, strlen(name) + 1, 1, file) == 1;
+    }
+
+    if (fclose(file) != 0) {
+        written = false;
+    }
+    if (!written) {
+        fprintf(stderr, "Error: %s: could not write workload.\n", path);
+    }
+    return written;
+}
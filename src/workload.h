@@ -0,0 +1,160 @@
+/*
+ * workload.h
+ *
+ * Workloads: the set of processes a simulation runs, either the built-in
+ * processes[] table or one loaded from a file at runtime.
+ *
+ * Two file formats are read, told apart by the first bytes of the file.
+ *
+ * The binary format is the primary one.  It is mapped into memory and used
+ * in place: the op array and the process names are used where they lie in
+ * the file, so loading only builds the PCBs and checks the ops, with no
+ * parsing or copying.  All fields are 32-bit unsigned integers in native
+ * byte order:
+ *
+ *   header   : magic ("OSWL"), version (2), process count, op count,
+ *              size of the name table in bytes, reserved (0)
+ *   processes: one record per process, in arrival order:
+ *              priority, arrival time, index of its first op, number of
+ *              ops (ending with OP_TERMINATE), offset of its name
+ *   ops      : op count records of type, time, I/O device, laid out
+ *              exactly as op_t.  Version 1 files, whose ops have no I/O
+ *              device, are still read, with every I/O burst on device 0.
+ *   names    : NUL-terminated process names
+ *
+ * The text format has one process per line, in arrival order:
+ *
+ *   name,priority,arrival_time,cpu,io,cpu,...,cpu
+ *
+ * The bursts alternate CPU and I/O and start and end with a CPU burst.  An
+ * I/O burst may be written time@device to send it to an I/O device other
+ * than device 0.
+ * Blank lines and lines starting with '#' are skipped.  It is read one line
+ * at a time, so a trace can be streamed from a pipe.
+ *
+ * In both formats times are in ticks of 100ms, processes get pids in file
+ * order, and no process may arrive before the one listed ahead of it.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "os-sim.h"
+
+/*
+ * A workload is a set of PCBs in arrival order, together with one arena
+ * holding all of their op arrays.  Each PCB's pc points into ops.
+ *
+ * The memory behind a workload is owned in one of three ways: a single
+ * arena holding the PCBs, ops and names (copies and generated workloads),
+ * the mapping of a binary file that ops and names point into, or else
+ * separate allocations for processes, ops and names.
+ */
+struct _workload_t
+{
+    pcb_t *processes;
+    unsigned int count;
+    op_t *ops;
+    char *names;
+    void *arena;
+    void *mapping;
+    size_t mapping_size;
+};
+
+/*
+ * workload_copy() makes a deep copy of count PCBs and their op arrays, in
+ * one arena.  The copy shares the names of the source, which must outlive
+ * it.
+ * workload_free() releases a workload made by workload_copy() or
+ * workload_load().
+ */
+extern void workload_copy(workload_t *copy, const pcb_t *source,
+                          unsigned int count);
+extern void workload_free(workload_t *workload);
+
+/*
+ * workload_fingerprint() adds a process's priority, arrival time and ops to
+ * a running hash, started from WORKLOAD_FINGERPRINT_BASIS, so that two
+ * workloads can be told apart.  It reads the op array from the PCB's pc,
+ * so it is used before the process is simulated.
+ */
+#define WORKLOAD_FINGERPRINT_BASIS 0xcbf29ce484222325ull
+
+extern unsigned long long workload_fingerprint(unsigned long long hash, const pcb_t *process);
+
+/*
+ * workload_load() reads a workload file in either format.  A path of "-"
+ * reads the text format from standard input.
+ *
+ * @return false, after printing why, if the file cannot be loaded
+ */
+extern bool workload_load(workload_t *workload, const char *path);
+
+/*
+ * workload_write_binary() writes a workload out in the binary format.
+ *
+ * @return false, after printing why, if the file cannot be written
+ */
+extern bool workload_write_binary(const workload_t *workload, const char *path);
+
+/*
+ * A workload stream hands out the processes of a workload one at a time,
+ * in arrival order, for a simulation to admit as they arrive.  It walks
+ * either a workload already in memory or a workload file.  A text file is
+ * parsed one line at a time as its processes are asked for, so neither a
+ * long trace nor one streamed from a pipe is ever held whole; a binary
+ * file is mapped, and its pages are only read in as they are used.
+ *
+ * With a text file only the next process is held, in pending, with its
+ * ops and name in buffers that every line reuses.
+ */
+struct _workload_stream_t
+{
+    const pcb_t *processes;     /* in memory, or the PCBs of loaded */
+    unsigned int count;
+    unsigned int next;
+    workload_t loaded;          /* a binary file */
+    FILE *file;                 /* a text file, or NULL */
+    const char *path;
+    unsigned int line_number;
+    char *line;
+    size_t line_capacity;
+    pcb_t pending;
+    bool has_pending;
+    op_t *ops;
+    unsigned int op_capacity;
+    char *name;
+    size_t name_capacity;
+    unsigned int read;          /* processes read from the file so far */
+    unsigned int last_arrival;
+    bool failed;
+};
+
+/*
+ * workload_stream_init() starts a stream over count PCBs in memory, which
+ * must outlive it.  workload_stream_open() starts one over a workload file
+ * in either format, with "-" reading the text format from standard input.
+ *
+ * @return false, after printing why, if the file cannot be opened
+ */
+extern void workload_stream_init(workload_stream_t *stream, const pcb_t *processes,
+                                 unsigned int count);
+extern bool workload_stream_open(workload_stream_t *stream, const char *path);
+
+/*
+ * workload_stream_peek() returns the next process of a stream, which stays
+ * the same until workload_stream_next() moves past it; its pc and name are
+ * only valid until then.  Processes from a file are checked as they are
+ * read, and get pids in file order.
+ *
+ * @return NULL at the end of the stream, or, with failed set after
+ *         printing why, at a process that is not valid
+ */
+extern const pcb_t *workload_stream_peek(workload_stream_t *stream);
+extern void workload_stream_next(workload_stream_t *stream);
+
+/* workload_stream_close() releases a stream and whatever it has read */
+extern void workload_stream_close(workload_stream_t *stream);